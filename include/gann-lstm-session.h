@@ -0,0 +1,106 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#ifndef __GANN_LSTM_SESSION_H__
+#define __GANN_LSTM_SESSION_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gann.h"
+#include "gann-lstm.h"
+
+/*!
+** the state of one stream of symbols through trained layers, e.g. a user
+** generating text. a step only runs the forward kernels and keeps no caches
+** for the backward pass, so a session is the hidden and cell state of every
+** layer and the last output.
+**
+** the layers are shared by all sessions and only read.
+*/
+typedef struct gnn_lstm_session_s
+{
+  gnn_lstm_t**      layers;
+
+  /*!
+  ** the layers, the last one takes the symbols and layer 0 gives the output
+  */
+  uint              layer_num;
+
+  /*!
+  ** the hidden and cell states of layer p, N of the layer, the cell state of
+  ** a GRU stays zero
+  */
+  float**           h;
+
+  float**           c;
+
+  /*!
+  ** the distribution of the next symbol after the last step, Y of layer 0
+  */
+  float*            probs;
+
+  /*!
+  ** the floats of h, c and probs in one block
+  */
+  float*            data;
+
+  /*!
+  ** the inputs, gates and outputs of a batch led by this session, it only
+  ** grows, so the steps of a server reuse it rather than map it every step
+  */
+  float*            scratch;
+
+  size_t            scratch_size;
+}
+gnn_lstm_session_t;
+
+/*!
+** makes a session at the zero state.
+*/
+gnn_lstm_session_t*
+gnn_lstm_session_new(gnn_lstm_t** layers, uint layer_num);
+
+/*!
+** goes back to the zero state, e.g. for a new sequence.
+*/
+void
+gnn_lstm_session_reset(gnn_lstm_session_t* session);
+
+/*!
+** feeds one symbol.
+**
+** @return the distribution of the next symbol, valid until the next step
+*/
+float const*
+gnn_lstm_session_step(gnn_lstm_session_t* session, int symbol);
+
+/*!
+** feeds one symbol to each of count sessions of the same layers, the weights
+** are loaded once for the batch rather than once per session, and a session
+** steps the same as alone. the batch works in the scratch of sessions[0].
+*/
+void
+gnn_lstm_session_step_batch(gnn_lstm_session_t** sessions, int const* symbols, uint count);
+
+/*!
+** draws the next symbol from the distribution of the last step.
+*/
+int
+gnn_lstm_session_sample(gnn_lstm_session_t const* session, gnn_rng_t* rng);
+
+void
+gnn_lstm_session_free(gnn_lstm_session_t* session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __GANN_LSTM_SESSION_H__
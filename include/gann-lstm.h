@@ -14,9 +14,24 @@
 extern "C" {
 #endif
 
+#include "gann.h"
+
+/*!
+** the vocabulary of gann-w2v-vocab.h, a layer only keeps a pointer to it
+*/
+struct gnn_w2v_vocab_s;
+
 #define OPTIMIZE_ADAM                       0
 #define OPTIMIZE_GRADIENT_DESCENT           1
 
+/*!
+** the cell of a layer, a GRU has three gates and no cell state
+*/
+#define GANN_LSTM_CELL                      0
+#define GANN_GRU_CELL                       1
+
+#define GANN_LSTM_GATES(cell)               ((cell) == GANN_GRU_CELL ? 3 : 4)
+
 typedef struct gnn_lstm_params_s
 {
   // For progress monitoring
@@ -61,6 +76,28 @@ typedef struct gnn_lstm_params_s
   char* store_network_name_json;
   char* store_char_indx_map_name;
 
+  /*!
+  ** 1 trains every layer on a thread of its own, layer p starts timestep t
+  ** as soon as the layer above is done with it, so the layers run in a
+  ** wavefront a timestep apart
+  */
+  int   pipeline;
+
+  /*!
+  ** how many threads train replicas of the layers on slices of the data,
+  ** the optimizer steps with the mean of their gradients. the runs are the
+  ** same for the same seed and workers, 0 or 1 trains on the calling thread
+  ** alone and only then the pipeline is used
+  */
+  int   workers;
+
+  /*!
+  ** the vocabulary whose Huffman tree is the output of layer 0, the symbols
+  ** are its word ids and the rows of Wy its inner nodes, so a step computes
+  ** the path of the symbol rather than all Y outputs. NULL for the softmax
+  */
+  struct gnn_w2v_vocab_s const* huffman;
+
   // General parameters
   unsigned int mini_batch_size;
   double gradient_clip_limit;
@@ -94,85 +131,259 @@ typedef struct gnn_lstm_s
   // Parameters
   gnn_lstm_params_t* params;
 
+  /*!
+  ** GANN_LSTM_CELL or GANN_GRU_CELL. a GRU keeps its update gate in Wf, its
+  ** reset gate in Wi and its candidate in Wc, and has no Wo and bo
+  */
+  int cell;
+
+  /*!
+  ** all weights and biases in one arena of size floats, in the order Wf,
+  ** Wi, Wc, Wo, Wy, bf, bi, bc, bo and by, the arrays below point into it
+  */
+  float* weights;
+
+  size_t size;
+
   /*!
   ** the weights of forget gate
   */
-  double* Wf;
+  float* Wf;
 
   /*!
   ** the weights of input gate
   */
-  double* Wi;
+  float* Wi;
 
   /*!
   ** the weights of input node
   */
-  double* Wc;
+  float* Wc;
 
   /*!
   ** the weights of output gate
   */
-  double* Wo;
+  float* Wo;
 
   /*!
   ** the weights of output
   */
-  double* Wy;
+  float* Wy;
 
   /*!
   ** the bias of forget gate
   */
-  double* bf;
+  float* bf;
 
   /*!
   ** the bias of input gate
   */
-  double* bi;
+  float* bi;
 
   /*!
   ** the bias of input node
   */
-  double* bc;
+  float* bc;
 
   /*!
   ** the bias of output gate
   */
-  double* bo;
+  float* bo;
 
   /*!
   ** the bias of output
   */
-  double* by;
-
-  // descent layer hidden state
-  double* dldh;
-  double* dldho;
-  double* dldhf;
-  double* dldhi;
-  double* dldhc;
-  double* dldc;
-
-  // descent layer input
-  double* dldXi;
-  double* dldXo;
-  double* dldXf;
-  double* dldXc;
-
-  // gradient descent momentum
-  double* Wfm;
-  double* Wim;
-  double* Wcm;
-  double* Wom;
-  double* Wym;
-  double* bfm;
-  double* bim;
-  double* bcm;
-  double* bom;
-  double* bym;
+  float* by;
 }
 gnn_lstm_t;
 
+/*!
+** an arena of the shape of the weights of a layer, for the gradients over a
+** minibatch and the moments of the optimizers, so a backward step adds into
+** it in one pass and an optimizer walks it as one flat vector.
+*/
+typedef struct gnn_lstm_grad_s
+{
+  unsigned int X;
+
+  unsigned int N;
+
+  unsigned int Y;
+
+  unsigned int S;
+
+  /*!
+  ** the arena of size floats, laid out as gnn_lstm_t::weights
+  */
+  float* data;
+
+  size_t size;
+
+  float* Wf;
+  float* Wi;
+  float* Wc;
+  float* Wo;
+  float* Wy;
+
+  float* bf;
+  float* bi;
+  float* bc;
+  float* bo;
+  float* by;
+}
+gnn_lstm_grad_t;
+
+/*!
+** makes a new lstm network instance.
+**
+** @param zeros
+**        1 leaves the weights zero, otherwise they are drawn from rng
+*/
+gnn_lstm_t*
+gnn_lstm_new(int                  X,
+             int                  N,
+             int                  Y,
+             int                  zeros,
+             gnn_lstm_params_t*   params,
+             gnn_rng_t*           rng);
+
+/*!
+** makes a new GRU layer, it trains, steps in sessions and is freed as an
+** lstm layer, and layers of both cells may be stacked.
+*/
+gnn_lstm_t*
+gnn_gru_new(int                  X,
+            int                  N,
+            int                  Y,
+            int                  zeros,
+            gnn_lstm_params_t*   params,
+            gnn_rng_t*           rng);
+
+void
+gnn_lstm_free(gnn_lstm_t* model);
+
+/*!
+** makes a zeroed arena of the shape of a layer.
+*/
+gnn_lstm_grad_t*
+gnn_lstm_grad_new(gnn_lstm_t const* model);
+
+void
+gnn_lstm_grad_zero(gnn_lstm_grad_t* grad);
+
+void
+gnn_lstm_grad_free(gnn_lstm_grad_t* grad);
+
+/*!
+** trains the layers on a sequence of symbols, the last layer takes the one
+** hot input and layer 0 gives the softmax output.
+**
+** @param training_points
+**        the length of X_train and Y_train
+**
+** @param X_train
+**        the input symbols
+**
+** @param Y_train
+**        the expected symbols, usually X_train shifted by one
+**
+** @param loss_out
+**        the moving average of the loss after training
+*/
+void
+gnn_lstm_train(gnn_lstm_t**        model_layers,
+               gnn_lstm_params_t*  params,
+               uint                training_points,
+               int*                X_train,
+               int*                Y_train,
+               uint                layers,
+               double*             loss_out);
+
+/*!
+** Y = AX + b
+*/
+void
+gnn_lstm_full_forward(float* Y, float* A, float* X, float* b, int R, int C);
+
+/*!
+** Y[k] = A * X[k] + b for count inputs, the rows of A are taken 4 at a time
+** against every input, so a batch loads the weights once.
+**
+** @param ldy
+**        the distance of the outputs, at least R
+**
+** @param lda
+**        the distance of the rows of A, at least C, so the product may take
+**        the first C columns of a wider matrix
+**
+** @param ldx
+**        the distance of the inputs, at least C
+*/
+void
+gnn_lstm_batch_forward(float*         Y,
+                       uint           ldy,
+                       float const*   A,
+                       uint           lda,
+                       float const*   X,
+                       uint           ldx,
+                       float const*   b,
+                       int            R,
+                       int            C,
+                       uint           count);
+
+/*!
+** Y += A[:, column], the product of A and a one hot input, e.g. a symbol,
+** is a gather of one column rather than a product over all of them.
+*/
+void
+gnn_lstm_gather_forward(float* Y, float const* A, uint lda, uint column, int R);
+
+/*!
+** dldA += dldY * X', dldb += dldY and dldX = A' * dldY
+*/
+void
+gnn_lstm_full_backward(float* dldY, float* A, float* X, float* dldA, float* dldX, float* dldb, int R, int C);
+
+/*!
+** the backward step of Y = A[:, :C] * X + A[:, column] + b, the column of a
+** one hot input only gets dldY, so its gradient is sparse, and dldX is the
+** delta of X alone.
+*/
+void
+gnn_lstm_gather_backward(float* dldY, float* A, uint lda, float* X, uint column, float* dldA, float* dldX, float* dldb, int R, int C);
+
+double
+gnn_lstm_cross_entropy(float* probabilities, int correct);
+
+void
+gnn_lstm_softmax_forward(float* P, float* Y, int F, double temperature);
+
+/*!
+** the distribution over the words of the vocabulary from the outputs of the
+** inner nodes of its Huffman tree, a word is the product of the sigmoids on
+** its path.
+**
+** @param Y
+**        the outputs Wy * h + by, one per inner node, overwritten by their
+**        sigmoids
+*/
+void
+gnn_lstm_huffman_forward(float* P, float* Y, struct gnn_w2v_vocab_s const* vocab);
+
+void
+gnn_lstm_softmax_backward(float* P, int c, float* dldh, int R);
+
+void
+gnn_lstm_sigmoid_forward(float* Y, float* X, int L);
+
+void
+gnn_lstm_sigmoid_backward(float* dldY, float* Y, float* dldX, int L);
+
+void
+gnn_lstm_tanh_forward(float* Y, float* X, int L);
 
+void
+gnn_lstm_tanh_backward(float* dldY, float* Y, float* dldX, int L);
 
 #ifdef __cplusplus
 }
@@ -17,11 +17,7 @@ extern "C" {
 #include <math.h>
 #include <stdlib.h>
 
-#ifndef GNN_MLP_RANDOM
-/* We use the following for uniform random numbers between 0 and 1.
- * If you have a better function, redefine this macro. */
-#define GNN_MLP_RANDOM() (((float)rand())/RAND_MAX)
-#endif
+#include "gann.h"
 
 typedef float (*gnn_mlp_activate)(float a);
 
@@ -76,9 +72,18 @@ static float MAGICAL_WEIGHT_NUMBER = 1.0f;
 static float MAGICAL_LEARNING_NUMBER = 0.4f;
 
 
+/*!
+** creates the network, the weights are randomized from GANN_RNG_SEED.
+*/
 gnn_mlp_t *
 gnn_mlp_new(int inputs, int hidden_layers, int hidden, int outputs);
 
+/*!
+** sets the weights from -0.5 to 0.5 with the given random stream.
+*/
+void
+gnn_mlp_randomize(gnn_mlp_t* mlp, gnn_rng_t* rng);
+
 void
 gnn_mlp_free(gnn_mlp_t* mlp);
 
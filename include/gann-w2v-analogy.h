@@ -0,0 +1,98 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#ifndef __GANN_W2V_ANALOGY_H__
+#define __GANN_W2V_ANALOGY_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+
+#include "gann.h"
+#include "gann-w2v-store.h"
+#include "gann-w2v-knn.h"
+
+/*!
+** the accuracy of one ": name" section in the analogy file.
+*/
+typedef struct gnn_w2v_analogy_section_s
+{
+  char        name[GANN_W2V_MAX_STRING];
+
+  /*!
+  ** the number of questions
+  */
+  llong       total;
+
+  /*!
+  ** the number of questions whose four words are all in vocabulary
+  */
+  llong       seen;
+
+  /*!
+  ** the number of questions answered right at top 1
+  */
+  llong       correct;
+}
+gnn_w2v_analogy_section_t;
+
+typedef struct gnn_w2v_analogy_s
+{
+  gnn_w2v_analogy_section_t*    sections;
+
+  uint                          section_num;
+
+  llong                         total;
+
+  llong                         seen;
+
+  llong                         correct;
+
+  /*!
+  ** the wall time of answering all questions
+  */
+  double                        seconds;
+
+  double                        queries_per_second;
+}
+gnn_w2v_analogy_t;
+
+/*!
+** answers every "a b c d" question of the analogy file with the word most
+** similar to b - a + c, excluding a, b and c. All questions go through one
+** batched search over the normalized vectors.
+**
+** @param knn
+**        the searcher of store vectors
+**
+** @param path
+**        the analogy file, ": name" lines start sections
+**
+** @return the accuracy, or NULL if the file is not readable, the searcher
+**         is not over the store, or the questions do not fit in one batch
+*/
+gnn_w2v_analogy_t*
+gnn_w2v_analogy_evaluate(gnn_w2v_store_t const*   store,
+                         gnn_w2v_knn_t const*     knn,
+                         const char*              path,
+                         uint                     thread_num);
+
+void
+gnn_w2v_analogy_print(gnn_w2v_analogy_t const* analogy, FILE* out);
+
+void
+gnn_w2v_analogy_free(gnn_w2v_analogy_t* analogy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __GANN_W2V_ANALOGY_H__
@@ -0,0 +1,208 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#ifndef __GANN_W2V_HNSW_H__
+#define __GANN_W2V_HNSW_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+
+#include "gann.h"
+#include "gann-w2v.h"
+#include "gann-w2v-store.h"
+#include "gann-w2v-knn.h"
+
+#define GANN_W2V_HNSW_MAGIC                    "GNNHNSW"
+#define GANN_W2V_HNSW_VERSION                  1
+
+/*!
+** the default recall/latency knobs.
+*/
+#define GANN_W2V_HNSW_M                        16
+#define GANN_W2V_HNSW_EF_CONSTRUCTION          200
+#define GANN_W2V_HNSW_EF_SEARCH                64
+#define GANN_W2V_HNSW_MAX_LEVEL                16
+
+/*!
+** the index file header, all fields are in host byte order, and the arrays
+** of gnn_w2v_hnsw_t follow at their offsets.
+*/
+typedef struct gnn_w2v_hnsw_header_s
+{
+  char        magic[8];
+  uint        version;
+  uint        dim_num;
+  uint        stride;
+  uint        M;
+  uint        M0;
+  uint        ef_construction;
+  uint        ef_search;
+  int         max_level;
+  llong       size;
+  llong       entry_point;
+  ullong      upper_size;
+  ullong      vectors_offset;
+  ullong      levels_offset;
+  ullong      links0_offset;
+  ullong      upper_offsets_offset;
+  ullong      upper_links_offset;
+  ullong      file_size;
+}
+gnn_w2v_hnsw_header_t;
+
+/*!
+** the hierarchical navigable small world graph over normalized vectors, the
+** similarity is cosine.
+**
+** all arrays are flat, so the same layout is used in memory and in the
+** mapped file:
+**   links0       : uint[size * (M0 + 1)], count followed by ids
+**   upper_links  : uint[upper_size], levels 1..levels[i] of node i start at
+**                  upper_offsets[i], each level has M + 1 uints
+*/
+typedef struct gnn_w2v_hnsw_s
+{
+  uint                  dim_num;
+
+  uint                  stride;
+
+  llong                 size;
+
+  /*!
+  ** the max neighbours on upper levels
+  */
+  uint                  M;
+
+  /*!
+  ** the max neighbours on level 0, M0 = 2 * M
+  */
+  uint                  M0;
+
+  uint                  ef_construction;
+
+  /*!
+  ** the candidate list size at query time, larger is more accurate and slower
+  */
+  uint                  ef_search;
+
+  int                   max_level;
+
+  llong                 entry_point;
+
+  /*!
+  ** the normalized vectors, the size = size * stride
+  */
+  float*                vectors;
+
+  uint*                 levels;
+
+  uint*                 links0;
+
+  ullong*               upper_offsets;
+
+  uint*                 upper_links;
+
+  ullong                upper_size;
+
+  /*!
+  ** the node locks used while building
+  */
+  pthread_mutex_t*      locks;
+
+  pthread_mutex_t       global;
+
+  /*!
+  ** the mapped file, or NULL if built in memory
+  */
+  void*                 base;
+
+  size_t                length;
+}
+gnn_w2v_hnsw_t;
+
+/*!
+** builds the index in parallel.
+**
+** @param stride
+**        the float number between two rows in vectors
+**
+** @param M
+**        the max neighbours per node on upper levels, 2 * M on level 0
+**
+** @param ef_construction
+**        the candidate list size when building
+**
+** @param thread_num
+**        the number of building threads
+*/
+gnn_w2v_hnsw_t*
+gnn_w2v_hnsw_new(const float*   vectors,
+                 llong          size,
+                 uint           dim_num,
+                 uint           stride,
+                 uint           M,
+                 uint           ef_construction,
+                 uint           thread_num);
+
+gnn_w2v_hnsw_t*
+gnn_w2v_hnsw_from_w2v(gnn_w2v_t const*      w2v,
+                      uint                  M,
+                      uint                  ef_construction,
+                      uint                  thread_num);
+
+gnn_w2v_hnsw_t*
+gnn_w2v_hnsw_from_store(gnn_w2v_store_t const*  store,
+                        uint                    M,
+                        uint                    ef_construction,
+                        uint                    thread_num);
+
+void
+gnn_w2v_hnsw_free(gnn_w2v_hnsw_t* hnsw);
+
+/*!
+** @return 0 if success, otherwise -1
+*/
+int
+gnn_w2v_hnsw_save(gnn_w2v_hnsw_t const* hnsw, const char* path);
+
+/*!
+** maps a saved index read-only, the result is searchable right away.
+*/
+gnn_w2v_hnsw_t*
+gnn_w2v_hnsw_open(const char* path);
+
+/*!
+** finds the approximate top-k most similar rows of query, with
+** max(k, ef_search) candidates. The search memories are kept per thread
+** and reused until gnn_w2v_hnsw_release.
+**
+** @return the number of neighbours found
+*/
+uint
+gnn_w2v_hnsw_search(gnn_w2v_hnsw_t const*   hnsw,
+                    const float*            query,
+                    uint                    k,
+                    gnn_w2v_neighbor_t*     result);
+
+/*!
+** frees the search memories of the calling thread, which grow with the
+** largest index it searched. A thread that searched should call it before
+** it exits, the next search of the thread allocates them again.
+*/
+void
+gnn_w2v_hnsw_release(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __GANN_W2V_HNSW_H__
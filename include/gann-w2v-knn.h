@@ -0,0 +1,132 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#ifndef __GANN_W2V_KNN_H__
+#define __GANN_W2V_KNN_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gann.h"
+#include "gann-w2v.h"
+#include "gann-w2v-store.h"
+
+/*!
+** the rows of one scan block, the block stays in cache while all queries of
+** a batch are scanned against it.
+*/
+#define GANN_W2V_KNN_ROW_BLOCK                 256
+
+typedef struct gnn_w2v_neighbor_s
+{
+  llong       id;
+
+  float       similarity;
+}
+gnn_w2v_neighbor_t;
+
+/*!
+** the exact nearest neighbour searcher with cosine similarity.
+*/
+typedef struct gnn_w2v_knn_s
+{
+  uint        dim_num;
+
+  /*!
+  ** the float number of one row, padded with zeros to 64 bytes
+  */
+  uint        stride;
+
+  llong       size;
+
+  /*!
+  ** the L2-normalized vectors, the size = size * stride
+  */
+  float*      vectors;
+}
+gnn_w2v_knn_t;
+
+/*!
+** pushes a candidate to the min-heap of k best neighbours.
+*/
+void
+gnn_w2v_neighbors_push(gnn_w2v_neighbor_t*      heap,
+                       uint*                    size,
+                       uint                     k,
+                       llong                    id,
+                       float                    similarity);
+
+/*!
+** sorts the heap by similarity in descending order.
+*/
+void
+gnn_w2v_neighbors_sort(gnn_w2v_neighbor_t* heap, uint size);
+
+/*!
+** copies and normalizes the row-major vectors.
+**
+** @param stride
+**        the float number between two rows in vectors
+*/
+gnn_w2v_knn_t*
+gnn_w2v_knn_new(const float*    vectors,
+                llong           size,
+                uint            dim_num,
+                uint            stride);
+
+gnn_w2v_knn_t*
+gnn_w2v_knn_from_w2v(gnn_w2v_t const* w2v);
+
+gnn_w2v_knn_t*
+gnn_w2v_knn_from_store(gnn_w2v_store_t const* store);
+
+void
+gnn_w2v_knn_free(gnn_w2v_knn_t* knn);
+
+/*!
+** finds the top-k most similar rows of query.
+**
+** @param result
+**        the k neighbours at most, sorted by similarity in descending order
+**
+** @return the number of neighbours found
+*/
+uint
+gnn_w2v_knn_search(gnn_w2v_knn_t const*   knn,
+                   const float*           query,
+                   uint                   k,
+                   gnn_w2v_neighbor_t*    result);
+
+/*!
+** finds the top-k most similar rows for each query. Queries are spread over
+** threads, each thread walks row blocks and computes 2 queries x 4 rows
+** tiles in registers, with the heap push fused in instead of storing the
+** similarity matrix.
+**
+** @param queries
+**        the row-major queries, the size = query_num * dim_num
+**
+** @param results
+**        the neighbours, the size = query_num * k, and the unused slots
+**        have id -1
+*/
+void
+gnn_w2v_knn_search_batch(gnn_w2v_knn_t const*   knn,
+                         const float*           queries,
+                         uint                   query_num,
+                         uint                   k,
+                         gnn_w2v_neighbor_t*    results,
+                         uint                   thread_num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __GANN_W2V_KNN_H__
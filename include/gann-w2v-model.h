@@ -0,0 +1,152 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#ifndef __GANN_W2V_MODEL_H__
+#define __GANN_W2V_MODEL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gann.h"
+#include "gann-w2v.h"
+#include "gann-w2v-reader.h"
+
+#define GANN_W2V_MODEL_MAGIC                   "GNNW2VM"
+#define GANN_W2V_MODEL_VERSION                 2
+
+#define GANN_W2V_CHECKPOINT_MAGIC              "GNNW2VC"
+
+/*!
+** the header of a model file, which keeps everything to continue training,
+** unlike the store of gnn_w2v_save that keeps the final vectors only. all
+** fields are in host byte order.
+**
+** file layout:
+**   header
+**   words    : vocab_size of (ullong count, uint length, length bytes,
+**              char codelen, codelen bytes of code, int[codelen] of point)
+**   hidden, output and negative weights : float[vocab_size * dim_num]
+**   character weights : float[char_size * dim_num]
+**   subword weights   : float[bucket_size * dim_num]
+*/
+typedef struct gnn_w2v_model_header_s
+{
+  char        magic[8];
+
+  uint        version;
+
+  /*!
+  ** the number of dimensions
+  */
+  uint        dim_num;
+
+  ullong      vocab_size;
+
+  ullong      char_size;
+
+  ullong      bucket_size;
+}
+gnn_w2v_model_header_t;
+
+/*!
+** saves the vocabulary with its counts and all weight matrices.
+**
+** @return 0 if success, otherwise -1
+*/
+int
+gnn_w2v_model_save(gnn_w2v_t const*         w2v,
+                   gnn_w2v_vocab_t const*   vocab,
+                   const char*              path);
+
+/*!
+** loads a model saved by gnn_w2v_model_save, the vocabulary is rebuilt from
+** the saved words in their saved order with their saved Huffman codes, so the
+** rows match, also after the vocabulary was grown.
+**
+** @param mem_flags
+**        the placement of the loaded matrices, see gnn_w2v_new
+**
+** @return 0 and the vocabulary and the network, or -1 if the file can not
+**         be read
+*/
+int
+gnn_w2v_model_load(const char*              path,
+                   int                      mem_flags,
+                   gnn_w2v_vocab_t**        vocab,
+                   gnn_w2v_t**              w2v);
+
+/*!
+** the training state besides the weights, taken when the training threads
+** are between two segments, so a job resumed from it goes on like the one
+** that saved it.
+*/
+typedef struct gnn_w2v_checkpoint_s
+{
+  float                       alpha;
+
+  /*!
+  ** the training threads, one stream per thread
+  */
+  uint                        thread_num;
+
+  /*!
+  ** the position of the next unread word of the corpus
+  */
+  gnn_w2v_reader_state_t      reader;
+
+  gnn_rng_t*                  rngs;
+}
+gnn_w2v_checkpoint_t;
+
+/*!
+** the trailer of a checkpoint file, which is a model file followed by the
+** trailer and the thread streams, gnn_rng_t[thread_num].
+*/
+typedef struct gnn_w2v_checkpoint_header_s
+{
+  char                        magic[8];
+
+  float                       alpha;
+
+  uint                        thread_num;
+
+  gnn_w2v_reader_state_t      reader;
+}
+gnn_w2v_checkpoint_header_t;
+
+/*!
+** saves a checkpoint, it is written to path.tmp and renamed over path.
+**
+** @return 0 if success, otherwise -1
+*/
+int
+gnn_w2v_checkpoint_save(gnn_w2v_t const*                w2v,
+                        gnn_w2v_vocab_t const*          vocab,
+                        gnn_w2v_checkpoint_t const*     checkpoint,
+                        const char*                     path);
+
+/*!
+** loads a checkpoint, the thread streams are allocated and the caller frees
+** checkpoint->rngs.
+**
+** @return 0 if success, otherwise -1
+*/
+int
+gnn_w2v_checkpoint_load(const char*                     path,
+                        int                             mem_flags,
+                        gnn_w2v_vocab_t**               vocab,
+                        gnn_w2v_t**                     w2v,
+                        gnn_w2v_checkpoint_t*           checkpoint);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __GANN_W2V_MODEL_H__
@@ -0,0 +1,174 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#ifndef __GANN_W2V_PQ_H__
+#define __GANN_W2V_PQ_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gann.h"
+#include "gann-w2v.h"
+#include "gann-w2v-store.h"
+#include "gann-w2v-knn.h"
+
+#define GANN_W2V_PQ_MAGIC                      "GNNW2VQ"
+#define GANN_W2V_PQ_VERSION                    1
+
+/*!
+** the centroids of one subspace, so one code is one byte.
+*/
+#define GANN_W2V_PQ_CENTROIDS                  256
+
+#define GANN_W2V_PQ_ITERATIONS                 25
+
+/*!
+** the max training vectors for k-means, the others are only encoded.
+*/
+#define GANN_W2V_PQ_MAX_TRAINING               65536
+
+/*!
+** the quantizer file header, all fields are in host byte order, and the
+** centroids and codes follow at their offsets.
+*/
+typedef struct gnn_w2v_pq_header_s
+{
+  char        magic[8];
+  uint        version;
+  uint        dim_num;
+  uint        m;
+  uint        sub_dim;
+  uint        centroid_num;
+  uint        reserved;
+  llong       size;
+  ullong      centroids_offset;
+  ullong      codes_offset;
+  ullong      file_size;
+}
+gnn_w2v_pq_header_t;
+
+/*!
+** the product quantizer over normalized vectors, every vector is stored as
+** m bytes, one centroid index per subspace.
+*/
+typedef struct gnn_w2v_pq_s
+{
+  uint            dim_num;
+
+  /*!
+  ** the number of subspaces
+  */
+  uint            m;
+
+  /*!
+  ** the dimensions of one subspace, m * sub_dim >= dim_num and the tail is
+  ** padded with zeros
+  */
+  uint            sub_dim;
+
+  /*!
+  ** the used centroids per subspace, at most 256
+  */
+  uint            centroid_num;
+
+  llong           size;
+
+  /*!
+  ** the centroids, the size = m * GANN_W2V_PQ_CENTROIDS * sub_dim
+  */
+  float*          centroids;
+
+  /*!
+  ** the codes, the size = size * m
+  */
+  unsigned char*  codes;
+
+  /*!
+  ** the mapped file, or NULL if trained in memory
+  */
+  void*           base;
+
+  size_t          length;
+}
+gnn_w2v_pq_t;
+
+/*!
+** trains the codebooks with k-means per subspace and encodes all vectors.
+**
+** @param stride
+**        the float number between two rows in vectors
+**
+** @param m
+**        the number of subspaces, the code size in bytes
+**
+** @param thread_num
+**        the number of threads, subspaces are trained in parallel
+*/
+gnn_w2v_pq_t*
+gnn_w2v_pq_new(const float*   vectors,
+               llong          size,
+               uint           dim_num,
+               uint           stride,
+               uint           m,
+               uint           thread_num);
+
+gnn_w2v_pq_t*
+gnn_w2v_pq_from_w2v(gnn_w2v_t const* w2v, uint m, uint thread_num);
+
+gnn_w2v_pq_t*
+gnn_w2v_pq_from_store(gnn_w2v_store_t const* store, uint m, uint thread_num);
+
+void
+gnn_w2v_pq_free(gnn_w2v_pq_t* pq);
+
+/*!
+** encodes a vector as m bytes, the vector is normalized first.
+*/
+void
+gnn_w2v_pq_encode(gnn_w2v_pq_t const* pq, const float* vector, unsigned char* code);
+
+/*!
+** reconstructs the normalized vector of row id.
+**
+** @param vector
+**        the output, the size = dim_num
+*/
+void
+gnn_w2v_pq_decode(gnn_w2v_pq_t const* pq, llong id, float* vector);
+
+/*!
+** finds the top-k rows by asymmetric distance, the query is not quantized,
+** its similarity to every centroid is looked up from a per-query table.
+**
+** @return the number of neighbours found
+*/
+uint
+gnn_w2v_pq_search(gnn_w2v_pq_t const*     pq,
+                  const float*            query,
+                  uint                    k,
+                  gnn_w2v_neighbor_t*     result);
+
+/*!
+** @return 0 if success, otherwise -1
+*/
+int
+gnn_w2v_pq_save(gnn_w2v_pq_t const* pq, const char* path);
+
+/*!
+** maps the saved codebooks and codes read-only.
+*/
+gnn_w2v_pq_t*
+gnn_w2v_pq_open(const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __GANN_W2V_PQ_H__
@@ -0,0 +1,208 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#ifndef __GANN_W2V_READER_H__
+#define __GANN_W2V_READER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "gann.h"
+#include "gann-w2v.h"
+
+/*!
+** the default sentence slots in the ring, a power of two.
+*/
+#define GANN_W2V_READER_CAPACITY               256
+
+/*!
+** one sentence of word ids, filled by the reader and copied out by a
+** training thread.
+*/
+typedef struct gnn_w2v_sentence_s
+{
+  uint        length;
+
+  int         ids[GANN_W2V_MAX_SENTENCE_LENGTH];
+}
+gnn_w2v_sentence_t;
+
+/*!
+** the position of the reader in the passes over the corpus, enough to start
+** a new reader exactly where an old one stopped.
+*/
+typedef struct gnn_w2v_reader_state_s
+{
+  /*!
+  ** the current pass, and the passes are over when it reaches iterations
+  */
+  uint        iteration;
+
+  /*!
+  ** the file offset of the next word in the current pass
+  */
+  ullong      offset;
+
+  /*!
+  ** the stream of subsampling
+  */
+  gnn_rng_t   rng;
+}
+gnn_w2v_reader_state_t;
+
+/*!
+** the corpus reader, one producer thread reads, looks up and subsamples the
+** words, and pushes whole sentences into a bounded lock-free ring that the
+** training threads pop from.
+**
+** every slot has a sequence number: slot i is ready for the consumer taking
+** position p when its sequence is p + 1, and ready for the producer when it
+** is p.
+*/
+typedef struct gnn_w2v_reader_s
+{
+  gnn_w2v_vocab_t const*      vocab;
+
+  char*                       path;
+
+  uint                        sample;
+
+  /*!
+  ** the start position, and the position of the next unread word once the
+  ** reader thread is done
+  */
+  gnn_w2v_reader_state_t      state;
+
+  /*!
+  ** the reader stops at the first sentence end after pushing this number of
+  ** words, and 0 means no limit
+  */
+  ullong                      limit;
+
+  /*!
+  ** the passes over the corpus
+  */
+  uint                        iterations;
+
+  ullong                      train_words;
+
+  uint                        capacity;
+
+  gnn_w2v_sentence_t*         slots;
+
+  atomic_ullong*              sequences;
+
+  /*!
+  ** the next position to pop, shared by the consumers
+  */
+  atomic_ullong               head;
+
+  char                        padding[64];
+
+  /*!
+  ** the next position to push, owned by the producer
+  */
+  ullong                      tail;
+
+  /*!
+  ** the words pushed so far
+  */
+  atomic_ullong               word_count;
+
+  atomic_int                  done;
+
+  pthread_t                   thread;
+}
+gnn_w2v_reader_t;
+
+/*!
+** creates the reader and starts its thread.
+**
+** @param iterations
+**        the passes over the corpus before the reader is drained
+**
+** @param capacity
+**        the sentence slots, rounded up to a power of two
+**
+** @param seed
+**        the seed of subsampling, the reader takes stream 0 of it
+**
+** @return the reader, or NULL if the file can not be opened
+*/
+gnn_w2v_reader_t*
+gnn_w2v_reader_new(const char*              path,
+                   gnn_w2v_vocab_t const*   vocab,
+                   uint                     sample,
+                   uint                     iterations,
+                   uint                     capacity,
+                   ullong                   seed);
+
+/*!
+** creates a reader that starts at a saved position, e.g. of a checkpoint.
+**
+** @param limit
+**        the words to push before the reader stops at a sentence end, 0
+**        reads to the end of the passes
+**
+** @return the reader, or NULL if the file can not be opened
+*/
+gnn_w2v_reader_t*
+gnn_w2v_reader_resume(const char*                     path,
+                      gnn_w2v_vocab_t const*          vocab,
+                      uint                            sample,
+                      uint                            iterations,
+                      uint                            capacity,
+                      gnn_w2v_reader_state_t const*   state,
+                      ullong                          limit);
+
+/*!
+** pops the next sentence, blocking while the ring is empty, it is safe to
+** call from many threads.
+**
+** @param ids
+**        the output, at least GANN_W2V_MAX_SENTENCE_LENGTH ids
+**
+** @return the sentence length, and 0 when the corpus is finished
+*/
+uint
+gnn_w2v_reader_next(gnn_w2v_reader_t* reader, int* ids);
+
+/*!
+** pops the sentence at the position of one of consumer_num consumers,
+** consumer i starts at position i and takes every consumer_num-th sentence,
+** so each consumer gets the same sentences on every run. Every consumer must
+** take until the end, and gnn_w2v_reader_next must not be mixed in.
+**
+** @param position
+**        the next position of the consumer, it is advanced by consumer_num
+**
+** @param ids
+**        the output, at least GANN_W2V_MAX_SENTENCE_LENGTH ids
+**
+** @return the sentence length, and 0 when the corpus is finished
+*/
+uint
+gnn_w2v_reader_take(gnn_w2v_reader_t* reader, ullong* position, uint consumer_num, int* ids);
+
+/*!
+** joins the reader thread and frees the ring, every consumer must be done,
+** and reader->state is read before.
+*/
+void
+gnn_w2v_reader_free(gnn_w2v_reader_t* reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __GANN_W2V_READER_H__
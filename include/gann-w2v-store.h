@@ -0,0 +1,177 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#ifndef __GANN_W2V_STORE_H__
+#define __GANN_W2V_STORE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gann.h"
+#include "gann-w2v.h"
+
+#define GANN_W2V_STORE_MAGIC                   "GNNW2VB"
+#define GANN_W2V_STORE_VERSION                 1
+
+/*!
+** the alignment of vector block in file, it is page size so that the mapped
+** vectors are page aligned as well as cache line aligned.
+*/
+#define GANN_W2V_STORE_ALIGN                   4096
+
+/*!
+** every vector row is padded to a multiple of this float number (64 bytes).
+*/
+#define GANN_W2V_STORE_ROW_FLOATS              16
+
+#define GANN_W2V_STORE_EMPTY                   0xFFFFFFFF
+
+/*!
+** the binary embedding file header, all fields are in host byte order.
+**
+** file layout:
+**   header
+**   vectors  : float[vocab_size * stride], at vectors_offset (page aligned)
+**   offsets  : ullong[vocab_size + 1], the word offsets in strings
+**   strings  : zero terminated words
+**   hashes   : uint[hash_size], open addressing table of word ids
+*/
+typedef struct gnn_w2v_store_header_s
+{
+  char        magic[8];
+
+  uint        version;
+
+  /*!
+  ** the number of dimensions
+  */
+  uint        dim_num;
+
+  /*!
+  ** the size of vocabulary words
+  */
+  ullong      vocab_size;
+
+  /*!
+  ** the float number of one vector row, stride >= dim_num
+  */
+  ullong      stride;
+
+  ullong      vectors_offset;
+
+  ullong      offsets_offset;
+
+  ullong      strings_offset;
+
+  ullong      hashes_offset;
+
+  /*!
+  ** the size of hash table, always power of two
+  */
+  ullong      hash_size;
+
+  ullong      file_size;
+}
+gnn_w2v_store_header_t;
+
+/*!
+** the read-only embedding store backed by a shared memory mapping, so all
+** processes opening the same file share one page-cached copy.
+*/
+typedef struct gnn_w2v_store_s
+{
+  uint                  dim_num;
+
+  uint                  stride;
+
+  llong                 vocab_size;
+
+  /*!
+  ** the vectors, the size = vocab_size * stride
+  */
+  const float*          vectors;
+
+  const ullong*         offsets;
+
+  const char*           strings;
+
+  const uint*           hashes;
+
+  ullong                hash_mask;
+
+  /*!
+  ** the mapped file
+  */
+  void*                 base;
+
+  size_t                length;
+}
+gnn_w2v_store_t;
+
+/*!
+** saves the trained input vectors (hidden weights) in binary store format.
+**
+** @param w2v
+**        the trained word2vec network
+**
+** @param vocab
+**        the vocabulary used to train the network
+**
+** @param path
+**        the output file path
+**
+** @return 0 if success, otherwise -1
+*/
+int
+gnn_w2v_save(gnn_w2v_t const*           w2v,
+             gnn_w2v_vocab_t const*     vocab,
+             const char*                path);
+
+/*!
+** saves vectors of any row-major matrix in binary store format, the word of
+** row i is words[i].
+*/
+int
+gnn_w2v_store_write(const char*         path,
+                    const float*        vectors,
+                    const char* const*  words,
+                    llong               vocab_size,
+                    uint                dim_num);
+
+/*!
+** opens the binary embedding file as read-only mapping.
+**
+** @return the store, or NULL if failed
+*/
+gnn_w2v_store_t*
+gnn_w2v_store_open(const char* path);
+
+void
+gnn_w2v_store_close(gnn_w2v_store_t* store);
+
+/*!
+** finds the word id in O(1).
+**
+** @return the word id, or -1 if not found
+*/
+llong
+gnn_w2v_store_index(gnn_w2v_store_t const* store, const char* word);
+
+const char*
+gnn_w2v_store_word(gnn_w2v_store_t const* store, llong id);
+
+const float*
+gnn_w2v_store_vector(gnn_w2v_store_t const* store, llong id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __GANN_W2V_STORE_H__
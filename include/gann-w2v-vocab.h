@@ -0,0 +1,105 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#ifndef __GANN_W2V_VOCAB_H__
+#define __GANN_W2V_VOCAB_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gann.h"
+
+/*!
+** the word and vocabulary types of word2vec, kept apart from gann-w2v.h so
+** that the lstm huffman output can use them without the gfc dependency.
+*/
+typedef struct gnn_w2v_word_s
+{
+  ullong      count;
+
+  int*        point;
+
+  int*        character;
+  int         character_size;
+  int*        character_emb_select;
+
+  int*        subword;
+  int         subword_size;
+
+  char*       word;
+
+  int         utf8len;
+
+  int         len;
+
+  char*       code;
+
+  char        codelen;
+
+  float*      weights;
+
+  uint        index;
+
+}
+gnn_w2v_word_t;
+
+typedef struct gnn_w2v_vocab_s
+{
+  /*!
+  ** the distince words reading from file
+  */
+  gnn_w2v_word_t*       words;
+
+  /*!
+  ** the hash value for each word
+  */
+  uint*                 hashes;
+
+  /*!
+  ** the size of words
+  */
+  llong                 size;
+
+  /*!
+  ** the allocated words
+  */
+  llong                 max_size;
+
+  /*!
+  ** the size of characters
+  */
+  llong                 char_size;
+
+  int*                  unigram;
+
+  /*!
+  ** the flat arena of character ids of all words, the character field of
+  ** each word points into it
+  */
+  int*                  characters;
+
+  /*!
+  ** the size of subword buckets, 0 until the subwords are computed
+  */
+  llong                 bucket_size;
+
+  /*!
+  ** the flat arena of subword bucket ids of all words, the subword field of
+  ** each word points into it
+  */
+  int*                  subwords;
+}
+gnn_w2v_vocab_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __GANN_W2V_VOCAB_H__
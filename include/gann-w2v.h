@@ -18,6 +18,7 @@ extern "C" {
 #include <gfc.h>
 
 #include "gann.h"
+#include "gann-w2v-vocab.h"
 
 #define GANN_W2V_MAX_STRING                    100
 #define GANN_W2V_EXP_TABLE_SIZE                1000
@@ -27,6 +28,25 @@ extern "C" {
 #define GANN_W2V_MIN_CHINESE                   0x4E00
 #define GANN_W2V_MAX_CHINESE                   0x9FA5
 
+/*!
+** the character positions in word for position-based character embeddings:
+** single, begin, end and middle.
+*/
+#define GANN_W2V_CHAR_POSITIONS                4
+
+/*!
+** the subword n-grams in UTF-8 code points, the word is wrapped with '<'
+** and '>' first.
+*/
+#define GANN_W2V_MIN_NGRAM                     3
+#define GANN_W2V_MAX_NGRAM                     6
+#define GANN_W2V_MAX_SUBWORDS                  (GANN_W2V_MAX_STRING * 4)
+
+/*!
+** the suggested bucket size of the hashed subword matrix.
+*/
+#define GANN_W2V_BUCKET_SIZE                   2000000
+
 /*!
 ** the word2vec neural network
 */
@@ -78,64 +98,27 @@ typedef struct gnn_w2v_s
   */
   float*      char_weights;
 
-  uint*       embedded_count;
-
-  uint*       last_embedded_count;
-}
-gnn_w2v_t;
-
-typedef struct gnn_w2v_word_s
-{
-  ullong      count;
-
-  int*        point;
-
-  int*        character;
-  int         character_size;
-  int*        character_emb_select;
-
-  char*       word;
-
-  int         utf8len;
-
-  int         len;
-
-  char*       code;
-
-  char        codelen;
-
-  float*      weights;
-
-  uint        index;
-
-}
-gnn_w2v_word_t;
-
-typedef struct gnn_w2v_vocab_s
-{
   /*!
-  ** the distince words reading from file
+  ** the size of hashed subword buckets, and 0 means no subwords.
   */
-  gnn_w2v_word_t*       words;
+  uint        bucket_size;
 
   /*!
-  ** the hash value for each word
+  ** the subword weights, the size = bucket_size * dim_num
   */
-  uint*                 hashes;
+  float*      bucket_weights;
 
-  /*!
-  ** the size of words
-  */
-  llong                 size;
+  uint*       embedded_count;
+
+  uint*       last_embedded_count;
 
   /*!
-  ** the size of characters
+  ** the placement flags of the weight matrices
   */
-  llong                 char_size;
-
-  int*                  unigram;
+  int         mem_flags;
 }
-gnn_w2v_vocab_t;
+gnn_w2v_t;
+
 
 
 /*!
@@ -152,10 +135,37 @@ gnn_w2v_word_index(gnn_w2v_vocab_t* vocab, const char* word);
 
 
 /*!
-** build
+** creates an empty vocabulary with the sentence end </s> only.
+*/
+gnn_w2v_vocab_t*
+gnn_w2v_vocab_new(void);
+
+/*!
+** rebuilds the tables derived from the words and their counts: the unigram
+** table of negative sampling, the characters and, if the bucket size is set,
+** the subwords. the Huffman codes are built for the words without them, the
+** words with codes keep theirs.
 */
 void
-gnn_w2v_unigram_build(gnn_w2v_vocab_t* vocab);
+gnn_w2v_vocab_build(gnn_w2v_vocab_t* vocab);
+
+/*!
+** counts the words of a new text into the vocabulary and rebuilds it, the
+** known words keep their ids and the unseen ones are appended.
+**
+** the known words keep their Huffman codes too, the new words hang below the
+** leaf of </s>, so their codes are longer than a rebuilt tree would give
+** them.
+**
+** @return the number of new words, or -1 if the file can not be opened
+**
+** @see gnn_w2v_grow to add their rows to a trained network
+*/
+llong
+gnn_w2v_vocab_grow(gnn_w2v_vocab_t* vocab, const char* train_file_path);
+
+void
+gnn_w2v_vocab_free(gnn_w2v_vocab_t* vocab);
 
 int
 gnn_w2v_vocab_add(gnn_w2v_vocab_t* vocab, char *word, int is_non_comp);
@@ -163,13 +173,96 @@ gnn_w2v_vocab_add(gnn_w2v_vocab_t* vocab, char *word, int is_non_comp);
 void
 gnn_w2v_vocab_sort(gnn_w2v_vocab_t* vocab);
 
+/*!
+** gets the character embedding ids of the Chinese characters in word, the
+** other characters are skipped.
+**
+** @return the number of ids, at most max_size
+*/
+int
+gnn_w2v_characters(const char* word, int* ids, int max_size);
+
+/*!
+** precomputes the character ids of all words into the flat arena, and sets
+** the size of characters.
+*/
+void
+gnn_w2v_vocab_characters(gnn_w2v_vocab_t* vocab);
+
+/*!
+** gets the hashed bucket ids of the character n-grams of word, from
+** GANN_W2V_MIN_NGRAM to GANN_W2V_MAX_NGRAM code points.
+**
+** @return the number of ids, at most max_size
+*/
+int
+gnn_w2v_subwords(const char* word, int* ids, int max_size, uint bucket_size);
+
+/*!
+** precomputes the subword ids of all words into the flat arena, called after
+** gnn_w2v_read and before gnn_w2v_new to train with subwords.
+**
+** @param bucket_size
+**        the rows of the subword matrix, e.g. GANN_W2V_BUCKET_SIZE, and 0
+**        turns subwords off
+*/
+void
+gnn_w2v_vocab_subwords(gnn_w2v_vocab_t* vocab, uint bucket_size);
+
+/*!
+** creates the network with randomized weights.
+**
+** @param mem_flags
+**        the placement of the weight matrices, GANN_MEM_DEFAULT or a
+**        combination of GANN_MEM_HUGE_PAGES, GANN_MEM_INTERLEAVE and
+**        GANN_MEM_FIRST_TOUCH
+**
+** @param rng
+**        the random stream of the initial weights, or NULL to leave them
+**        zero, e.g. when they are loaded
+*/
 gnn_w2v_t*
-gnn_w2v_new(gnn_w2v_vocab_t* vocab,
-            uint dimensions);
+gnn_w2v_new(gnn_w2v_vocab_t*   vocab,
+            uint               dimensions,
+            int                mem_flags,
+            gnn_rng_t*         rng);
 
 void
 gnn_w2v_free(gnn_w2v_t* w2v);
 
+/*!
+** adds the rows of the words appended by gnn_w2v_vocab_grow, randomized like
+** gnn_w2v_new, the trained rows are kept.
+**
+** the known words keep their Huffman paths, so the output rows of their
+** inner nodes stay trained, the new inner nodes take the new output rows.
+*/
+void
+gnn_w2v_grow(gnn_w2v_t* w2v, gnn_w2v_vocab_t const* vocab, gnn_rng_t* rng);
+
+/*!
+** composes the vector of word id, the mean of its word vector and its
+** subword vectors, averaged with its mean character vector if it has Chinese
+** characters.
+**
+** @param vec
+**        the output, the size = dim_num
+*/
+void
+gnn_w2v_vector(gnn_w2v_t const*         w2v,
+               gnn_w2v_vocab_t const*   vocab,
+               llong                    id,
+               real*                    vec);
+
+/*!
+** composes the vector of an out-of-vocabulary word from its subword buckets
+** and its characters, the vocabulary is not needed.
+**
+** @return the number of subwords and characters used, and 0 means no vector
+*/
+int
+gnn_w2v_oov_vector(gnn_w2v_t const* w2v, const char* word, real* vec);
+
 /*!
 **
 */
@@ -177,19 +270,88 @@ gnn_w2v_vocab_t*
 gnn_w2v_read(const char* train_file_path);
 
 /*!
+** writes the trained input vectors in text format, one word per line.
 **
+** @see gnn_w2v_save for the binary format
 */
 void
-gnn_w2v_train(gnn_w2v_vocab_t*      vocab,
-              uint                  dims,
-              uint                  layer_size,
-              const char*           model_file_path);
+gnn_w2v_train(gnn_w2v_t const*          w2v,
+              gnn_w2v_vocab_t const*    vocab,
+              const char*               model_file_path);
 
-void
-gnn_w2v_skipgram(const char*            text_path,
-                 gnn_w2v_vocab_t*       vocab,
-                 uint                   sample,
-                 uint                   window);
+/*!
+** the options of a skip-gram job.
+*/
+typedef struct gnn_w2v_skipgram_options_s
+{
+  /*!
+  ** the checkpoint file, NULL turns the checkpoints off
+  */
+  const char*   checkpoint_path;
+
+  /*!
+  ** the trained words between two checkpoints, 0 turns the checkpoints off.
+  ** At every checkpoint the training threads are joined and the weights are
+  ** copied while they are stopped, only the file is written in the
+  ** background.
+  */
+  ullong        checkpoint_words;
+}
+gnn_w2v_skipgram_options_t;
+
+/*!
+** trains the skip-gram model and returns the trained network, the caller
+** owns the result and frees it with gnn_w2v_free.
+**
+** @param options
+**        the checkpoints of the job, or NULL for none
+**
+** @see gnn_w2v_skipgram_resume
+*/
+gnn_w2v_t*
+gnn_w2v_skipgram(const char*                            text_path,
+                 gnn_w2v_vocab_t*                       vocab,
+                 uint                                   sample,
+                 uint                                   window,
+                 gnn_w2v_skipgram_options_t const*      options);
+
+/*!
+** continues the training of a network on a new text, e.g. the daily delta
+** of a corpus, after its vocabulary and the network are grown.
+**
+** @return 0 if success, or -1 if the text can not be opened or the network
+**         does not match the vocabulary
+*/
+int
+gnn_w2v_skipgram_continue(gnn_w2v_t*                            w2v,
+                          const char*                           text_path,
+                          gnn_w2v_vocab_t*                      vocab,
+                          uint                                  sample,
+                          uint                                  window,
+                          gnn_w2v_skipgram_options_t const*     options);
+
+/*!
+** resumes an interrupted training from its latest checkpoint, the text,
+** sample and window must be the ones of the interrupted job. Only with one
+** training thread is the result the same as if it never stopped, more
+** threads update the weights hogwild in an order of their own.
+**
+** @param options
+**        the checkpoints of the resumed job, or NULL for none
+**
+** @param vocab
+**        the output, the vocabulary saved in the checkpoint
+**
+** @return the trained network, or NULL if the checkpoint or the text can
+**         not be read
+*/
+gnn_w2v_t*
+gnn_w2v_skipgram_resume(const char*                             checkpoint,
+                        const char*                             text_path,
+                        uint                                    sample,
+                        uint                                    window,
+                        gnn_w2v_skipgram_options_t const*       options,
+                        gnn_w2v_vocab_t**                       vocab);
 
 #ifdef __cplusplus
 }
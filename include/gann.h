@@ -30,15 +30,97 @@ typedef unsigned long long        ullong;
 typedef long long                 llong;
 typedef float                     real;
 
+/*!
+** the default seed of the random generators.
+*/
+#define GANN_RNG_SEED                     5489ULL
+
+/*!
+** the counter-based random generator, the n-th number of a stream is
+** splitmix64(key + n * golden), so it has no hidden state, a stream jumps
+** anywhere at once, and every thread owns a stream of the same seed.
+*/
+typedef struct gnn_rng_s
+{
+  /*!
+  ** derived from the seed and the stream
+  */
+  ullong      key;
+
+  ullong      counter;
 
+  /*!
+  ** the second normal number of the last Box-Muller pair
+  */
+  float       spare;
+
+  int         has_spare;
+}
+gnn_rng_t;
+
+/*!
+** initializes the stream of a seed, the streams of one seed are independent,
+** e.g. one per thread.
+*/
+void
+gnn_rng_init(gnn_rng_t* rng, ullong seed, ullong stream);
+
+/*!
+** the splitmix64 finalizer, a bijective hash of 64 bits.
+*/
+ullong
+gnn_rng_mix(ullong x);
+
+ullong
+gnn_rng_next(gnn_rng_t* rng);
+
+/*!
+** @return a uniform number in [0, 1)
+*/
 float
-gnn_num_random(float mu, float sigma);
+gnn_rng_uniform(gnn_rng_t* rng);
+
+/*!
+** @return a standard normal number
+*/
+float
+gnn_rng_gaussian(gnn_rng_t* rng);
+
+float
+gnn_num_random(gnn_rng_t* rng, float mu, float sigma);
 
 void
 gnn_vec_print(float const* vec, uint size);
 
+/*!
+** creates a vector of normal numbers scaled by sqrt(5 / random), or zeros
+** if random <= 0, and rng may be NULL then.
+*/
 float*
-gnn_vec_new(uint size, float seed);
+gnn_vec_new(uint size, float random, gnn_rng_t* rng);
+
+/*!
+** fills a vector with uniform numbers in [low, high), the stream of rng is
+** hashed per element in SIMD lanes and split over threads.
+**
+** element i takes counter rng->counter + i + 1, the same number a loop of
+** gnn_rng_uniform would give, so the result does not depend on the threads,
+** and the stream is advanced past the vector.
+**
+** @param thread_num
+**        the threads, 0 takes one per online CPU, small vectors are always
+**        filled by the caller
+*/
+void
+gnn_vec_fill_uniform(float* vec, size_t size, float low, float high, gnn_rng_t* rng, uint thread_num);
+
+/*!
+** fills a vector with normal numbers by Box-Muller on the uniform lanes,
+** element 2k and 2k + 1 are the pair of counters 2k + 1 and 2k + 2, and the
+** stream is advanced by size rounded up to even.
+*/
+void
+gnn_vec_fill_gaussian(float* vec, size_t size, float mu, float sigma, gnn_rng_t* rng, uint thread_num);
 
 void
 gnn_vec_copy(float* dst, const float* src, uint size);
@@ -67,6 +149,109 @@ gnn_vec_multiply_scalar(float* dst, float multiplicand, uint size);
 void
 gnn_vec_divide_scalar(float* dst, float dividend, uint size);
 
+/*!
+** the SIMD kernels, vectorized with AVX-512 or AVX2 when the compiler
+** targets them, otherwise plain loops.
+*/
+float
+gnn_vec_dot(const float* a, const float* b, uint size);
+
+void
+gnn_vec_dot4(float* ret, const float* x, const float* rows, uint stride, uint size);
+
+void
+gnn_vec_dot2x4(float* ret, const float* x, uint x_stride, const float* rows, uint stride, uint size);
+
+/*!
+** dst += alpha * x
+*/
+void
+gnn_vec_axpy(float* dst, float alpha, const float* x, uint size);
+
+/*!
+** err += g * row and row += g * input in one pass, so the row is loaded
+** once for both updates of a (input, target) pair in SGD.
+*/
+void
+gnn_vec_fused_axpy(float* err, float* row, float g, const float* input, uint size);
+
+/*!
+** the sum of squares of the gradients clamped into [-clip, clip].
+*/
+double
+gnn_vec_clipped_norm2(const float* g, size_t size, float clip);
+
+/*!
+** one adam step over a flat vector, the gradient is clamped into [-clip,
+** clip] and multiplied by scale as it is loaded, so clipping and fitting
+** need no pass of their own:
+**
+**   m = beta1 * m + (1 - beta1) * g
+**   r = beta2 * r + (1 - beta2) * g * g
+**   w -= alpha * m / (rho * sqrt(r) + 1e-8)
+**
+** alpha and rho carry the learning rate and the bias corrections of the
+** step, computed once by the caller.
+*/
+void
+gnn_vec_adam(float* w, float* m, float* r, const float* g, size_t size,
+             float alpha, float rho, float beta1, float beta2, float clip, float scale);
+
+/*!
+** one momentum descent step, v = momentum * v - lr * g and w += v, with g
+** clamped and scaled as in gnn_vec_adam.
+*/
+void
+gnn_vec_momentum(float* w, float* v, const float* g, size_t size,
+                 float lr, float momentum, float clip, float scale);
+
+/*!
+** dst = 1 / (1 + exp(-src)), vectorized over a batch of logits with a
+** polynomial exp, the relative error is about 1e-7.
+*/
+void
+gnn_vec_sigmoid(float* dst, const float* src, uint size);
+
+/*!
+** prefetches the cache lines of a vector that is read and written soon.
+*/
+void
+gnn_vec_prefetch(const float* vec, uint size);
+
+/*!
+** scales the vector to unit length, and returns the original length.
+*/
+float
+gnn_vec_normalize(float* vec, uint size);
+
+/*!
+** the placement flags of gnn_mem_alloc, they can be combined.
+**
+** GANN_MEM_HUGE_PAGES  : backs the memory with 2 MB pages, explicit huge
+**                        pages first and transparent ones otherwise, so
+**                        random rows miss the TLB less often
+** GANN_MEM_INTERLEAVE  : spreads the pages round-robin over all NUMA nodes
+** GANN_MEM_FIRST_TOUCH : faults the pages in from thread_num threads, so
+**                        without interleave every node gets a share
+*/
+#define GANN_MEM_DEFAULT                  0
+#define GANN_MEM_HUGE_PAGES               1
+#define GANN_MEM_INTERLEAVE               2
+#define GANN_MEM_FIRST_TOUCH              4
+
+#define GANN_MEM_HUGE_PAGE_SIZE           (2UL << 20)
+
+/*!
+** allocates zeroed, page aligned memory for a large matrix, the placement
+** flags are best effort and silently ignored where the system lacks them.
+**
+** @return the memory, freed with gnn_mem_free and the same size and flags
+*/
+void*
+gnn_mem_alloc(size_t size, int flags, uint thread_num);
+
+void
+gnn_mem_free(void* ptr, size_t size, int flags);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,77 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#ifndef __GANN_LSTM_INTERNAL_H__
+#define __GANN_LSTM_INTERNAL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gann-lstm.h"
+
+/*!
+** the trainer of gann-lstm.c, exposed only to check the gradients of the
+** layers against the loss, the training itself goes through gnn_lstm_train.
+*/
+typedef struct gnn_lstm_trainer_s gnn_lstm_trainer_t;
+
+/*!
+** creates a layer of the cell, GANN_LSTM_CELL or GANN_GRU_CELL.
+**
+** @param zeros
+**        1 if the weights are zeros, otherwise they are drawn from rng
+*/
+gnn_lstm_t*
+gnn_lstm_cell_new(int                  cell,
+                  int                  X,
+                  int                  N,
+                  int                  Y,
+                  int                  zeros,
+                  gnn_lstm_params_t*   params,
+                  gnn_rng_t*           rng);
+
+/*!
+** a trainer of the layers on the first minibatch of the data, with no
+** optimizer moments.
+*/
+gnn_lstm_trainer_t*
+gnn_lstm_trainer_new(gnn_lstm_t**          model_layers,
+                     gnn_lstm_params_t*    params,
+                     uint                  layers,
+                     uint                  training_points,
+                     int*                  X_train,
+                     int*                  Y_train);
+
+void
+gnn_lstm_trainer_free(gnn_lstm_trainer_t* trainer);
+
+/*!
+** the gradients of the layers on the minibatch, one layer after the other.
+*/
+void
+gnn_lstm_trainer_gradients(gnn_lstm_trainer_t* trainer);
+
+/*!
+** the loss of the minibatch with the current weights, the forward pass only.
+*/
+double
+gnn_lstm_trainer_loss(gnn_lstm_trainer_t* trainer);
+
+/*!
+** the gradients of layer p from the last gnn_lstm_trainer_gradients.
+*/
+gnn_lstm_grad_t*
+gnn_lstm_trainer_gradient(gnn_lstm_trainer_t const* trainer, uint p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __GANN_LSTM_INTERNAL_H__
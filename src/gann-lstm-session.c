@@ -0,0 +1,252 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "gann-w2v-vocab.h"
+#include "gann-lstm-session.h"
+
+gnn_lstm_session_t*
+gnn_lstm_session_new(gnn_lstm_t** layers, uint layer_num)
+{
+  gnn_lstm_session_t* ret;
+  size_t size = layers[0]->Y;
+  float* cursor;
+  uint p;
+
+  for (p = 0; p < layer_num; p++)
+    size += 2 * layers[p]->N;
+
+  ret = (gnn_lstm_session_t*) calloc(1, sizeof(gnn_lstm_session_t));
+  if (ret == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for session in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  ret->layers = layers;
+  ret->layer_num = layer_num;
+  ret->h = (float**) calloc(layer_num, sizeof(float*));
+  ret->c = (float**) calloc(layer_num, sizeof(float*));
+  ret->data = (float*) calloc(size, sizeof(float));
+  if (ret->h == NULL || ret->c == NULL || ret->data == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for session in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+
+  cursor = ret->data;
+  for (p = 0; p < layer_num; p++)
+  {
+    ret->h[p] = cursor;
+    ret->c[p] = cursor + layers[p]->N;
+    cursor += 2 * layers[p]->N;
+  }
+  ret->probs = cursor;
+  return ret;
+}
+
+void
+gnn_lstm_session_reset(gnn_lstm_session_t* session)
+{
+  uint p;
+  for (p = 0; p < session->layer_num; p++)
+  {
+    memset(session->h[p], 0, session->layers[p]->N * sizeof(float));
+    memset(session->c[p], 0, session->layers[p]->N * sizeof(float));
+  }
+  memset(session->probs, 0, session->layers[0]->Y * sizeof(float));
+}
+
+float const*
+gnn_lstm_session_step(gnn_lstm_session_t* session, int symbol)
+{
+  gnn_lstm_session_step_batch(&session, &symbol, 1);
+  return session->probs;
+}
+
+/*!
+** the R rows of the gates from W for count inputs of width S, the symbols
+** are columns gathered past the N of the hidden state, NULL for dense inputs.
+*/
+static void
+gnn_lstm_session_gates(float*          gates,
+                       uint            ldg,
+                       float const*    W,
+                       uint            S,
+                       float const*    inputs,
+                       float const*    b,
+                       uint            R,
+                       uint            N,
+                       int const*      symbols,
+                       uint            count)
+{
+  uint k;
+
+  if (symbols == NULL)
+  {
+    gnn_lstm_batch_forward(gates, ldg, W, S, inputs, S, b, R, S, count);
+    return;
+  }
+  gnn_lstm_batch_forward(gates, ldg, W, S, inputs, S, b, R, N, count);
+  for (k = 0; k < count; k++)
+    gnn_lstm_gather_forward(gates + (size_t) k * ldg, W, S, N + symbols[k], R);
+}
+
+void
+gnn_lstm_session_step_batch(gnn_lstm_session_t** sessions, int const* symbols, uint count)
+{
+  gnn_lstm_t** layers = sessions[0]->layers;
+  uint layer_num = sessions[0]->layer_num;
+  uint maxS = 0, maxG = 0, maxY = 0;
+  uint N, S, Y, X, G, k, p;
+  float *inputs, *gates, *outputs, *z, *h, *c;
+  size_t size;
+
+  for (p = 0; p < layer_num; p++)
+  {
+    if (layers[p]->S > maxS) maxS = layers[p]->S;
+    if (GANN_LSTM_GATES(layers[p]->cell) * layers[p]->N > maxG) maxG = GANN_LSTM_GATES(layers[p]->cell) * layers[p]->N;
+    if (layers[p]->Y > maxY) maxY = layers[p]->Y;
+  }
+  size = (size_t) count * (maxS + maxG + maxY);
+  if (size > sessions[0]->scratch_size)
+  {
+    free(sessions[0]->scratch);
+    sessions[0]->scratch = (float*) malloc(size * sizeof(float));
+    if (sessions[0]->scratch == NULL)
+    {
+      fprintf(stderr, "error: failed to allocate memories for session step in %d of %s.\n", __LINE__, __FILE__);
+      exit(1);
+    }
+    sessions[0]->scratch_size = size;
+  }
+  inputs = sessions[0]->scratch;
+  gates = inputs + (size_t) count * maxS;
+  outputs = gates + (size_t) count * maxG;
+
+  // layer numbering starts at the output, the last layer takes the symbols
+  p = layer_num;
+  while (p-- > 0)
+  {
+    N = layers[p]->N;
+    S = layers[p]->S;
+    Y = layers[p]->Y;
+    X = layers[p]->X;
+    G = GANN_LSTM_GATES(layers[p]->cell);
+
+    /*!
+    ** the input of a session is its hidden state followed by the output of
+    ** the layer above, or by the one hot symbol, which is a column of the
+    ** gates gathered after the product of the hidden states
+    */
+    for (k = 0; k < count; k++)
+    {
+      assert(sessions[k]->layers == layers);
+      gnn_vec_copy(inputs + (size_t) k * S, sessions[k]->h[p], N);
+      if (p < layer_num - 1)
+        gnn_vec_copy(inputs + (size_t) k * S + N, outputs + (size_t) k * maxY, X);
+    }
+
+    /*!
+    ** the gates are adjacent rows of the arena, one product for all. the
+    ** candidate of a GRU takes the hidden state through its reset gate, so
+    ** it only takes the update and reset gates here
+    */
+    gnn_lstm_session_gates(gates, G * N, layers[p]->Wf, S, inputs, layers[p]->bf,
+                           (layers[p]->cell == GANN_GRU_CELL ? 2 : 4) * N, N,
+                           p == layer_num - 1 ? symbols : NULL, count);
+
+    if (layers[p]->cell == GANN_GRU_CELL)
+    {
+      // z and r, then the candidate on [r * h, input] into the third block
+      for (k = 0; k < count; k++)
+      {
+        z = gates + (size_t) k * G * N;
+        gnn_lstm_sigmoid_forward(z, z, 2 * N);
+        gnn_vec_multiply(inputs + (size_t) k * S, z + N, N);
+      }
+      gnn_lstm_session_gates(gates + 2 * N, G * N, layers[p]->Wc, S, inputs, layers[p]->bc, N, N,
+                             p == layer_num - 1 ? symbols : NULL, count);
+    }
+
+    for (k = 0; k < count; k++)
+    {
+      z = gates + (size_t) k * G * N;
+      h = sessions[k]->h[p];
+      c = sessions[k]->c[p];
+
+      if (layers[p]->cell == GANN_GRU_CELL)
+      {
+        // h = n + z * (h - n), the cell state stays zero
+        gnn_lstm_tanh_forward(z + 2 * N, z + 2 * N, N);
+        gnn_vec_subtract(h, z + 2 * N, N);
+        gnn_vec_multiply(h, z, N);
+        gnn_vec_add(h, z + 2 * N, N);
+      }
+      else
+      {
+        // c = f * c + i * tanh(zc), h = o * tanh(c)
+        gnn_lstm_sigmoid_forward(z, z, 2 * N);
+        gnn_lstm_tanh_forward(z + 2 * N, z + 2 * N, N);
+        gnn_lstm_sigmoid_forward(z + 3 * N, z + 3 * N, N);
+        gnn_vec_multiply(c, z, N);
+        gnn_vec_multiply(z + N, z + 2 * N, N);
+        gnn_vec_add(c, z + N, N);
+        gnn_lstm_tanh_forward(h, c, N);
+        gnn_vec_multiply(h, z + 3 * N, N);
+      }
+
+      // the hidden states of the batch are packed for the output product
+      gnn_vec_copy(inputs + (size_t) k * N, h, N);
+    }
+
+    gnn_lstm_batch_forward(outputs, maxY, layers[p]->Wy, N, inputs, N, layers[p]->by, Y, N, count);
+
+    for (k = 0; k < count; k++)
+    {
+      if (p == 0 && layers[p]->params->huffman != NULL)
+        gnn_lstm_huffman_forward(sessions[k]->probs, outputs + (size_t) k * maxY, layers[p]->params->huffman);
+      else if (p == 0)
+        gnn_lstm_softmax_forward(sessions[k]->probs, outputs + (size_t) k * maxY, Y, layers[p]->params->softmax_temp);
+#ifdef INTERLAYER_SIGMOID_ACTIVATION
+      else
+        gnn_lstm_sigmoid_forward(outputs + (size_t) k * maxY, outputs + (size_t) k * maxY, Y);
+#endif
+    }
+  }
+}
+
+int
+gnn_lstm_session_sample(gnn_lstm_session_t const* session, gnn_rng_t* rng)
+{
+  uint Y = session->layers[0]->Y;
+  float r = gnn_rng_uniform(rng);
+  uint i;
+
+  for (i = 0; i + 1 < Y; i++)
+  {
+    r -= session->probs[i];
+    if (r < 0) break;
+  }
+  return i;
+}
+
+void
+gnn_lstm_session_free(gnn_lstm_session_t* session)
+{
+  if (session == NULL) return;
+  free(session->h);
+  free(session->c);
+  free(session->data);
+  free(session->scratch);
+  free(session);
+}
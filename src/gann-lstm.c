@@ -9,66 +9,300 @@
 */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <float.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "gann.h"
+#include "gann-w2v-vocab.h"
 #include "gann-lstm.h"
+#include "gann-lstm-internal.h"
+
+/*!
+** the weight and bias arrays in the arena of a layer, Wf, Wi, Wc, Wo, Wy,
+** bf, bi, bc, bo and by.
+*/
+#define GANN_LSTM_TENSORS                   10
 
 typedef struct gnn_lstm_values_cache_s
 {
-  double* probs;
-  double* probs_before_sigma;
-  double* c;
-  double* h;
-  double* c_old;
-  double* h_old;
-  double* X;
+  float* probs;
+  float* probs_before_sigma;
+  float* c;
+  float* h;
+  float* c_old;
+  float* h_old;
+  float* X;
 
   /*!
   ** the weights of forgate gate in hidden state
   */
-  double* hf;
+  float* hf;
 
   /*!
   ** the weights of input gate in hidden state
   */
-  double* hi;
+  float* hi;
 
   /*!
   ** the weights of output gate in hidden state
   */
-  double* ho;
+  float* ho;
 
   /*!
   ** the weights of input node in hidden state
   */
-  double* hc;
+  float* hc;
+
+  float* tanh_c_cache;
+
+  /*!
+  ** the input of the candidate of a GRU, [r * h_old, input], or NULL
+  */
+  float* Xr;
 
-  double* tanh_c_cache;
+  /*!
+  ** the symbol of a one hot input, X then only caches the hidden state, or
+  ** -1 if the input is dense
+  */
+  int symbol;
 }
 gnn_lstm_values_cache_t;
 
 typedef struct gnn_lstm_values_state_s {
-  double* c;
-  double* h;
+  float* c;
+  float* h;
 }
 gnn_lstm_values_state_t;
 
 typedef struct gnn_lstm_values_next_cache_s {
-  double* dldh_next;
-  double* dldc_next;
-  double* dldY_pass;
+  float* dldh_next;
+  float* dldc_next;
+  float* dldY_pass;
+
+  // descent layer hidden state, within the timestep
+  float* dldh;
+  float* dldho;
+  float* dldhf;
+  float* dldhi;
+  float* dldhc;
+  float* dldc;
+
+  // descent layer input
+  float* dldXi;
+  float* dldXo;
+  float* dldXf;
+  float* dldXc;
 }
 gnn_lstm_values_next_cache_t;
 
-void
-gnn_lstm_forward_propagate(gnn_lstm_t*                model,
-                           double*                    input,
-                           gnn_lstm_values_cache_t*   cache_in,
-                           gnn_lstm_values_cache_t*   cache_out,
-                           int                        softmax)
+/*!
+** the output of a symbol on its path in the Huffman tree, the sigmoid of
+** every inner node on the path is kept in probs for the backward step.
+**
+** @return the cross entropy of the symbol
+*/
+static double
+gnn_lstm_huffman_path_forward(gnn_lstm_t const* model, float const* h, int symbol, float* probs)
+{
+  gnn_w2v_word_t const* word = &model->params->huffman->words[symbol];
+  double ret = 0;
+  float x, e;
+  int d, row;
+
+  for (d = 0; d < word->codelen; d++)
+  {
+    row = word->point[d];
+    x = gnn_vec_dot(model->Wy + (size_t) row * model->N, h, model->N) + model->by[row];
+    e = expf(-fabsf(x));
+    probs[d] = x >= 0 ? 1.0f / (1.0f + e) : e / (1.0f + e);
+    /*!
+    ** code 0 is the branch of the sigmoid, code 1 the other one, and
+    ** -log(sigmoid(x)) = log(1 + exp(-x)) never saturates to inf
+    */
+    if (word->code[d])
+      x = -x;
+    ret += (x < 0 ? -x : 0) + log1p(e);
+  }
+  return ret;
+}
+
+/*!
+** the gradients of the rows on the path of a symbol, and dldh.
+*/
+static void
+gnn_lstm_huffman_path_backward(gnn_lstm_t const*   model,
+                               float const*        h,
+                               int                 symbol,
+                               float const*        probs,
+                               gnn_lstm_grad_t*    gradients,
+                               float*              dldh)
+{
+  gnn_w2v_word_t const* word = &model->params->huffman->words[symbol];
+  int N = model->N;
+  float g;
+  int d, row;
+
+  memset(dldh, 0, N * sizeof(float));
+  for (d = 0; d < word->codelen; d++)
+  {
+    row = word->point[d];
+    g = probs[d] - (1 - word->code[d]);
+    gnn_vec_axpy(dldh, g, model->Wy + (size_t) row * N, N);
+    gnn_vec_axpy(gradients->Wy + (size_t) row * N, g, h, N);
+    gradients->by[row] += g;
+  }
+}
+
+/*!
+** the gate before its activation, Y = W * [h_old, input] + b. the input of a
+** symbol is one hot, so only h_old is multiplied and the column of the
+** symbol is gathered.
+*/
+static void
+gnn_lstm_gate_forward(float*          Y,
+                      float const*    W,
+                      float const*    b,
+                      float*          X,
+                      int             symbol,
+                      int             N,
+                      int             S)
+{
+  if (symbol < 0)
+  {
+    gnn_lstm_full_forward(Y, (float*) W, X, (float*) b, N, S);
+    return;
+  }
+  gnn_lstm_batch_forward(Y, N, W, S, X, N, b, N, N, 1);
+  gnn_lstm_gather_forward(Y, W, S, N + symbol, N);
+}
+
+/*!
+** the backward step of a gate, see gnn_lstm_gate_forward, the delta of a
+** one hot input is not passed on.
+*/
+static void
+gnn_lstm_gate_backward(float*   dldY,
+                       float*   W,
+                       float*   X,
+                       int      symbol,
+                       float*   dldW,
+                       float*   dldX,
+                       float*   dldb,
+                       int      N,
+                       int      S)
+{
+  if (symbol < 0)
+    gnn_lstm_full_backward(dldY, W, X, dldW, dldX, dldb, N, S);
+  else
+    gnn_lstm_gather_backward(dldY, W, S, X, N + symbol, dldW, dldX, dldb, N, N);
+}
+
+/*!
+** the GRU of a timestep on X = [h_old, input]
+**
+**   z = sigmoid(Wf * X + bf), r = sigmoid(Wi * X + bi)
+**   n = tanh(Wc * [r * h_old, input] + bc)
+**   h = (1 - z) * n + z * h_old
+**
+** the update gate z is cached in hf, the reset gate r in hi and the
+** candidate n in hc.
+*/
+static void
+gnn_gru_cell_forward(gnn_lstm_t*                 model,
+                     gnn_lstm_values_cache_t*    cache,
+                     float const*                h_old,
+                     int                         N,
+                     int                         S)
+{
+  gnn_lstm_gate_forward(cache->hf, model->Wf, model->bf, cache->X, cache->symbol, N, S);
+  gnn_lstm_sigmoid_forward(cache->hf, cache->hf, N);
+
+  gnn_lstm_gate_forward(cache->hi, model->Wi, model->bi, cache->X, cache->symbol, N, S);
+  gnn_lstm_sigmoid_forward(cache->hi, cache->hi, N);
+
+  gnn_vec_copy(cache->Xr, cache->hi, N);
+  gnn_vec_multiply(cache->Xr, h_old, N);
+  if (cache->symbol < 0)
+    gnn_vec_copy(cache->Xr + N, cache->X + N, S - N);
+
+  gnn_lstm_gate_forward(cache->hc, model->Wc, model->bc, cache->Xr, cache->symbol, N, S);
+  gnn_lstm_tanh_forward(cache->hc, cache->hc, N);
+
+  /*!
+  ** h = n + z * (h_old - n)
+  */
+  gnn_vec_copy(cache->h, h_old, N);
+  gnn_vec_subtract(cache->h, cache->hc, N);
+  gnn_vec_multiply(cache->h, cache->hf, N);
+  gnn_vec_add(cache->h, cache->hc, N);
+}
+
+/*!
+** the backward step of gnn_gru_cell_forward from dldh, the deltas of the
+** timestep are in d_next.
+**
+** @return dldX, the delta of [h_old, input], only of h_old for a symbol
+*/
+static float*
+gnn_gru_cell_backward(gnn_lstm_t*                     model,
+                      gnn_lstm_values_next_cache_t*   d_next,
+                      gnn_lstm_values_cache_t*        cache,
+                      gnn_lstm_grad_t*                gradients)
+{
+  int N = model->N, S = model->S, width = cache->symbol < 0 ? S : N;
+  float *dldh = d_next->dldh, *dldz = d_next->dldhf, *dldr = d_next->dldhi, *dldn = d_next->dldhc;
+  // the delta of h_old straight through the update gate
+  float *dldh_old = d_next->dldho;
+  float *dldX = d_next->dldXi;
+
+  gnn_vec_copy(dldh_old, dldh, N);
+  gnn_vec_multiply(dldh_old, cache->hf, N);
+
+  gnn_vec_copy(dldn, dldh, N);
+  gnn_vec_subtract(dldn, dldh_old, N);
+  gnn_lstm_tanh_backward(dldn, cache->hc, dldn, N);
+
+  gnn_vec_copy(dldz, cache->h_old, N);
+  gnn_vec_subtract(dldz, cache->hc, N);
+  gnn_vec_multiply(dldz, dldh, N);
+  gnn_lstm_sigmoid_backward(dldz, cache->hf, dldz, N);
+
+  gnn_lstm_gate_backward(dldn, model->Wc, cache->Xr, cache->symbol, gradients->Wc, d_next->dldXc, gradients->bc, N, S);
+
+  // the candidate takes r * h_old, so its delta splits into r and h_old
+  gnn_vec_copy(dldr, d_next->dldXc, N);
+  gnn_vec_multiply(dldr, cache->h_old, N);
+  gnn_lstm_sigmoid_backward(dldr, cache->hi, dldr, N);
+  gnn_vec_multiply(d_next->dldXc, cache->hi, N);
+
+  gnn_lstm_gate_backward(dldz, model->Wf, cache->X, cache->symbol, gradients->Wf, d_next->dldXf, gradients->bf, N, S);
+  gnn_lstm_gate_backward(dldr, model->Wi, cache->X, cache->symbol, gradients->Wi, dldX, gradients->bi, N, S);
+
+  gnn_vec_add(dldX, d_next->dldXf, width);
+  gnn_vec_add(dldX, d_next->dldXc, width);
+  gnn_vec_add(dldX, dldh_old, N);
+  return dldX;
+}
+
+/*!
+** the forward step of one timestep, the input is dense, or if symbol is not
+** negative the one hot vector of the symbol, which is never built.
+*/
+static void
+gnn_lstm_forward_step(gnn_lstm_t*                model,
+                      float*                     input,
+                      int                        symbol,
+                      gnn_lstm_values_cache_t*   cache_in,
+                      gnn_lstm_values_cache_t*   cache_out,
+                      int                        softmax)
 {
   int N, Y, S, i = 0;
-  double *h_old, *c_old, *X_one_hot;
+  float *h_old, *c_old, *X_one_hot;
 
   h_old = cache_in->h;
   c_old = cache_in->c;
@@ -80,22 +314,26 @@ gnn_lstm_forward_propagate(gnn_lstm_t*                model,
 #ifdef WINDOWS
   // MSVC is not a C99 compiler, and does not support variable length arrays
   // MSVC is documented as conforming to C90
-  double *tmp;
+  float *tmp;
   if ( init_zero_vector(&tmp, N) ) {
     fprintf(stderr, "%s.%s.%d init_zero_vector(.., %d) failed\r\n",
       __FILE__, __func__, __LINE__, N);
     exit(1);
   }
 #else
-  double tmp[N]; // VLA must be supported.. May cause portability problems.. If so use init_zero_vector (will be slower).
+  float tmp[N]; // VLA must be supported.. May cause portability problems.. If so use init_zero_vector (will be slower).
 #endif
 
-  gnn_vec_copy(cache_out->h_old, h_old, N);
-  gnn_vec_copy(cache_out->c_old, c_old, N);
+  // the old state of the arena caches is the state of cache_in already
+  if (cache_out->h_old != h_old)
+    gnn_vec_copy(cache_out->h_old, h_old, N);
+  if (cache_out->c_old != c_old)
+    gnn_vec_copy(cache_out->c_old, c_old, N);
 
   X_one_hot = cache_out->X;
+  cache_out->symbol = symbol;
 
-  while ( i < S )
+  while ( i < (symbol < 0 ? S : N) )
   {
     if ( i < N )
       X_one_hot[i] = h_old[i];
@@ -104,260 +342,1205 @@ gnn_lstm_forward_propagate(gnn_lstm_t*                model,
     ++i;
   }
 
+  if (model->cell == GANN_GRU_CELL)
+  {
+    gnn_gru_cell_forward(model, cache_out, h_old, N, S);
+  }
+  else
+  {
+    /*!
+    ** hf_t = wf_t * X_t + bf_t
+    */
+    gnn_lstm_gate_forward(cache_out->hf, model->Wf, model->bf, X_one_hot, symbol, N, S);
+    gnn_lstm_sigmoid_forward(cache_out->hf, cache_out->hf, N);
+
+    gnn_lstm_gate_forward(cache_out->hi, model->Wi, model->bi, X_one_hot, symbol, N, S);
+    gnn_lstm_sigmoid_forward(cache_out->hi, cache_out->hi, N);
+
+    gnn_lstm_gate_forward(cache_out->ho, model->Wo, model->bo, X_one_hot, symbol, N, S);
+    gnn_lstm_sigmoid_forward(cache_out->ho, cache_out->ho, N);
+
+    gnn_lstm_gate_forward(cache_out->hc, model->Wc, model->bc, X_one_hot, symbol, N, S);
+    gnn_lstm_tanh_forward(cache_out->hc, cache_out->hc, N);
+
+    /*!
+    ** c = hf * c_old + hi * hc
+    */
+    gnn_vec_copy(cache_out->c, cache_out->hf, N);
+    gnn_vec_multiply(cache_out->c, c_old, N);
+
+    gnn_vec_copy(tmp, cache_out->hi, N);
+    gnn_vec_multiply(tmp, cache_out->hc, N);
+
+    gnn_vec_add(cache_out->c, tmp, N);
+
+    /*!
+    ** h = ho * tanh_c_cache
+    */
+    gnn_lstm_tanh_forward(cache_out->tanh_c_cache, cache_out->c, N);
+    gnn_vec_copy(cache_out->h, cache_out->ho, N);
+    gnn_vec_multiply(cache_out->h, cache_out->tanh_c_cache, N);
+  }
+
+  /*!
+  ** probs = softmax ( Wy*h + by ), the output on the Huffman tree is only the
+  ** path of the symbol, which the trainer computes
+  */
+  if (softmax <= 0 || model->params->huffman == NULL)
+    gnn_lstm_full_forward(cache_out->probs, model->Wy, cache_out->h, model->by, Y, N);
+  if (softmax > 0 && model->params->huffman == NULL)
+  {
+    gnn_lstm_softmax_forward(cache_out->probs, cache_out->probs, Y, model->params->softmax_temp);
+  }
+#ifdef INTERLAYER_SIGMOID_ACTIVATION
+  if (softmax <= 0)
+  {
+    gnn_lstm_sigmoid_forward(cache_out->probs, cache_out->probs, Y);
+    gnn_vec_copy(cache_out->probs_before_sigma, cache_out->probs, Y);
+  }
+#endif
+
+#ifdef WINDOWS
+  free_vector(&tmp);
+#endif
+
+}
+
+void
+gnn_lstm_forward_propagate(gnn_lstm_t*                model,
+                           float*                     input,
+                           gnn_lstm_values_cache_t*   cache_in,
+                           gnn_lstm_values_cache_t*   cache_out,
+                           int                        softmax)
+{
+  gnn_lstm_forward_step(model, input, -1, cache_in, cache_out, softmax);
+}
+
+/*!
+** the backward step of one timestep, the gradients of the weights are added
+** to the minibatch gradients, and the gradients of the previous timestep and
+** of the layer below are written to cache_out.
+*/
+void
+gnn_lstm_backward_propagate(gnn_lstm_t*                     model,
+                            float*                          y_probabilities,
+                            int                             y_correct,
+                            gnn_lstm_values_next_cache_t*   d_next,
+                            gnn_lstm_values_cache_t*        cache_in,
+                            gnn_lstm_grad_t*                gradients,
+                            gnn_lstm_values_next_cache_t*   cache_out)
+{
+  float *h,*dldh_next,*dldc_next, *dldy, *dldh, *dldho, *dldhf, *dldhi, *dldhc, *dldc, *dldX;
+  int N, Y, S;
+
+  N = model->N;
+  Y = model->Y;
+  S = model->S;
+
+  // the deltas within the timestep live with the caches, not the shared model
+  dldh = d_next->dldh;
+  dldc = d_next->dldc;
+  dldho = d_next->dldho;
+  dldhi = d_next->dldhi;
+  dldhf = d_next->dldhf;
+  dldhc = d_next->dldhc;
+
+  h = cache_in->h;
+
+  dldh_next = d_next->dldh_next;
+  dldc_next = d_next->dldc_next;
+
+  dldy = y_probabilities;
+
+  if ( y_correct >= 0 && model->params->huffman != NULL ) {
+    // the probabilities are the sigmoids on the path of y_correct
+    gnn_lstm_huffman_path_backward(model, h, y_correct, dldy, gradients, dldh);
+  } else {
+    if ( y_correct >= 0 ) {
+      dldy[y_correct] -= 1.0;
+    }
+#ifdef INTERLAYER_SIGMOID_ACTIVATION
+    if ( y_correct < 0 ) {
+      gnn_lstm_sigmoid_backward(dldy, cache_in->probs_before_sigma, dldy, Y);
+    }
+#endif
+
+    gnn_lstm_full_backward(dldy, model->Wy, h, gradients->Wy, dldh, gradients->by, Y, N);
+  }
+  gnn_vec_add(dldh, dldh_next, N);
+
+  if ( model->cell == GANN_GRU_CELL ) {
+    // a GRU has no cell state, dldc_next stays zero
+    dldX = gnn_gru_cell_backward(model, d_next, cache_in, gradients);
+  } else {
+    gnn_vec_copy(dldho, dldh, N);
+    gnn_vec_multiply(dldho, cache_in->tanh_c_cache, N);
+    gnn_lstm_sigmoid_backward(dldho, cache_in->ho, dldho, N);
+
+    gnn_vec_copy(dldc, dldh, N);
+    gnn_vec_multiply(dldc, cache_in->ho, N);
+    gnn_lstm_tanh_backward(dldc, cache_in->tanh_c_cache, dldc, N);
+    gnn_vec_add(dldc, dldc_next, N);
+
+    gnn_vec_copy(dldhf, dldc, N);
+    gnn_vec_multiply(dldhf, cache_in->c_old, N);
+    gnn_lstm_sigmoid_backward(dldhf, cache_in->hf, dldhf, N);
+
+    gnn_vec_copy(dldhi, cache_in->hc, N);
+    gnn_vec_multiply(dldhi, dldc, N);
+    gnn_lstm_sigmoid_backward(dldhi, cache_in->hi, dldhi, N);
+
+    gnn_vec_copy(dldhc, cache_in->hi, N);
+    gnn_vec_multiply(dldhc, dldc, N);
+    gnn_lstm_tanh_backward(dldhc, cache_in->hc, dldhc, N);
+
+    gnn_lstm_gate_backward(dldhi, model->Wi, cache_in->X, cache_in->symbol, gradients->Wi, d_next->dldXi, gradients->bi, N, S);
+    gnn_lstm_gate_backward(dldhc, model->Wc, cache_in->X, cache_in->symbol, gradients->Wc, d_next->dldXc, gradients->bc, N, S);
+    gnn_lstm_gate_backward(dldho, model->Wo, cache_in->X, cache_in->symbol, gradients->Wo, d_next->dldXo, gradients->bo, N, S);
+    gnn_lstm_gate_backward(dldhf, model->Wf, cache_in->X, cache_in->symbol, gradients->Wf, d_next->dldXf, gradients->bf, N, S);
+
+    // dldXi will work as a temporary substitute for dldX (where we get extract dh_next from!)
+    dldX = d_next->dldXi;
+    gnn_vec_add(dldX, d_next->dldXc, cache_in->symbol < 0 ? S : N);
+    gnn_vec_add(dldX, d_next->dldXo, cache_in->symbol < 0 ? S : N);
+    gnn_vec_add(dldX, d_next->dldXf, cache_in->symbol < 0 ? S : N);
+
+    gnn_vec_copy(cache_out->dldc_next, cache_in->hf, N);
+    gnn_vec_multiply(cache_out->dldc_next, dldc, N);
+  }
+
+  gnn_vec_copy(cache_out->dldh_next, dldX, N);
+
+  // To pass on to next layer, a symbol has no layer below
+  if ( cache_in->symbol < 0 )
+    gnn_vec_copy(cache_out->dldY_pass, &dldX[N], model->X);
+}
+
+static void*
+gnn_lstm_calloc(size_t count, size_t size)
+{
+  void* ret = calloc(count, size);
+  if (ret == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for lstm in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  return ret;
+}
+
+/*!
+** the floats in the weight arena of a layer of G gates.
+*/
+static size_t
+gnn_lstm_arena_size(uint G, uint N, uint Y, uint S)
+{
+  return G * (size_t) N * S + (size_t) Y * N + G * (size_t) N + Y;
+}
+
+/*!
+** points the arrays Wf, Wi, Wc, Wo, Wy, bf, bi, bc, bo and by into an arena
+** of G gates, the gates past G are NULL.
+*/
+static void
+gnn_lstm_arena_views(float* data, uint G, uint N, uint Y, uint S, float** views)
+{
+  uint i;
+
+  for (i = 0; i < 4; i++)
+    views[i] = i < G ? data + i * (size_t) N * S : NULL;
+  views[4] = data + G * (size_t) N * S;
+  views[5] = views[4] + (size_t) Y * N;
+  for (i = 1; i < 4; i++)
+    views[5 + i] = i < G ? views[5] + i * N : NULL;
+  views[9] = views[5] + G * N;
+}
+
+/*!
+** makes a new layer of a cell.
+**
+** @param X
+**        the input number
+**
+** @param N
+**        the hidden neuron number
+**
+** @param Y
+**        the output number
+**
+** @param rng
+**        the random stream of the weights, or NULL if zeros
+*/
+gnn_lstm_t*
+gnn_lstm_cell_new(int                  cell,
+                  int                  X,
+                  int                  N,
+                  int                  Y,
+                  int                  zeros,
+                  gnn_lstm_params_t*   params,
+                  gnn_rng_t*           rng)
+{
+  int S = X + N, G = GANN_LSTM_GATES(cell);
+  gnn_lstm_t* ret = gnn_lstm_calloc(1, sizeof(gnn_lstm_t));
+  float* views[GANN_LSTM_TENSORS];
+
+  ret->X = X;
+  ret->N = N;
+  ret->S = S;
+  ret->Y = Y;
+  ret->cell = cell;
+
+  ret->params = params;
+
+  ret->size = gnn_lstm_arena_size(G, N, Y, S);
+  ret->weights = gnn_mem_alloc(ret->size * sizeof(float), GANN_MEM_DEFAULT, 1);
+  gnn_lstm_arena_views(ret->weights, G, N, Y, S, views);
+  ret->Wf = views[0];
+  ret->Wi = views[1];
+  ret->Wc = views[2];
+  ret->Wo = views[3];
+  ret->Wy = views[4];
+  ret->bf = views[5];
+  ret->bi = views[6];
+  ret->bc = views[7];
+  ret->bo = views[8];
+  ret->by = views[9];
+
+  // the gates are adjacent and drawn in one pass, the biases stay zero
+  if (!zeros) {
+    gnn_vec_fill_gaussian(ret->Wf, G * (size_t) N * S, 0, 1 / sqrtf(S / 5.0f), rng, 0);
+    gnn_vec_fill_gaussian(ret->Wy, (size_t) Y * N, 0, 1 / sqrtf(N / 5.0f), rng, 0);
+  }
+
+  return ret;
+}
+
+gnn_lstm_t*
+gnn_lstm_new(int                  X,
+             int                  N,
+             int                  Y,
+             int                  zeros,
+             gnn_lstm_params_t*   params,
+             gnn_rng_t*           rng)
+{
+  return gnn_lstm_cell_new(GANN_LSTM_CELL, X, N, Y, zeros, params, rng);
+}
+
+gnn_lstm_t*
+gnn_gru_new(int                  X,
+            int                  N,
+            int                  Y,
+            int                  zeros,
+            gnn_lstm_params_t*   params,
+            gnn_rng_t*           rng)
+{
+  return gnn_lstm_cell_new(GANN_GRU_CELL, X, N, Y, zeros, params, rng);
+}
+
+void
+gnn_lstm_free(gnn_lstm_t* model)
+{
+  if (model == NULL) return;
+  gnn_mem_free(model->weights, model->size * sizeof(float), GANN_MEM_DEFAULT);
+  free(model);
+}
+
+gnn_lstm_grad_t*
+gnn_lstm_grad_new(gnn_lstm_t const* model)
+{
+  gnn_lstm_grad_t* ret = gnn_lstm_calloc(1, sizeof(gnn_lstm_grad_t));
+  float* views[GANN_LSTM_TENSORS];
+
+  ret->X = model->X;
+  ret->N = model->N;
+  ret->Y = model->Y;
+  ret->S = model->S;
+
+  ret->size = model->size;
+  ret->data = gnn_mem_alloc(ret->size * sizeof(float), GANN_MEM_DEFAULT, 1);
+  gnn_lstm_arena_views(ret->data, GANN_LSTM_GATES(model->cell), ret->N, ret->Y, ret->S, views);
+  ret->Wf = views[0];
+  ret->Wi = views[1];
+  ret->Wc = views[2];
+  ret->Wo = views[3];
+  ret->Wy = views[4];
+  ret->bf = views[5];
+  ret->bi = views[6];
+  ret->bc = views[7];
+  ret->bo = views[8];
+  ret->by = views[9];
+
+  return ret;
+}
+
+void
+gnn_lstm_grad_zero(gnn_lstm_grad_t* grad)
+{
+  memset(grad->data, 0, grad->size * sizeof(float));
+}
+
+void
+gnn_lstm_grad_free(gnn_lstm_grad_t* grad)
+{
+  if (grad == NULL) return;
+  gnn_mem_free(grad->data, grad->size * sizeof(float), GANN_MEM_DEFAULT);
+  free(grad);
+}
+
+/*!
+** the factor that fits the clipped gradients into the norm of the limit,
+** it takes one read of the arena, and the update applies clip and factor as
+** it loads the gradients.
+*/
+static float
+gnn_lstm_grad_scale(gnn_lstm_grad_t* grad, float clip, int fit, float limit)
+{
+  double norm;
+
+  if (!fit) return 1;
+  norm = sqrt(gnn_vec_clipped_norm2(grad->data, grad->size, clip));
+  return norm > limit ? limit / norm : 1;
+}
+
+/*!
+** the adam step of a layer fused with clipping and fitting, M and R are the
+** first and second moments.
+**
+** @param t
+**        the steps done before
+*/
+static void
+gnn_lstm_adam(gnn_lstm_t*         model,
+              gnn_lstm_grad_t*    grad,
+              gnn_lstm_grad_t*    M,
+              gnn_lstm_grad_t*    R,
+              ulong               t,
+              float               clip,
+              float               scale)
+{
+  double beta1 = model->params->beta1;
+  double beta2 = model->params->beta2;
+  double alpha = model->params->learning_rate / (1.0 - pow(beta1, t + 1));
+  double rho = 1.0 / sqrt(1.0 - pow(beta2, t + 1));
+
+  gnn_vec_adam(model->weights, M->data, R->data, grad->data, model->size,
+               alpha, rho, beta1, beta2, clip, scale);
+}
+
+/*!
+** the gradient descent step with momentum, M keeps the velocity.
+*/
+static void
+gnn_lstm_descend(gnn_lstm_t*        model,
+                 gnn_lstm_grad_t*   grad,
+                 gnn_lstm_grad_t*   M,
+                 float              clip,
+                 float              scale)
+{
+  gnn_vec_momentum(model->weights, M->data, grad->data, model->size,
+                   model->params->learning_rate, model->params->momentum, clip, scale);
+}
+
+/*!
+** the floats of a cache row, rounded up to a cache line so every row of a
+** block is aligned for the vector kernels.
+*/
+#define GANN_LSTM_ROW(n)                    (((size_t) (n) + 15) & ~(size_t) 15)
+
+/*!
+** the caches of a layer for all timesteps of a minibatch in one arena, every
+** quantity is a [T x N] block of rows (structure of arrays), and the views
+** of a timestep point at its rows. the arena lives as long as the training,
+** a minibatch only resets the start state and the deltas.
+*/
+typedef struct gnn_lstm_cache_arena_s
+{
+  /*!
+  ** the timesteps, the minibatch and the start state
+  */
+  uint                            T;
+
+  float*                          data;
+
+  size_t                          size;
+
+  gnn_lstm_values_cache_t*        steps;
+
+  /*!
+  ** the deltas of the next timestep and within the backward step
+  */
+  gnn_lstm_values_next_cache_t    next;
+
+  /*!
+  ** the deltas passed to the layer below, one row per timestep so the layer
+  ** below may take them later
+  */
+  float*                          passes;
+
+  size_t                          ld_pass;
+
+  /*!
+  ** the state carried between minibatches when stateful
+  */
+  gnn_lstm_values_state_t         state;
+}
+gnn_lstm_cache_arena_t;
+
+static float*
+gnn_lstm_cache_block(float** cursor, size_t rows, uint width)
+{
+  float* ret = *cursor;
+  *cursor += rows * GANN_LSTM_ROW(width);
+  return ret;
+}
+
+static gnn_lstm_cache_arena_t*
+gnn_lstm_cache_arena_new(gnn_lstm_t const* model, uint T)
+{
+  gnn_lstm_cache_arena_t* ret = gnn_lstm_calloc(1, sizeof(gnn_lstm_cache_arena_t));
+  size_t ldN = GANN_LSTM_ROW(model->N), ldS = GANN_LSTM_ROW(model->S), ldY = GANN_LSTM_ROW(model->Y);
+  float *probs, *probs_before_sigma = NULL, *c, *h, *X, *hf, *hi, *ho = NULL, *hc, *tanh_c = NULL, *Xr = NULL;
+  int gru = model->cell == GANN_GRU_CELL;
+  float* cursor;
+  uint t;
+
+  ret->T = T;
+  ret->ld_pass = GANN_LSTM_ROW(model->X);
+  // a GRU keeps the input of its candidate rather than ho and tanh(c)
+  ret->size = T * ((gru ? 5 : 7) * ldN + (gru ? 2 : 1) * ldS + ldY + ret->ld_pass) + 10 * ldN + 4 * ldS;
+#ifdef INTERLAYER_SIGMOID_ACTIVATION
+  ret->size += T * ldY;
+#endif
+  ret->data = gnn_mem_alloc(ret->size * sizeof(float), GANN_MEM_DEFAULT, 1);
+  ret->steps = gnn_lstm_calloc(T, sizeof(gnn_lstm_values_cache_t));
+
+  cursor = ret->data;
+  probs = gnn_lstm_cache_block(&cursor, T, model->Y);
+#ifdef INTERLAYER_SIGMOID_ACTIVATION
+  probs_before_sigma = gnn_lstm_cache_block(&cursor, T, model->Y);
+#endif
+  c = gnn_lstm_cache_block(&cursor, T, model->N);
+  h = gnn_lstm_cache_block(&cursor, T, model->N);
+  X = gnn_lstm_cache_block(&cursor, T, model->S);
+  hf = gnn_lstm_cache_block(&cursor, T, model->N);
+  hi = gnn_lstm_cache_block(&cursor, T, model->N);
+  hc = gnn_lstm_cache_block(&cursor, T, model->N);
+  if (gru)
+    Xr = gnn_lstm_cache_block(&cursor, T, model->S);
+  else
+  {
+    ho = gnn_lstm_cache_block(&cursor, T, model->N);
+    tanh_c = gnn_lstm_cache_block(&cursor, T, model->N);
+  }
+  ret->passes = gnn_lstm_cache_block(&cursor, T, model->X);
+  ret->next.dldh_next = gnn_lstm_cache_block(&cursor, 1, model->N);
+  ret->next.dldc_next = gnn_lstm_cache_block(&cursor, 1, model->N);
+  ret->next.dldY_pass = NULL;
+  ret->next.dldh = gnn_lstm_cache_block(&cursor, 1, model->N);
+  ret->next.dldho = gnn_lstm_cache_block(&cursor, 1, model->N);
+  ret->next.dldhf = gnn_lstm_cache_block(&cursor, 1, model->N);
+  ret->next.dldhi = gnn_lstm_cache_block(&cursor, 1, model->N);
+  ret->next.dldhc = gnn_lstm_cache_block(&cursor, 1, model->N);
+  ret->next.dldc = gnn_lstm_cache_block(&cursor, 1, model->N);
+  ret->next.dldXi = gnn_lstm_cache_block(&cursor, 1, model->S);
+  ret->next.dldXo = gnn_lstm_cache_block(&cursor, 1, model->S);
+  ret->next.dldXf = gnn_lstm_cache_block(&cursor, 1, model->S);
+  ret->next.dldXc = gnn_lstm_cache_block(&cursor, 1, model->S);
+  ret->state.c = gnn_lstm_cache_block(&cursor, 1, model->N);
+  ret->state.h = gnn_lstm_cache_block(&cursor, 1, model->N);
+  assert(cursor == ret->data + ret->size);
+
+  for (t = 0; t < T; t++)
+  {
+    gnn_lstm_values_cache_t* step = &ret->steps[t];
+
+    step->probs = probs + t * ldY;
+    step->probs_before_sigma = probs_before_sigma == NULL ? NULL : probs_before_sigma + t * ldY;
+    step->c = c + t * ldN;
+    step->h = h + t * ldN;
+    // the old state of a step is the state of the step before, not a copy
+    step->c_old = c + (t > 0 ? t - 1 : 0) * ldN;
+    step->h_old = h + (t > 0 ? t - 1 : 0) * ldN;
+    step->X = X + t * ldS;
+    step->hf = hf + t * ldN;
+    step->hi = hi + t * ldN;
+    step->ho = ho == NULL ? NULL : ho + t * ldN;
+    step->hc = hc + t * ldN;
+    step->tanh_c_cache = tanh_c == NULL ? NULL : tanh_c + t * ldN;
+    step->Xr = Xr == NULL ? NULL : Xr + t * ldS;
+    step->symbol = -1;
+  }
+  return ret;
+}
+
+static void
+gnn_lstm_cache_arena_free(gnn_lstm_cache_arena_t* arena)
+{
+  gnn_mem_free(arena->data, arena->size * sizeof(float), GANN_MEM_DEFAULT);
+  free(arena->steps);
+  free(arena);
+}
+
+/*!
+** zeroes the hidden and cell state a sequence starts from.
+*/
+static void
+gnn_lstm_cache_set_start(gnn_lstm_values_cache_t* cache, int N)
+{
+  memset(cache->h, 0, N * sizeof(float));
+  memset(cache->c, 0, N * sizeof(float));
+}
+
+/*!
+** copies the state into the cache if to_state is 0, otherwise the cache
+** into the state.
+*/
+static void
+gnn_lstm_state_copy(gnn_lstm_values_state_t* state, gnn_lstm_values_cache_t* cache, int N, int to_state)
+{
+  if (to_state)
+  {
+    gnn_vec_copy(state->h, cache->h, N);
+    gnn_vec_copy(state->c, cache->c, N);
+  }
+  else
+  {
+    gnn_vec_copy(cache->h, state->h, N);
+    gnn_vec_copy(cache->c, state->c, N);
+  }
+}
+
+static void
+gnn_lstm_next_cache_zero(gnn_lstm_values_next_cache_t* d_next, int N)
+{
+  memset(d_next->dldh_next, 0, N * sizeof(float));
+  memset(d_next->dldc_next, 0, N * sizeof(float));
+}
+
+static void
+gnn_lstm_store_progress(const char* path, ulong n, double loss)
+{
+  FILE* fout = fopen(path, "a");
+  if (fout == NULL) return;
+  fprintf(fout, "%lu,%lf\n", n, loss);
+  fclose(fout);
+}
+
+/*!
+** the training state of the layers on a slice of the data, shared by the
+** layer threads of the wavefront, the main thread moves it from minibatch to
+** minibatch. with workers every worker has a replica of its own.
+*/
+struct gnn_lstm_trainer_s
+{
+  gnn_lstm_t**                model_layers;
+
+  gnn_lstm_params_t*          params;
+
+  uint                        layers;
+
+  uint                        training_points;
+
+  int*                        X_train;
+
+  int*                        Y_train;
+
+  gnn_lstm_cache_arena_t**    cache_layers;
+
+  gnn_lstm_grad_t**           gradient_layers;
+
+  /*!
+  ** the first moment of adam, or the velocity of gradient descent
+  */
+  gnn_lstm_grad_t**           M_layers;
+
+  gnn_lstm_grad_t**           R_layers;
+
   /*!
-  ** hf_t = wf_t * X_t + bf_t
+  ** the position in the slice, the start and the timesteps of the minibatch
   */
-  gnn_lstm_full_forward(cache_out->hf, model->Wf, X_one_hot, model->bf, N, S);
-  gnn_lstm_sigmoid_forward(cache_out->hf, cache_out->hf, N);
+  uint                        i;
 
-  gnn_lstm_full_forward(cache_out->hi, model->Wi, X_one_hot, model->bi, N, S);
-  gnn_lstm_sigmoid_forward(cache_out->hi, cache_out->hi, N);
+  uint                        b;
 
-  gnn_lstm_full_forward(cache_out->ho, model->Wo, X_one_hot, model->bo, N, S);
-  gnn_lstm_sigmoid_forward(cache_out->ho, cache_out->ho, N);
+  uint                        trailing;
 
-  gnn_lstm_full_forward(cache_out->hc, model->Wc, X_one_hot, model->bc, N, S);
-  gnn_lstm_tanh_forward(cache_out->hc, cache_out->hc, N);
+  /*!
+  ** the iteration of the minibatch
+  */
+  ulong                       n;
 
   /*!
-  ** c = hf * c_old + hi * hc
+  ** the cross entropy summed up by layer 0
   */
-  gnn_vec_copy(cache_out->c, cache_out->hf, N);
-  gnn_vec_multiply(cache_out->c, c_old, N);
+  double                      loss;
 
-  gnn_vec_copy(tmp, cache_out->hi, N);
-  gnn_vec_multiply(tmp, cache_out->hc, N);
+  /*!
+  ** the generation of the minibatch a layer finished a timestep of, in the
+  ** forward and the backward pass, [layers x T]
+  */
+  atomic_ulong*               forward_flags;
 
-  gnn_vec_add(cache_out->c, tmp, N);
+  atomic_ulong*               backward_flags;
 
   /*!
-  ** h = ho * tanh_c_cache
+  ** the minibatch published to the layer threads, and the last one each
+  ** layer finished
   */
-  gnn_lstm_tanh_forward(cache_out->tanh_c_cache, cache_out->c, N);
-  gnn_vec_copy(cache_out->h, cache_out->ho, N);
-  gnn_vec_multiply(cache_out->h, cache_out->tanh_c_cache, N);
+  atomic_ulong                generation;
+
+  atomic_ulong*               done;
+
+  atomic_int                  stop;
+
+  pthread_t*                  threads;
+};
+
+typedef struct gnn_lstm_layer_job_s
+{
+  gnn_lstm_trainer_t*         trainer;
+
+  uint                        p;
+}
+gnn_lstm_layer_job_t;
+
+/*!
+** the replicas of the data parallel training, every worker runs the layers
+** of its replica on its slice of the data, then the gradients are summed up
+** in a tree, so the sum is the same for the same number of workers.
+*/
+typedef struct gnn_lstm_workers_s
+{
+  gnn_lstm_trainer_t*         replicas;
+
+  uint                        count;
+
+  /*!
+  ** the reduction a replica reached, the generation times
+  ** GANN_LSTM_REDUCE_STAGES plus the levels of the tree it summed up
+  */
+  atomic_ulong*               stages;
+
+  /*!
+  ** the minibatch published to the workers, and the last one each worker
+  ** finished
+  */
+  atomic_ulong                generation;
+
+  atomic_ulong*               done;
+
+  atomic_int                  stop;
+
+  pthread_t*                  threads;
+}
+gnn_lstm_workers_t;
+
+typedef struct gnn_lstm_worker_job_s
+{
+  gnn_lstm_workers_t*         workers;
+
+  uint                        rank;
+}
+gnn_lstm_worker_job_t;
+
+/*!
+** more than the levels of any tree of workers
+*/
+#define GANN_LSTM_REDUCE_STAGES             64
+
+/*!
+** spins until a flag of the wavefront reaches the generation.
+*/
+static void
+gnn_lstm_flag_wait(atomic_ulong* flag, ulong generation)
+{
+  while (atomic_load_explicit(flag, memory_order_acquire) < generation)
+    sched_yield();
+}
+
+/*!
+** spins until the main thread publishes the minibatch after seen.
+**
+** @return 0 when the training is over
+*/
+static int
+gnn_lstm_generation_wait(atomic_ulong* generation, atomic_int* stop, ulong seen)
+{
+  while (atomic_load_explicit(generation, memory_order_acquire) == seen)
+  {
+    if (atomic_load_explicit(stop, memory_order_acquire))
+      return 0;
+    sched_yield();
+  }
+  return 1;
+}
+
+/*!
+** the forward pass of layer p over the minibatch, with threads a timestep
+** waits for the layer above at the same timestep.
+*/
+static void
+gnn_lstm_layer_forward(gnn_lstm_trainer_t* trainer, uint p, ulong generation)
+{
+  gnn_lstm_t* model = trainer->model_layers[p];
+  gnn_lstm_cache_arena_t* cache = trainer->cache_layers[p];
+  uint T = cache->T, layers = trainer->layers;
+  float* input = NULL;
+  int symbol = -1;
+  uint q, e3;
+
+  if ( trainer->params->stateful && p > 0 )
+    gnn_lstm_state_copy(&cache->state, &cache->steps[0], model->N, 0);
+  else
+    gnn_lstm_cache_set_start(&cache->steps[0], model->N);
+
+  for ( q = 0; q < trainer->trailing; ++q )
+  {
+    e3 = trainer->b + q;
+
+    /* Layer numbering starts at the output point of the net, the symbols go in one hot */
+    if ( p == layers - 1 )
+      symbol = trainer->X_train[e3];
+    else
+    {
+      if ( trainer->threads != NULL )
+        gnn_lstm_flag_wait(&trainer->forward_flags[(p + 1) * T + q], generation);
+      input = trainer->cache_layers[p + 1]->steps[q + 1].probs;
+    }
+
+    gnn_lstm_forward_step(model, input, symbol, &cache->steps[q], &cache->steps[q + 1], p == 0);
+
+    if ( p == 0 && trainer->params->huffman != NULL )
+      trainer->loss += gnn_lstm_huffman_path_forward(model, cache->steps[q + 1].h, trainer->Y_train[e3],
+                                                     cache->steps[q + 1].probs);
+    else if ( p == 0 )
+      trainer->loss += gnn_lstm_cross_entropy(cache->steps[q + 1].probs, trainer->Y_train[e3]);
+
+    if ( trainer->threads != NULL )
+      atomic_store_explicit(&trainer->forward_flags[p * T + q], generation, memory_order_release);
+  }
+
+  if ( trainer->params->stateful )
+    gnn_lstm_state_copy(&cache->state, &cache->steps[trainer->trailing], model->N, 1);
+}
+
+/*!
+** the backward pass of layer p over the minibatch, the timesteps add their
+** gradients up, so they are zeroed once here. with threads a timestep waits
+** for the layer below it in the net, p - 1, at the same timestep.
+*/
+static void
+gnn_lstm_layer_backward(gnn_lstm_trainer_t* trainer, uint p, ulong generation)
+{
+  gnn_lstm_t* model = trainer->model_layers[p];
+  gnn_lstm_cache_arena_t* cache = trainer->cache_layers[p];
+  gnn_lstm_cache_arena_t* below = p > 0 ? trainer->cache_layers[p - 1] : NULL;
+  gnn_lstm_values_next_cache_t out = cache->next;
+  uint T = cache->T;
+  uint q;
+
+  gnn_lstm_grad_zero(trainer->gradient_layers[p]);
+  gnn_lstm_next_cache_zero(&cache->next, model->N);
+
+  for ( q = trainer->trailing; q > 0; --q )
+  {
+    out.dldY_pass = cache->passes + q * cache->ld_pass;
+
+    if ( p == 0 )
+    {
+      gnn_lstm_backward_propagate(model,
+        cache->steps[q].probs,
+        trainer->Y_train[trainer->b + q - 1],
+        &cache->next,
+        &cache->steps[q],
+        trainer->gradient_layers[p],
+        &out);
+    }
+    else
+    {
+      if ( trainer->threads != NULL )
+        gnn_lstm_flag_wait(&trainer->backward_flags[(p - 1) * T + q], generation);
+      gnn_lstm_backward_propagate(model,
+        below->passes + q * below->ld_pass,
+        -1,
+        &cache->next,
+        &cache->steps[q],
+        trainer->gradient_layers[p],
+        &out);
+    }
+
+    if ( trainer->threads != NULL )
+      atomic_store_explicit(&trainer->backward_flags[p * T + q], generation, memory_order_release);
+  }
+}
+
+/*!
+** the optimizer step of layer p, clipping and fitting are folded into the update.
+*/
+static void
+gnn_lstm_layer_update(gnn_lstm_trainer_t* trainer, uint p)
+{
+  gnn_lstm_params_t* params = trainer->params;
+  gnn_lstm_grad_t* grad = trainer->gradient_layers[p];
+  float clip = params->gradient_clip ? params->gradient_clip_limit : FLT_MAX;
+  float scale = gnn_lstm_grad_scale(grad, clip, params->gradient_fit, params->gradient_clip_limit);
+
+  if ( params->optimizer == OPTIMIZE_ADAM )
+    gnn_lstm_adam(trainer->model_layers[p], grad, trainer->M_layers[p], trainer->R_layers[p],
+                  trainer->n, clip, scale);
+  else
+    gnn_lstm_descend(trainer->model_layers[p], grad, trainer->M_layers[p], clip, scale);
+}
+
+/*!
+** the thread of a layer in the wavefront, it trains its layer on every
+** minibatch the main thread publishes. the update of a layer only needs the
+** backward pass of the layer itself, so it runs as soon as that is done.
+*/
+static void*
+gnn_lstm_layer_run(void* data)
+{
+  gnn_lstm_layer_job_t* job = (gnn_lstm_layer_job_t*) data;
+  gnn_lstm_trainer_t* trainer = job->trainer;
+  ulong generation = 0;
 
-  /*!
-  ** probs = softmax ( Wy*h + by )
-  */
-  gnn_lstm_full_forward(cache_out->probs, model->Wy, cache_out->h, model->by, Y, N);
-  if (softmax > 0)
-  {
-    gnn_lstm_softmax_forward(cache_out->probs, cache_out->probs, Y, model->params->softmax_temp);
-  }
-#ifdef INTERLAYER_SIGMOID_ACTIVATION
-  if (softmax <= 0)
+  while (gnn_lstm_generation_wait(&trainer->generation, &trainer->stop, generation))
   {
-    gnn_lstm_sigmoid_forward(cache_out->probs, cache_out->probs, Y);
-    gnn_vec_copy(cache_out->probs_before_sigma, cache_out->probs, Y);
+    generation++;
+    gnn_lstm_layer_forward(trainer, job->p, generation);
+    gnn_lstm_layer_backward(trainer, job->p, generation);
+    gnn_lstm_layer_update(trainer, job->p);
+    atomic_store_explicit(&trainer->done[job->p], generation, memory_order_release);
   }
-#endif
-
-  gnn_vec_copy(cache_out->X, X_one_hot, S);
+  return NULL;
+}
 
-#ifdef WINDOWS
-  free_vector(&tmp);
-#endif
+void
+gnn_lstm_trainer_gradients(gnn_lstm_trainer_t* trainer)
+{
+  uint p = trainer->layers;
 
+  while ( p-- > 0 )
+    gnn_lstm_layer_forward(trainer, p, 0);
+  for ( p = 0; p < trainer->layers; ++p )
+    gnn_lstm_layer_backward(trainer, p, 0);
 }
 
-//              model, y_probabilities, y_correct, the next deltas, state and cache values, &gradients, &the next deltas
-void
-gnn_lstm_backward_propagate(gnn_lstm_t*                     model,
-                            double*                         y_probabilities,
-                            int                             y_correct,
-                            gnn_lstm_values_next_cache_t*   d_next,
-                            gnn_lstm_values_cache_t*        cache_in,
-                            gnn_lstm_t*                     gradients,
-                            gnn_lstm_values_next_cache_t*   cache_out)
+/*!
+** trains the layers on one minibatch, serially or on the layer threads.
+*/
+static void
+gnn_lstm_trainer_step(gnn_lstm_trainer_t* trainer)
 {
-  double *h,*dldh_next,*dldc_next, *dldy, *dldh, *dldho, *dldhf, *dldhi, *dldhc, *dldc;
-  int N, Y, S;
+  ulong generation;
+  uint p;
 
-  N = model->N;
-  Y = model->Y;
-  S = model->S;
+  if ( trainer->threads != NULL )
+  {
+    generation = atomic_load_explicit(&trainer->generation, memory_order_relaxed) + 1;
+    atomic_store_explicit(&trainer->generation, generation, memory_order_release);
+    for ( p = 0; p < trainer->layers; ++p )
+      gnn_lstm_flag_wait(&trainer->done[p], generation);
+    return;
+  }
 
-  // model cache
-  dldh = model->dldh;
-  dldc = model->dldc;
-  dldho = model->dldho;
-  dldhi = model->dldhi;
-  dldhf = model->dldhf;
-  dldhc = model->dldhc;
+  gnn_lstm_trainer_gradients(trainer);
+  for ( p = 0; p < trainer->layers; ++p )
+    gnn_lstm_layer_update(trainer, p);
+}
 
-  h = cache_in->h;
+/*!
+** the minibatch of a replica starts at its position in its slice.
+*/
+static void
+gnn_lstm_trainer_begin(gnn_lstm_trainer_t* trainer, ulong n)
+{
+  uint mini_batch_size = trainer->params->mini_batch_size;
+
+  trainer->b = trainer->i;
+  trainer->trailing = mini_batch_size;
+  if ( trainer->i + mini_batch_size >= trainer->training_points )
+    trainer->trailing = trainer->training_points - trainer->i;
+  trainer->n = n;
+  trainer->loss = 0;
+}
 
-  dldh_next = d_next->dldh_next;
-  dldc_next = d_next->dldc_next;
+/*!
+** moves a replica to its next minibatch.
+**
+** @return 1 if the minibatch was the last of the slice
+*/
+static int
+gnn_lstm_trainer_end(gnn_lstm_trainer_t* trainer)
+{
+  uint mini_batch_size = trainer->params->mini_batch_size;
+  int ret = trainer->b + mini_batch_size >= trainer->training_points;
 
-  dldy = y_probabilities;
+  trainer->i = (trainer->b + mini_batch_size) % trainer->training_points;
+  if ( trainer->i < mini_batch_size )
+    trainer->i = 0;
+  return ret;
+}
 
-  if ( y_correct >= 0 ) {
-    dldy[y_correct] -= 1.0;
-  }
-#ifdef INTERLAYER_SIGMOID_ACTIVATION
-  if ( y_correct < 0 ) {
-    gnn_lstm_sigmoid_backward(dldy, cache_in->probs_before_sigma, dldy, Y);
+/*!
+** a replica of the layers on training_points points of the data, the
+** moments of the optimizer are shared by the replicas.
+*/
+static void
+gnn_lstm_trainer_init(gnn_lstm_trainer_t*   trainer,
+                      gnn_lstm_t**          model_layers,
+                      gnn_lstm_params_t*    params,
+                      uint                  layers,
+                      uint                  training_points,
+                      int*                  X_train,
+                      int*                  Y_train,
+                      gnn_lstm_grad_t**     M_layers,
+                      gnn_lstm_grad_t**     R_layers)
+{
+  uint p;
+
+  memset(trainer, 0, sizeof(gnn_lstm_trainer_t));
+  trainer->model_layers = model_layers;
+  trainer->params = params;
+  trainer->layers = layers;
+  trainer->training_points = training_points;
+  trainer->X_train = X_train;
+  trainer->Y_train = Y_train;
+  trainer->M_layers = M_layers;
+  trainer->R_layers = R_layers;
+  trainer->cache_layers = gnn_lstm_calloc(layers, sizeof(gnn_lstm_cache_arena_t*));
+  trainer->gradient_layers = gnn_lstm_calloc(layers, sizeof(gnn_lstm_grad_t*));
+  for ( p = 0; p < layers; ++p )
+  {
+    trainer->cache_layers[p] = gnn_lstm_cache_arena_new(model_layers[p], params->mini_batch_size + 1);
+    trainer->gradient_layers[p] = gnn_lstm_grad_new(model_layers[p]);
   }
-#endif
+}
 
-  gnn_lstm_full_backward(dldy, model->Wy, h, gradients->Wy, dldh, gradients->by, Y, N);
-  gnn_vec_add(dldh, dldh_next, N);
+static void
+gnn_lstm_trainer_release(gnn_lstm_trainer_t* trainer)
+{
+  uint p;
 
-  gnn_vec_copy(dldho, dldh, N);
-  gnn_vec_multiply(dldho, cache_in->tanh_c_cache, N);
-  gnn_lstm_sigmoid_backward(dldho, cache_in->ho, dldho, N);
+  for ( p = 0; p < trainer->layers; ++p )
+  {
+    gnn_lstm_cache_arena_free(trainer->cache_layers[p]);
+    gnn_lstm_grad_free(trainer->gradient_layers[p]);
+  }
+  free(trainer->cache_layers);
+  free(trainer->gradient_layers);
+}
 
-  gnn_vec_copy(dldc, dldh, N);
-  gnn_vec_multiply(dldc, cache_in->ho, N);
-  gnn_lstm_tanh_backward(dldc, cache_in->tanh_c_cache, dldc, N);
-  gnn_vec_add(dldc, dldc_next, N);
+gnn_lstm_trainer_t*
+gnn_lstm_trainer_new(gnn_lstm_t**          model_layers,
+                     gnn_lstm_params_t*    params,
+                     uint                  layers,
+                     uint                  training_points,
+                     int*                  X_train,
+                     int*                  Y_train)
+{
+  gnn_lstm_trainer_t* ret = gnn_lstm_calloc(1, sizeof(gnn_lstm_trainer_t));
 
-  gnn_vec_copy(dldhf, dldc, N);
-  gnn_vec_multiply(dldhf, cache_in->c_old, N);
-  gnn_lstm_sigmoid_backward(dldhf, cache_in->hf, dldhf, N);
+  gnn_lstm_trainer_init(ret, model_layers, params, layers, training_points, X_train, Y_train, NULL, NULL);
+  gnn_lstm_trainer_begin(ret, 0);
+  return ret;
+}
 
-  gnn_vec_multiply(dldhi, cache_in->hc, N);
-  gnn_vec_multiply(dldhi, dldc, N);
-  gnn_lstm_sigmoid_backward(dldhi, cache_in->hi, dldhi, N);
+void
+gnn_lstm_trainer_free(gnn_lstm_trainer_t* trainer)
+{
+  if ( trainer == NULL ) return;
+  gnn_lstm_trainer_release(trainer);
+  free(trainer);
+}
 
-  gnn_vec_copy(dldhc, cache_in->hi, N);
-  gnn_vec_multiply(dldhc, dldc, N);
-  gnn_lstm_tanh_backward(dldhc, cache_in->hc, dldhc, N);
+double
+gnn_lstm_trainer_loss(gnn_lstm_trainer_t* trainer)
+{
+  uint p = trainer->layers;
 
-  gnn_lstm_full_backward(dldhi, model->Wi, cache_in->X, gradients->Wi, gradients->dldXi, gradients->bi, N, S);
-  gnn_lstm_full_backward(dldhc, model->Wc, cache_in->X, gradients->Wc, gradients->dldXc, gradients->bc, N, S);
-  gnn_lstm_full_backward(dldho, model->Wo, cache_in->X, gradients->Wo, gradients->dldXo, gradients->bo, N, S);
-  gnn_lstm_full_backward(dldhf, model->Wf, cache_in->X, gradients->Wf, gradients->dldXf, gradients->bf, N, S);
+  trainer->loss = 0;
+  while ( p-- > 0 )
+    gnn_lstm_layer_forward(trainer, p, 0);
+  return trainer->loss;
+}
 
-  // dldXi will work as a temporary substitute for dldX (where we get extract dh_next from!)
-  gnn_vec_add(gradients->dldXi, gradients->dldXc, S);
-  gnn_vec_add(gradients->dldXi, gradients->dldXo, S);
-  gnn_vec_add(gradients->dldXi, gradients->dldXf, S);
+gnn_lstm_grad_t*
+gnn_lstm_trainer_gradient(gnn_lstm_trainer_t const* trainer, uint p)
+{
+  return trainer->gradient_layers[p];
+}
 
-  gnn_vec_copy(cache_out->dldh_next, gradients->dldXi, N);
-  gnn_vec_copy(cache_out->dldc_next, cache_in->hf, N);
-  gnn_vec_multiply(cache_out->dldc_next, dldc, N);
+/*!
+** the wavefront, every layer of the replica on a thread of its own.
+*/
+static void
+gnn_lstm_trainer_start(gnn_lstm_trainer_t* trainer, gnn_lstm_layer_job_t* jobs)
+{
+  size_t flags = (size_t) trainer->layers * (trainer->params->mini_batch_size + 1);
+  uint p;
+  size_t k;
+
+  trainer->forward_flags = gnn_lstm_calloc(flags, sizeof(atomic_ulong));
+  trainer->backward_flags = gnn_lstm_calloc(flags, sizeof(atomic_ulong));
+  trainer->done = gnn_lstm_calloc(trainer->layers, sizeof(atomic_ulong));
+  for ( k = 0; k < flags; ++k )
+  {
+    atomic_init(&trainer->forward_flags[k], 0);
+    atomic_init(&trainer->backward_flags[k], 0);
+  }
+  for ( p = 0; p < trainer->layers; ++p )
+    atomic_init(&trainer->done[p], 0);
+  atomic_init(&trainer->generation, 0);
+  atomic_init(&trainer->stop, 0);
 
-  // To pass on to next layer
-  gnn_vec_copy(cache_out->dldY_pass, &gradients->dldXi[N], model->X);
+  trainer->threads = gnn_lstm_calloc(trainer->layers, sizeof(pthread_t));
+  for ( p = 0; p < trainer->layers; ++p )
+  {
+    jobs[p].trainer = trainer;
+    jobs[p].p = p;
+    if ( pthread_create(&trainer->threads[p], NULL, gnn_lstm_layer_run, &jobs[p]) != 0 )
+    {
+      fprintf(stderr, "error: failed to start layer thread in %d of %s.\n", __LINE__, __FILE__);
+      exit(1);
+    }
+  }
 }
 
-void lstm_zero_the_model(gnn_lstm_t * model)
+static void
+gnn_lstm_trainer_stop(gnn_lstm_trainer_t* trainer)
 {
-  vector_set_to_zero(model->Wy, model->Y * model->N);
-  vector_set_to_zero(model->Wi, model->N * model->S);
-  vector_set_to_zero(model->Wc, model->N * model->S);
-  vector_set_to_zero(model->Wo, model->N * model->S);
-  vector_set_to_zero(model->Wf, model->N * model->S);
+  uint p;
+
+  atomic_store_explicit(&trainer->stop, 1, memory_order_release);
+  for ( p = 0; p < trainer->layers; ++p )
+    pthread_join(trainer->threads[p], NULL);
+  free(trainer->threads);
+  free(trainer->forward_flags);
+  free(trainer->backward_flags);
+  free(trainer->done);
+  trainer->threads = NULL;
+}
 
-  vector_set_to_zero(model->by, model->Y);
-  vector_set_to_zero(model->bi, model->N);
-  vector_set_to_zero(model->bc, model->N);
-  vector_set_to_zero(model->bf, model->N);
-  vector_set_to_zero(model->bo, model->N);
+/*!
+** sums the gradients of the replicas up into replica 0. at level k a replica
+** whose rank is a multiple of 2^(k+1) adds the replica 2^k above it, which
+** has summed up its own subtree by then, so every sum runs in the same order
+** whatever the timing. the sum of replica 0 becomes the mean.
+*/
+static void
+gnn_lstm_workers_reduce(gnn_lstm_workers_t* workers, uint rank, ulong generation)
+{
+  gnn_lstm_trainer_t* replica = &workers->replicas[rank];
+  gnn_lstm_trainer_t* child;
+  ulong stage = generation * GANN_LSTM_REDUCE_STAGES;
+  uint s, p, level = 0;
 
-  vector_set_to_zero(model->Wym, model->Y * model->N);
-  vector_set_to_zero(model->Wim, model->N * model->S);
-  vector_set_to_zero(model->Wcm, model->N * model->S);
-  vector_set_to_zero(model->Wom, model->N * model->S);
-  vector_set_to_zero(model->Wfm, model->N * model->S);
+  atomic_store_explicit(&workers->stages[rank], stage, memory_order_release);
+  for ( s = 1; s < workers->count && rank % (2 * s) == 0; s *= 2, ++level )
+  {
+    if ( rank + s < workers->count )
+    {
+      child = &workers->replicas[rank + s];
+      gnn_lstm_flag_wait(&workers->stages[rank + s], stage + level);
+      for ( p = 0; p < replica->layers; ++p )
+        gnn_vec_add(replica->gradient_layers[p]->data, child->gradient_layers[p]->data,
+                    replica->gradient_layers[p]->size);
+    }
+    atomic_store_explicit(&workers->stages[rank], stage + level + 1, memory_order_release);
+  }
 
-  vector_set_to_zero(model->bym, model->Y);
-  vector_set_to_zero(model->bim, model->N);
-  vector_set_to_zero(model->bcm, model->N);
-  vector_set_to_zero(model->bfm, model->N);
-  vector_set_to_zero(model->bom, model->N);
+  if ( rank == 0 )
+    for ( p = 0; p < replica->layers; ++p )
+      gnn_vec_multiply_scalar(replica->gradient_layers[p]->data, 1.0f / workers->count,
+                              replica->gradient_layers[p]->size);
+}
 
-  vector_set_to_zero(model->dldhf, model->N);
-  vector_set_to_zero(model->dldhi, model->N);
-  vector_set_to_zero(model->dldhc, model->N);
-  vector_set_to_zero(model->dldho, model->N);
-  vector_set_to_zero(model->dldc, model->N);
-  vector_set_to_zero(model->dldh, model->N);
+/*!
+** the thread of a worker, it computes the gradients of its replica on every
+** minibatch the main thread publishes and takes part in the reduction.
+*/
+static void*
+gnn_lstm_worker_run(void* data)
+{
+  gnn_lstm_worker_job_t* job = (gnn_lstm_worker_job_t*) data;
+  gnn_lstm_workers_t* workers = job->workers;
+  ulong generation = 0;
 
-  vector_set_to_zero(model->dldXc, model->S);
-  vector_set_to_zero(model->dldXo, model->S);
-  vector_set_to_zero(model->dldXi, model->S);
-  vector_set_to_zero(model->dldXf, model->S);
+  while (gnn_lstm_generation_wait(&workers->generation, &workers->stop, generation))
+  {
+    generation++;
+    gnn_lstm_trainer_gradients(&workers->replicas[job->rank]);
+    gnn_lstm_workers_reduce(workers, job->rank, generation);
+    atomic_store_explicit(&workers->done[job->rank], generation, memory_order_release);
+  }
+  return NULL;
 }
 
 /*!
-** makes a new lstm network instance.
-**
-** @param X
-**        the input number
-**
-** @param N
-**        the hidden neuron number
-**
-** @param Y
-**        the output number
+** trains the replicas on one minibatch each, the optimizer steps the layers
+** once with the mean of their gradients.
 */
-gnn_lstm_t*
-gnn_lstm_new(int                  X,
-             int                  N,
-             int                  Y,
-             int                  zeros,
-             gnn_lstm_params_t*   params)
+static void
+gnn_lstm_workers_step(gnn_lstm_workers_t* workers)
 {
-  int S = X + N;
-  gnn_lstm_t* ret = e_calloc(1, sizeof(gnn_lstm_t));
+  ulong generation;
+  uint w, p;
 
-  ret->X = X;
-  ret->N = N;
-  ret->S = S;
-  ret->Y = Y;
+  if ( workers->threads == NULL )
+  {
+    gnn_lstm_trainer_step(&workers->replicas[0]);
+    return;
+  }
 
-  ret->params = params;
+  generation = atomic_load_explicit(&workers->generation, memory_order_relaxed) + 1;
+  atomic_store_explicit(&workers->generation, generation, memory_order_release);
+  for ( w = 0; w < workers->count; ++w )
+    gnn_lstm_flag_wait(&workers->done[w], generation);
 
-  if (zeros) {
-    ret->Wf = gnn_vec_new(N * S, 0);
-    ret->Wi = gnn_vec_new(N * S, 0);
-    ret->Wc = gnn_vec_new(N * S, 0);
-    ret->Wo = gnn_vec_new(N * S, 0);
-    ret->Wy = gnn_vec_new(Y * N, 0);
-  } else {
-    ret->Wf = gnn_vec_new(N * S, (double)S);
-    ret->Wi = gnn_vec_new(N * S, (double)S);
-    ret->Wc = gnn_vec_new(N * S, (double)S);
-    ret->Wo = gnn_vec_new(N * S, (double)S);
-    ret->Wy = gnn_vec_new(Y * N, (double)N);
-  }
-
-  ret->bf = gnn_vec_new(N, 0);
-  ret->bi = gnn_vec_new(N, 0);
-  ret->bc = gnn_vec_new(N, 0);
-  ret->bo = gnn_vec_new(N, 0);
-  ret->by = gnn_vec_new(Y, 0);
-
-  ret->dldhf = gnn_vec_new(N, 0);
-  ret->dldhi = gnn_vec_new(N, 0);
-  ret->dldhc = gnn_vec_new(N, 0);
-  ret->dldho = gnn_vec_new(N, 0);
-  ret->dldc  = gnn_vec_new(N, 0);
-  ret->dldh  = gnn_vec_new(N, 0);
-
-  ret->dldXc = gnn_vec_new(S, 0);
-  ret->dldXo = gnn_vec_new(S, 0);
-  ret->dldXi = gnn_vec_new(S, 0);
-  ret->dldXf = gnn_vec_new(S, 0);
-
-  // Gradient descent momentum caches
-  ret->Wfm = gnn_vec_new(N * S, 0);
-  ret->Wim = gnn_vec_new(N * S, 0);
-  ret->Wcm = gnn_vec_new(N * S, 0);
-  ret->Wom = gnn_vec_new(N * S, 0);
-  ret->Wym = gnn_vec_new(Y * N, 0);
-
-  ret->bfm = gnn_vec_new(N, 0);
-  ret->bim = gnn_vec_new(N, 0);
-  ret->bcm = gnn_vec_new(N, 0);
-  ret->bom = gnn_vec_new(N, 0);
-  ret->bym = gnn_vec_new(Y, 0);
+  for ( p = 0; p < workers->replicas[0].layers; ++p )
+    gnn_lstm_layer_update(&workers->replicas[0], p);
+}
 
-  return ret;
+static void
+gnn_lstm_workers_start(gnn_lstm_workers_t* workers, gnn_lstm_worker_job_t* jobs)
+{
+  uint w;
+
+  workers->stages = gnn_lstm_calloc(workers->count, sizeof(atomic_ulong));
+  workers->done = gnn_lstm_calloc(workers->count, sizeof(atomic_ulong));
+  for ( w = 0; w < workers->count; ++w )
+  {
+    atomic_init(&workers->stages[w], 0);
+    atomic_init(&workers->done[w], 0);
+  }
+  atomic_init(&workers->generation, 0);
+  atomic_init(&workers->stop, 0);
+
+  workers->threads = gnn_lstm_calloc(workers->count, sizeof(pthread_t));
+  for ( w = 0; w < workers->count; ++w )
+  {
+    jobs[w].workers = workers;
+    jobs[w].rank = w;
+    if ( pthread_create(&workers->threads[w], NULL, gnn_lstm_worker_run, &jobs[w]) != 0 )
+    {
+      fprintf(stderr, "error: failed to start worker thread in %d of %s.\n", __LINE__, __FILE__);
+      exit(1);
+    }
+  }
+}
+
+static void
+gnn_lstm_workers_stop(gnn_lstm_workers_t* workers)
+{
+  uint w;
+
+  atomic_store_explicit(&workers->stop, 1, memory_order_release);
+  for ( w = 0; w < workers->count; ++w )
+    pthread_join(workers->threads[w], NULL);
+  free(workers->threads);
+  free(workers->stages);
+  free(workers->done);
+  workers->threads = NULL;
 }
 
 /*!
@@ -374,15 +1557,13 @@ gnn_lstm_new(int                  X,
 void
 gnn_lstm_train(gnn_lstm_t**        model_layers,
                gnn_lstm_params_t*  params,
-               set_t*              char_index_mapping,
                uint                training_points,
                int*                X_train,
                int*                Y_train,
                uint                layers,
                double*             loss_out)
 {
-  unsigned int p, i = 0, b = 0, q = 0, e1 = 0, e2 = 0,
-    e3, record_iteration = 0, tmp_count, trailing;
+  unsigned int p, w, lo, hi, record_iteration = 0;
   unsigned long n = 0, epoch = 0;
   double loss = -1, loss_tmp = 0.0, record_keeper = 0.0;
   double initial_learning_rate = params->learning_rate;
@@ -390,204 +1571,91 @@ gnn_lstm_train(gnn_lstm_t**        model_layers,
   char time_buffer[40];
   unsigned long iterations = params->iterations;
   unsigned long epochs = params->epochs;
-  int stateful = params->stateful, decrease_lr = params->decrease_lr;
+  int decrease_lr = params->decrease_lr;
   // configuration for output printing during training
   int print_progress = params->print_progress;
   int print_progress_iterations = params->print_progress_iterations;
-  int print_progress_sample_output = params->print_progress_sample_output;
-  int print_progress_to_file = params->print_progress_to_file;
-  int print_progress_number_of_chars = params->print_progress_number_of_chars;
-  char *print_progress_to_file_name = params->print_sample_output_to_file_name;
-  char *print_progress_to_file_arg = params->print_sample_output_to_file_arg;
   int store_progress_every_x_iterations = params->store_progress_every_x_iterations;
   char *store_progress_file_name = params->store_progress_file_name;
-  int store_network_every = params->store_network_every;
 
-  gnn_lstm_values_state_t**       stateful_d_next = NULL;
-  gnn_lstm_values_cache_t***      cache_layers;
-  gnn_lstm_values_next_cache_t**  d_next_layers;
-
-  gnn_lstm_t**  gradient_layers = NULL;
-  gnn_lstm_t**  gradient_layers_entry = NULL;
-  gnn_lstm_t**  M_layers = NULL;
-  gnn_lstm_t**  R_layers = NULL;
-
-#ifdef WINDOWS
-  double *first_layer_input = malloc(model_layers[0]->Y*sizeof(double));
+  gnn_lstm_grad_t** M_layers;
+  gnn_lstm_grad_t** R_layers = NULL;
+  gnn_lstm_workers_t workers;
+  gnn_lstm_worker_job_t* worker_jobs = NULL;
+  gnn_lstm_layer_job_t* layer_jobs = NULL;
+
+  if ( params->optimizer != OPTIMIZE_ADAM && params->optimizer != OPTIMIZE_GRADIENT_DESCENT ) {
+    fprintf( stderr,
+      "Failed to update gradients, no acceptible optimization algorithm provided.\n\
+      lstm_model_parameters_t has a field called 'optimizer'. Set this value to:\n\
+      %d: Adam gradients optimizer algorithm\n\
+      %d: Gradients descent algorithm.\n",
+      OPTIMIZE_ADAM,
+      OPTIMIZE_GRADIENT_DESCENT
+    );
+    exit(1);
+  }
 
-  if ( first_layer_input == NULL ) {
-    fprintf(stderr, "%s.%s.%d malloc(%zu) failed\r\n",
-      __FILE__, __func__, __LINE__, model_layers[0]->Y*sizeof(double));
+  if ( params->huffman != NULL && model_layers[0]->Y != params->huffman->size ) {
+    fprintf(stderr, "error: the %u outputs of layer 0 are not the %lld words of the huffman tree.\n",
+            model_layers[0]->Y, params->huffman->size);
     exit(1);
   }
-#else
-  double first_layer_input[model_layers[0]->Y];
-#endif
 
-  if ( stateful )
+  M_layers = gnn_lstm_calloc(layers, sizeof(gnn_lstm_grad_t*));
+  if ( params->optimizer == OPTIMIZE_ADAM )
+    R_layers = gnn_lstm_calloc(layers, sizeof(gnn_lstm_grad_t*));
+  for ( p = 0; p < layers; ++p )
   {
-    stateful_d_next = e_calloc(layers, sizeof(gnn_lstm_values_cache_t*));
-
-    i = 0;
-    while ( i < layers )
-    {
-      stateful_d_next[i] = e_calloc( training_points/params->mini_batch_size + 1, sizeof(gnn_lstm_values_state_t));
-
-      lstm_values_state_init(&stateful_d_next[i], model_layers[i]->N);
-      ++i;
-    }
+    M_layers[p] = gnn_lstm_grad_new(model_layers[p]);
+    if ( params->optimizer == OPTIMIZE_ADAM )
+      R_layers[p] = gnn_lstm_grad_new(model_layers[p]);
   }
 
-  i = 0;
-  cache_layers = e_calloc(layers, sizeof(gnn_lstm_values_cache_t**));
-
-  while ( i < layers )
+  /*!
+  ** a replica for every worker on a slice of the data of its own
+  */
+  memset(&workers, 0, sizeof(workers));
+  workers.count = params->workers > 1 ? params->workers : 1;
+  if ( workers.count > training_points )
+    workers.count = training_points;
+  workers.replicas = gnn_lstm_calloc(workers.count, sizeof(gnn_lstm_trainer_t));
+  for ( w = 0; w < workers.count; ++w )
   {
-    cache_layers[i] = e_calloc(params->mini_batch_size + 1, sizeof(gnn_lstm_values_cache_t*));
-
-    p = 0;
-    while (p < params->mini_batch_size + 1)
-    {
-      cache_layers[i][p] = lstm_cache_container_init(
-        model_layers[i]->X, model_layers[i]->N, model_layers[i]->Y);
-      if ( cache_layers[i][p] == NULL )
-        lstm_init_fail("Failed to allocate memory for the caches\n");
-      ++p;
-    }
-
-    ++i;
+    lo = (ullong) training_points * w / workers.count;
+    hi = (ullong) training_points * (w + 1) / workers.count;
+    gnn_lstm_trainer_init(&workers.replicas[w], model_layers, params, layers,
+                          hi - lo, X_train + lo, Y_train + lo, M_layers, R_layers);
   }
 
-  gradient_layers = e_calloc(layers, sizeof(gnn_lstm_t*) );
-
-  gradient_layers_entry = e_calloc(layers, sizeof(gnn_lstm_t*) );
-
-  d_next_layers = e_calloc(layers, sizeof(gnn_lstm_values_next_cache_t *));
-
-  if ( params->optimizer == OPTIMIZE_ADAM )
+  if ( workers.count > 1 )
   {
-    M_layers = e_calloc(layers, sizeof(gnn_lstm_t*) );
-    R_layers = e_calloc(layers, sizeof(gnn_lstm_t*) );
-
+    worker_jobs = gnn_lstm_calloc(workers.count, sizeof(gnn_lstm_worker_job_t));
+    gnn_lstm_workers_start(&workers, worker_jobs);
   }
-
-  i = 0;
-  while (i < layers)
+  else if ( params->pipeline && layers > 1 )
   {
-    gradient_layers[i] = gnn_lstm_new(model_layers[i]->X,
-                                      model_layers[i]->N,
-                                      model_layers[i]->Y,
-                                      1,
-                                      params);
-    gradient_layers_entry[i] = gnn_lstm_new(model_layers[i]->X,
-                                            model_layers[i]->N,
-                                            model_layers[i]->Y,
-                                            1,
-                                            params);
-
-    lstm_values_next_cache_init(&d_next_layers[i],
-      model_layers[i]->N, model_layers[i]->X);
-
-    if ( params->optimizer == OPTIMIZE_ADAM )
-    {
-      M_layers[i] = gnn_lstm_new(model_layers[i]->X,
-                                 model_layers[i]->N,
-                                 model_layers[i]->Y,
-                                 1,
-                                 params);
-      R_layers[i] = gnn_lstm_new(model_layers[i]->X,
-                                 model_layers[i]->N,
-                                 model_layers[i]->Y,
-                                 1,
-                                 params);
-    }
-
-    ++i;
+    layer_jobs = gnn_lstm_calloc(layers, sizeof(gnn_lstm_layer_job_t));
+    gnn_lstm_trainer_start(&workers.replicas[0], layer_jobs);
   }
 
   /*!
   ** 开始训练
   */
-  i = 0; b = 0;
   while ( n < iterations )
   {
 
     if ( epochs && epoch >= epochs ) break;
 
-    b = i;
-
-    loss_tmp = 0.0;
-
-    q = 0;
-
-    while ( q < layers )
-    {
-      if ( stateful ) {
-        if ( q == 0 )
-          lstm_cache_container_set_start(cache_layers[q][0],  model_layers[q]->N);
-        else
-          lstm_next_state_copy(stateful_d_next[q], cache_layers[q][0], model_layers[q]->N, 0);
-      } else {
-        lstm_cache_container_set_start(cache_layers[q][0], model_layers[q]->N);
-      }
-      ++q;
-    }
-
-    unsigned int check = i % training_points;
-
-    trailing = params->mini_batch_size;
-
-    if ( i + params->mini_batch_size >= training_points )
-    {
-      trailing = training_points - i;
-    }
+    for ( w = 0; w < workers.count; ++w )
+      gnn_lstm_trainer_begin(&workers.replicas[w], n);
 
-    q = 0;
-
-    while ( q < trailing )
-    {
-      e1 = q;     // 当前这个
-      e2 = q + 1; // 下一个
-
-      e3 = i % training_points;
-
-      tmp_count = 0;
-      while ( tmp_count < model_layers[0]->Y )
-      {
-        first_layer_input[tmp_count] = 0.0;
-        ++tmp_count;
-      }
-
-      first_layer_input[X_train[e3]] = 1.0;
-
-      /* Layer numbering starts at the output point of the net */
-      p = layers - 1;
-      gnn_lstm_forward_propagate(model_layers[p],
-                                 first_layer_input,
-                                 cache_layers[p][e1],
-                                 cache_layers[p][e2],
-                                 p == 0);
-
-      if ( p > 0 )
-      {
-        --p;
-        while ( p <= layers - 1 )
-        {
-          gnn_lstm_forward_propagate(model_layers[p],
-                                     cache_layers[p+1][e2]->probs,
-                                     cache_layers[p][e1],
-                                     cache_layers[p][e2],
-                                     p == 0);
-          --p;
-        }
-        p = 0;
-      }
-
-      loss_tmp += gnn_lstm_cross_entropy(cache_layers[p][e2]->probs, Y_train[e3]);
-      ++i; ++q;
-    }
+    gnn_lstm_workers_step(&workers);
 
-    loss_tmp /= (q+1);
+    loss_tmp = 0.0;
+    for ( w = 0; w < workers.count; ++w )
+      loss_tmp += workers.replicas[w].loss / (workers.replicas[w].trailing + 1);
+    loss_tmp /= workers.count;
 
     if ( loss < 0 )
       loss = loss_tmp;
@@ -602,116 +1670,6 @@ gnn_lstm_train(gnn_lstm_t**        model_layers,
       record_iteration = n;
     }
 
-    if ( stateful ) {
-      p = 0;
-      while ( p < layers ) {
-        lstm_next_state_copy(stateful_d_next[p], cache_layers[p][e2], model_layers[p]->N, 1);
-        ++p;
-      }
-    }
-
-    p = 0;
-    while ( p < layers ) {
-      lstm_zero_the_model(gradient_layers[p]);
-      lstm_zero_d_next(d_next_layers[p], model_layers[p]->X, model_layers[p]->N);
-      ++p;
-    }
-
-    while ( q > 0 ) {
-      e1 = q;
-      e2 = q - 1;
-
-      e3 = ( training_points + i - 1 ) % training_points;
-
-      p = 0;
-      while ( p < layers ) {
-        lstm_zero_the_model(gradient_layers_entry[p]);
-        ++p;
-      }
-
-      p = 0;
-      lstm_backward_propagate(model_layers[p],
-        cache_layers[p][e1]->probs,
-        Y_train[e3],
-        d_next_layers[p],
-        cache_layers[p][e1],
-        gradient_layers_entry[0],
-        d_next_layers[p]);
-
-      if ( p < layers ) {
-        ++p;
-        while ( p < layers ) {
-          lstm_backward_propagate(model_layers[p],
-            d_next_layers[p-1]->dldY_pass,
-            -1,
-            d_next_layers[p],
-            cache_layers[p][e1],
-            gradient_layers_entry[p],
-            d_next_layers[p]);
-          ++p;
-        }
-      }
-
-      p = 0;
-
-      while ( p < layers ) {
-        sum_gradients(gradient_layers[p], gradient_layers_entry[p]);
-        ++p;
-      }
-
-      i--; q--;
-    }
-
-    assert(check == e3);
-
-    p = 0;
-    while ( p < layers ) {
-
-      if ( params->gradient_clip )
-        gradients_clip(gradient_layers[p], params->gradient_clip_limit);
-
-      if ( params->gradient_fit )
-        gradients_fit(gradient_layers[p], params->gradient_clip_limit);
-
-      ++p;
-    }
-
-    p = 0;
-
-    /*!
-    ** 梯度下降优化
-    */
-    switch ( params->optimizer ) {
-    case OPTIMIZE_ADAM:
-      while ( p < layers ) {
-        gradients_adam_optimizer(
-          model_layers[p],
-          gradient_layers[p],
-          M_layers[p],
-          R_layers[p],
-          n);
-        ++p;
-      }
-      break;
-    case OPTIMIZE_GRADIENT_DESCENT:
-      while ( p < layers ) {
-        gradients_decend(model_layers[p], gradient_layers[p]);
-        ++p;
-      }
-      break;
-    default:
-      fprintf( stderr,
-        "Failed to update gradients, no acceptible optimization algorithm provided.\n\
-        lstm_model_parameters_t has a field called 'optimizer'. Set this value to:\n\
-        %d: Adam gradients optimizer algorithm\n\
-        %d: Gradients descent algorithm.\n",
-        OPTIMIZE_ADAM,
-        OPTIMIZE_GRADIENT_DESCENT
-      );
-      exit(1);
-      break;
-    }
-
     if ( print_progress && !( n % print_progress_iterations ) ) {
 
       memset(time_buffer, '\0', sizeof time_buffer);
@@ -721,48 +1679,18 @@ gnn_lstm_train(gnn_lstm_t**        model_layers,
       printf("%s Iteration: %lu (epoch: %lu), Loss: %lf, record: %lf (iteration: %d), LR: %lf\n",
         time_buffer, n, epoch, loss, record_keeper, record_iteration, params->learning_rate);
 
-      if ( print_progress_sample_output ) {
-        printf("=====================================================\n");
-        lstm_output_string_layers(model_layers, char_index_mapping, X_train[b],
-          print_progress_number_of_chars, layers);
-        printf("\n=====================================================\n");
-      }
-
-      if ( print_progress_to_file ) {
-        FILE * fp_progress_output = fopen(print_progress_to_file_name,
-          print_progress_to_file_arg);
-        if ( fp_progress_output != NULL ) {
-          fprintf(fp_progress_output, "%s====== Iteration: %lu, loss: %.5lf ======\n", n==0 ? "" : "\n", n, loss);
-          lstm_output_string_layers_to_file(fp_progress_output, model_layers, char_index_mapping, X_train[b], print_progress_number_of_chars, layers);
-          fclose(fp_progress_output);
-        }
-      }
-
       // Flushing stdout
       fflush(stdout);
     }
 
     if ( store_progress_every_x_iterations && !(n % store_progress_every_x_iterations ))
-      lstm_store_progress(store_progress_file_name, n, loss);
-
-    if ( store_network_every && !(n % store_network_every) ) {
-      lstm_store(
-        params->store_network_name_raw,
-        char_index_mapping,
-        model_layers,
-        layers);
-      lstm_store_net_layers_as_json(model_layers, params->store_network_name_json,
-        params->store_char_indx_map_name, char_index_mapping, layers);
-    }
+      gnn_lstm_store_progress(store_progress_file_name, n, loss);
 
-    if ( b + params->mini_batch_size >= training_points )
+    // an epoch is a pass of the first replica over its slice
+    if ( gnn_lstm_trainer_end(&workers.replicas[0]) )
       epoch++;
-
-    i = (b + params->mini_batch_size) % training_points;
-
-    if ( i < params->mini_batch_size ) {
-      i = 0;
-    }
+    for ( w = 1; w < workers.count; ++w )
+      gnn_lstm_trainer_end(&workers.replicas[w]);
 
     if ( decrease_lr ) {
       params->learning_rate = initial_learning_rate / ( 1.0 + n / params->learning_rate_decrease );
@@ -778,134 +1706,181 @@ gnn_lstm_train(gnn_lstm_t**        model_layers,
   /*!
   ** 释放资源
   */
-  p = 0;
-  while ( p < layers ) {
-    lstm_values_next_cache_free(d_next_layers[p]);
-
-    i = 0;
-    while ( i < params->mini_batch_size ) {
-      lstm_cache_container_free(cache_layers[p][i]);
-      lstm_cache_container_free(cache_layers[p][i]);
-      ++i;
-    }
-
-    if ( params->optimizer == OPTIMIZE_ADAM ) {
-      lstm_free_model(M_layers[p]);
-      lstm_free_model(R_layers[p]);
-    }
+  if ( workers.threads != NULL )
+    gnn_lstm_workers_stop(&workers);
+  if ( workers.replicas[0].threads != NULL )
+    gnn_lstm_trainer_stop(&workers.replicas[0]);
 
-    lstm_free_model(gradient_layers_entry[p]);
-    lstm_free_model(gradient_layers[p]);
+  for ( w = 0; w < workers.count; ++w )
+    gnn_lstm_trainer_release(&workers.replicas[w]);
 
-    ++p;
+  for ( p = 0; p < layers; ++p ) {
+    gnn_lstm_grad_free(M_layers[p]);
+    gnn_lstm_grad_free(R_layers == NULL ? NULL : R_layers[p]);
   }
 
-  if ( stateful && stateful_d_next != NULL ) {
-    i = 0;
-    while ( i < layers ) {
-      free(stateful_d_next[i]);
-      ++i;
-    }
-    free(stateful_d_next);
-  }
-
-
-  free(cache_layers);
-  free(gradient_layers);
-  if ( M_layers != NULL )
-    free(M_layers);
-  if ( R_layers != NULL )
-    free(R_layers);
-#ifdef WINDOWS
-  free(first_layer_input);
-#endif
+  free(workers.replicas);
+  free(worker_jobs);
+  free(layer_jobs);
+  free(M_layers);
+  free(R_layers);
 }
 
 /*!
 ** Y = AX + b
 */
 void
-gnn_lstm_full_forward(double*    Y,
-                      double*    A,
-                      double*    X,
-                      double*    b,
-                      int        R,
-                      int        C)
-{
-  int i = 0, n = 0;
+gnn_lstm_full_forward(float*    Y,
+                      float*    A,
+                      float*    X,
+                      float*    b,
+                      int       R,
+                      int       C)
+{
+  int i = 0;
   while (i < R)
   {
-    Y[i] = b[i];
-    n = 0;
-    while (n < C)
-    {
-      Y[i] += A[i * C + n] * X[n];
-      ++n;
-    }
+    Y[i] = b[i] + gnn_vec_dot(A + (size_t) i * C, X, C);
     ++i;
   }
 }
 
+void
+gnn_lstm_batch_forward(float*         Y,
+                       uint           ldy,
+                       float const*   A,
+                       uint           lda,
+                       float const*   X,
+                       uint           ldx,
+                       float const*   b,
+                       int            R,
+                       int            C,
+                       uint           count)
+{
+  float dots[4];
+  uint k;
+  int i = 0;
+
+  for (; i + 4 <= R; i += 4)
+    for (k = 0; k < count; k++)
+    {
+      gnn_vec_dot4(dots, X + (size_t) k * ldx, A + (size_t) i * lda, lda, C);
+      Y[(size_t) k * ldy + i] = b[i] + dots[0];
+      Y[(size_t) k * ldy + i + 1] = b[i + 1] + dots[1];
+      Y[(size_t) k * ldy + i + 2] = b[i + 2] + dots[2];
+      Y[(size_t) k * ldy + i + 3] = b[i + 3] + dots[3];
+    }
+  for (; i < R; i++)
+    for (k = 0; k < count; k++)
+      Y[(size_t) k * ldy + i] = b[i] + gnn_vec_dot(A + (size_t) i * lda, X + (size_t) k * ldx, C);
+}
+
+void
+gnn_lstm_gather_forward(float* Y, float const* A, uint lda, uint column, int R)
+{
+  int i;
+  for (i = 0; i < R; i++)
+    Y[i] += A[(size_t) i * lda + column];
+}
+
 /*!
-** Y = AX + b
+** Y = AX + b, the gradients of A and b are added to dldA and dldb, so the
+** timesteps of a minibatch accumulate in place.
 */
 void
-gnn_lstm_full_backward(double*   dldY,
-                       double*   A,
-                       double*   X,
-                       double*   dldA,
-                       double*   dldX,
-                       double*   dldb,
-                       int       R,
-                       int       C)
-{
-  int i = 0, n = 0;
-
-  // computing dldA
-  while ( i < R ) {
-    n = 0;
-    while ( n < C ) {
-      dldA[i * C + n] = dldY[i] * X[n];
-      ++n;
-    }
-    ++i;
-  }
+gnn_lstm_full_backward(float*   dldY,
+                       float*   A,
+                       float*   X,
+                       float*   dldA,
+                       float*   dldX,
+                       float*   dldb,
+                       int      R,
+                       int      C)
+{
+  int i = 0;
 
-  // computing dldb (easy peasy)
-  i = 0;
+  memset(dldX, 0, C * sizeof(float));
   while ( i < R )
   {
-    dldb[i] = dldY[i];
+    // computing dldA and dldX row by row
+    gnn_vec_axpy(dldA + (size_t) i * C, dldY[i], X, C);
+    gnn_vec_axpy(dldX, dldY[i], A + (size_t) i * C, C);
+    dldb[i] += dldY[i];
     ++i;
   }
+}
 
-  // computing dldX
-  i = 0, n = 0;
-  while ( i < C )
-  {
-    n = 0;
-
-    dldX[i] = 0.0;
-    while ( n < R ) {
-      dldX[i] += A[n * C + i] * dldY[n];
-      ++n;
-    }
+void
+gnn_lstm_gather_backward(float*   dldY,
+                         float*   A,
+                         uint     lda,
+                         float*   X,
+                         uint     column,
+                         float*   dldA,
+                         float*   dldX,
+                         float*   dldb,
+                         int      R,
+                         int      C)
+{
+  int i = 0;
 
+  memset(dldX, 0, C * sizeof(float));
+  while ( i < R )
+  {
+    // the one hot column gets dldY alone, the columns of X as in gnn_lstm_full_backward
+    gnn_vec_axpy(dldA + (size_t) i * lda, dldY[i], X, C);
+    gnn_vec_axpy(dldX, dldY[i], A + (size_t) i * lda, C);
+    dldA[(size_t) i * lda + column] += dldY[i];
+    dldb[i] += dldY[i];
     ++i;
   }
 }
 
 double
-gnn_lstm_cross_entropy(double* probabilities, int correct)
+gnn_lstm_cross_entropy(float* probabilities, int correct)
 {
   return -log(probabilities[correct]);
 }
 
+void
+gnn_lstm_huffman_forward(float* P, float* Y, gnn_w2v_vocab_t const* vocab)
+{
+  gnn_w2v_word_t const* word;
+  llong w;
+  float q;
+  int d, node;
+
+  /*!
+  ** one exponential per inner node, Y keeps the sigmoid of the smaller
+  ** branch, sigmoid(-|Y|), with the sign of Y, so both branches are exact
+  ** even far in the tails
+  */
+  for (w = 0; w + 1 < vocab->size; w++)
+  {
+    q = expf(-fabsf(Y[w]));
+    q = q / (1.0f + q);
+    Y[w] = signbit(Y[w]) ? -q : q;
+  }
+
+  for (w = 0; w < vocab->size; w++)
+  {
+    word = &vocab->words[w];
+    P[w] = 1;
+    for (d = 0; d < word->codelen; d++)
+    {
+      node = word->point[d];
+      q = fabsf(Y[node]);
+      // code 0 takes sigmoid(Y), which is the larger branch if Y >= 0
+      P[w] *= (word->code[d] != 0) == !signbit(Y[node]) ? q : 1 - q;
+    }
+  }
+}
+
 // Dealing with softmax layer, forward and backward
 //                &P,   Y,    features
 void
-gnn_lstm_softmax_forward(double* P,
-                         double* Y,
+gnn_lstm_softmax_forward(float* P,
+                         float* Y,
                          int F,
                          double temperature)
 {
@@ -943,9 +1918,9 @@ gnn_lstm_softmax_forward(double* P,
 }
 //                    P,    c,  &dldh, rows
 void
-gnn_lstm_softmax_backward(double* P,
+gnn_lstm_softmax_backward(float* P,
                           int c,
-                          double* dldh,
+                          float* dldh,
                           int R)
 {
   int r = 0;
@@ -961,7 +1936,7 @@ gnn_lstm_softmax_backward(double* P,
 /*!
 ** Y = sigmoid(X)
 */
-void  gnn_lstm_sigmoid_forward(double* Y, double* X, int L)
+void  gnn_lstm_sigmoid_forward(float* Y, float* X, int L)
 {
   int l = 0;
 
@@ -977,7 +1952,7 @@ void  gnn_lstm_sigmoid_forward(double* Y, double* X, int L)
 ** Y = sigmoid(X)
 */
 void
-gnn_lstm_sigmoid_backward(double* dldY, double* Y, double* dldX, int L)
+gnn_lstm_sigmoid_backward(float* dldY, float* Y, float* dldX, int L)
 {
   int l = 0;
 
@@ -991,7 +1966,7 @@ gnn_lstm_sigmoid_backward(double* dldY, double* Y, double* dldX, int L)
 /*!
 ** Y = tanh(X)
 */
-void gnn_lstm_tanh_forward(double* Y, double* X, int L)
+void gnn_lstm_tanh_forward(float* Y, float* X, int L)
 {
   int l = 0;
   while ( l < L ) {
@@ -1003,7 +1978,7 @@ void gnn_lstm_tanh_forward(double* Y, double* X, int L)
 /*!
 ** Y = tanh(X)
 */
-void  gnn_lstm_tanh_backward(double* dldY, double* Y, double* dldX, int L)
+void  gnn_lstm_tanh_backward(float* dldY, float* Y, float* dldX, int L)
 {
   int l = 0;
   while ( l < L )
@@ -1012,4 +1987,3 @@ void  gnn_lstm_tanh_backward(double* dldY, double* Y, double* dldX, int L)
     ++l;
   }
 }
-
@@ -78,14 +78,10 @@ gnn_mlp_threshold(float a)
   return a > 0;
 }
 
-static void
-gnn_mlp_randomize(gnn_mlp_t* mlp) {
-  int i;
-  for (i = 0; i < mlp->total_weights; ++i) {
-    float r = GNN_MLP_RANDOM();
-    /* Sets weights from -0.5 to 0.5. */
-    mlp->weights[i] = r - 0.5;
-  }
+void
+gnn_mlp_randomize(gnn_mlp_t* mlp, gnn_rng_t* rng) {
+  /* Sets weights from -0.5 to 0.5. */
+  gnn_vec_fill_uniform(mlp->weights, mlp->total_weights, -0.5f, 0.5f, rng, 1);
 }
 
 gnn_mlp_t*
@@ -128,7 +124,9 @@ gnn_mlp_new(int input_number,
   ret->outputs = ret->weights + ret->total_weights;
   ret->biases = ret->outputs + ret->total_neurons;
 
-  gnn_mlp_randomize(ret);
+  gnn_rng_t rng;
+  gnn_rng_init(&rng, GANN_RNG_SEED, 0);
+  gnn_mlp_randomize(ret, &rng);
 
   ret->activation_hidden = gnn_mlp_sigmoid_lookup;
   ret->activation_output = gnn_mlp_sigmoid_lookup;
@@ -0,0 +1,228 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gann-w2v-analogy.h"
+
+/*!
+** the neighbours of one question, enough to skip the three question words.
+*/
+#define GANN_W2V_ANALOGY_K                     4
+
+typedef struct gnn_w2v_analogy_question_s
+{
+  uint        section;
+
+  llong       words[4];
+}
+gnn_w2v_analogy_question_t;
+
+static double
+gnn_w2v_analogy_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+gnn_w2v_analogy_t*
+gnn_w2v_analogy_evaluate(gnn_w2v_store_t const*   store,
+                         gnn_w2v_knn_t const*     knn,
+                         const char*              path,
+                         uint                     thread_num)
+{
+  gnn_w2v_analogy_t* ret;
+  gnn_w2v_analogy_question_t* questions = NULL;
+  void* grown;
+  gnn_w2v_neighbor_t* results;
+  llong question_num = 0, question_size = 0, q;
+  char line[4096];
+  char* words[4];
+  char* saveptr;
+  char* token;
+  float* queries;
+  double start;
+  uint dim = knn->dim_num, i, n;
+  FILE* fin;
+
+  // the neighbor ids are store indexes
+  if (knn->size != store->vocab_size)
+  {
+    fprintf(stderr, "error: the searcher has %lld vectors but the store has %lld words.\n",
+            knn->size, store->vocab_size);
+    return NULL;
+  }
+
+  fin = fopen(path, "rb");
+  if (fin == NULL)
+  {
+    fprintf(stderr, "error: analogy file '%s' not found!\n", path);
+    return NULL;
+  }
+
+  ret = (gnn_w2v_analogy_t*) calloc(1, sizeof(gnn_w2v_analogy_t));
+  if (ret == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for analogy in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  while (fgets(line, sizeof(line), fin) != NULL)
+  {
+    if (line[0] == ':')
+    {
+      gnn_w2v_analogy_section_t* section;
+      grown = realloc(ret->sections, (ret->section_num + 1) * sizeof(gnn_w2v_analogy_section_t));
+      if (grown == NULL)
+      {
+        fprintf(stderr, "error: failed to allocate memories for analogy sections in %d of %s.\n", __LINE__, __FILE__);
+        exit(1);
+      }
+      ret->sections = (gnn_w2v_analogy_section_t*) grown;
+      section = &ret->sections[ret->section_num++];
+      memset(section, 0, sizeof(gnn_w2v_analogy_section_t));
+      token = strtok_r(line + 1, " \t\r\n", &saveptr);
+      strncpy(section->name, token != NULL ? token : "", GANN_W2V_MAX_STRING - 1);
+      continue;
+    }
+
+    n = 0;
+    for (token = strtok_r(line, " \t\r\n", &saveptr); token != NULL && n < 4;
+         token = strtok_r(NULL, " \t\r\n", &saveptr))
+      words[n++] = token;
+    if (n < 4) continue;
+
+    if (ret->section_num == 0)
+    {
+      ret->sections = (gnn_w2v_analogy_section_t*) calloc(1, sizeof(gnn_w2v_analogy_section_t));
+      if (ret->sections == NULL)
+      {
+        fprintf(stderr, "error: failed to allocate memories for analogy sections in %d of %s.\n", __LINE__, __FILE__);
+        exit(1);
+      }
+      ret->section_num = 1;
+    }
+    ret->sections[ret->section_num - 1].total++;
+    ret->total++;
+
+    if (question_num == question_size)
+    {
+      question_size = question_size ? question_size * 2 : 1024;
+      grown = realloc(questions, question_size * sizeof(gnn_w2v_analogy_question_t));
+      if (grown == NULL)
+      {
+        fprintf(stderr, "error: failed to allocate memories for analogy questions in %d of %s.\n", __LINE__, __FILE__);
+        exit(1);
+      }
+      questions = (gnn_w2v_analogy_question_t*) grown;
+    }
+    questions[question_num].section = ret->section_num - 1;
+    for (i = 0; i < 4; i++)
+      questions[question_num].words[i] = gnn_w2v_store_index(store, words[i]);
+    if (questions[question_num].words[0] < 0 || questions[question_num].words[1] < 0 ||
+        questions[question_num].words[2] < 0 || questions[question_num].words[3] < 0)
+      continue;
+    ret->sections[ret->section_num - 1].seen++;
+    ret->seen++;
+    question_num++;
+  }
+  fclose(fin);
+
+  // the batched search counts queries in uint
+  if (question_num > (llong) (uint) -1)
+  {
+    fprintf(stderr, "error: analogy file '%s' has %lld questions, more than one batch.\n", path, question_num);
+    free(questions);
+    gnn_w2v_analogy_free(ret);
+    return NULL;
+  }
+
+  if (question_num == 0)
+  {
+    free(questions);
+    return ret;
+  }
+
+  /*!
+  ** the query matrix of b - a + c over normalized vectors
+  */
+  start = gnn_w2v_analogy_now();
+  queries = (float*) malloc((size_t) question_num * dim * sizeof(float));
+  results = (gnn_w2v_neighbor_t*) malloc((size_t) question_num * GANN_W2V_ANALOGY_K * sizeof(gnn_w2v_neighbor_t));
+  if (queries == NULL || results == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for analogy queries in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  for (q = 0; q < question_num; q++)
+  {
+    float* query = queries + q * dim;
+    gnn_vec_copy(query, knn->vectors + questions[q].words[1] * knn->stride, dim);
+    gnn_vec_subtract(query, knn->vectors + questions[q].words[0] * knn->stride, dim);
+    gnn_vec_add(query, knn->vectors + questions[q].words[2] * knn->stride, dim);
+  }
+
+  gnn_w2v_knn_search_batch(knn, queries, (uint) question_num, GANN_W2V_ANALOGY_K, results, thread_num);
+
+  for (q = 0; q < question_num; q++)
+  {
+    gnn_w2v_neighbor_t* found = results + q * GANN_W2V_ANALOGY_K;
+    for (i = 0; i < GANN_W2V_ANALOGY_K; i++)
+    {
+      if (found[i].id == questions[q].words[0] || found[i].id == questions[q].words[1] ||
+          found[i].id == questions[q].words[2])
+        continue;
+      if (found[i].id == questions[q].words[3])
+      {
+        ret->sections[questions[q].section].correct++;
+        ret->correct++;
+      }
+      break;
+    }
+  }
+  ret->seconds = gnn_w2v_analogy_now() - start;
+  ret->queries_per_second = ret->seconds > 0 ? question_num / ret->seconds : 0;
+
+  free(queries);
+  free(results);
+  free(questions);
+  return ret;
+}
+
+void
+gnn_w2v_analogy_print(gnn_w2v_analogy_t const* analogy, FILE* out)
+{
+  uint i;
+  for (i = 0; i < analogy->section_num; i++)
+  {
+    gnn_w2v_analogy_section_t const* section = &analogy->sections[i];
+    fprintf(out, "%-20s accuracy: %6.2f %%  (%lld / %lld, %lld questions)\n",
+            section->name,
+            section->seen ? section->correct * 100.0 / section->seen : 0.0,
+            section->correct, section->seen, section->total);
+  }
+  fprintf(out, "%-20s accuracy: %6.2f %%  (%lld / %lld, %lld questions)\n",
+          "total",
+          analogy->seen ? analogy->correct * 100.0 / analogy->seen : 0.0,
+          analogy->correct, analogy->seen, analogy->total);
+  fprintf(out, "questions seen: %.2f %%, %.3f seconds, %.0f queries/second\n",
+          analogy->total ? analogy->seen * 100.0 / analogy->total : 0.0,
+          analogy->seconds, analogy->queries_per_second);
+}
+
+void
+gnn_w2v_analogy_free(gnn_w2v_analogy_t* analogy)
+{
+  if (analogy == NULL) return;
+  free(analogy->sections);
+  free(analogy);
+}
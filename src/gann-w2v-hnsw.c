@@ -0,0 +1,875 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gann-w2v-hnsw.h"
+
+#define GANN_W2V_HNSW_SEED                     0x9E3779B97F4A7C15ULL
+#define GANN_W2V_HNSW_ALIGN                    64
+
+/*!
+** the binary heap ordered by the similarity field, the smallest on top.
+*/
+typedef struct gnn_w2v_hnsw_heap_s
+{
+  gnn_w2v_neighbor_t*   data;
+
+  uint                  size;
+
+  uint                  capacity;
+}
+gnn_w2v_hnsw_heap_t;
+
+/*!
+** the scratch memories reused by all searches of one thread, a building
+** thread owns its own and the searching threads use a thread-local one.
+*/
+typedef struct gnn_w2v_hnsw_scratch_s
+{
+  uint*                 visited;
+
+  llong                 visited_size;
+
+  uint                  tag;
+
+  gnn_w2v_hnsw_heap_t   results;
+
+  gnn_w2v_hnsw_heap_t   candidates;
+
+  float*                query;
+
+  uint                  query_size;
+
+  uint*                 ids;
+
+  uint                  ids_size;
+}
+gnn_w2v_hnsw_scratch_t;
+
+typedef struct gnn_w2v_hnsw_build_s
+{
+  gnn_w2v_hnsw_t*       hnsw;
+
+  llong                 next;
+}
+gnn_w2v_hnsw_build_t;
+
+static __thread gnn_w2v_hnsw_scratch_t search_scratch;
+
+static void
+gnn_w2v_hnsw_heap_push(gnn_w2v_hnsw_heap_t* heap, llong id, float key)
+{
+  uint i;
+  if (heap->size == heap->capacity)
+  {
+    uint capacity = heap->capacity ? heap->capacity * 2 : 256;
+    void* grown = realloc(heap->data, capacity * sizeof(gnn_w2v_neighbor_t));
+    if (grown == NULL)
+    {
+      fprintf(stderr, "error: failed to allocate memories for hnsw heap in %d of %s.\n", __LINE__, __FILE__);
+      exit(1);
+    }
+    heap->data = (gnn_w2v_neighbor_t*) grown;
+    heap->capacity = capacity;
+  }
+  i = heap->size++;
+  while (i > 0 && heap->data[(i - 1) / 2].similarity > key)
+  {
+    heap->data[i] = heap->data[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap->data[i].id = id;
+  heap->data[i].similarity = key;
+}
+
+static gnn_w2v_neighbor_t
+gnn_w2v_hnsw_heap_pop(gnn_w2v_hnsw_heap_t* heap)
+{
+  gnn_w2v_neighbor_t ret = heap->data[0];
+  gnn_w2v_neighbor_t last = heap->data[--heap->size];
+  uint i = 0, child;
+  while ((child = i * 2 + 1) < heap->size)
+  {
+    if (child + 1 < heap->size && heap->data[child + 1].similarity < heap->data[child].similarity)
+      child++;
+    if (heap->data[child].similarity >= last.similarity)
+      break;
+    heap->data[i] = heap->data[child];
+    i = child;
+  }
+  if (heap->size > 0)
+    heap->data[i] = last;
+  return ret;
+}
+
+static void
+gnn_w2v_hnsw_scratch_free(gnn_w2v_hnsw_scratch_t* scratch)
+{
+  free(scratch->visited);
+  free(scratch->results.data);
+  free(scratch->candidates.data);
+  free(scratch->query);
+  free(scratch->ids);
+  memset(scratch, 0, sizeof(gnn_w2v_hnsw_scratch_t));
+}
+
+static uint*
+gnn_w2v_hnsw_visited(gnn_w2v_hnsw_scratch_t* scratch, llong size)
+{
+  if (scratch->visited_size < size)
+  {
+    free(scratch->visited);
+    scratch->visited = (uint*) calloc(size, sizeof(uint));
+    if (scratch->visited == NULL)
+    {
+      fprintf(stderr, "error: failed to allocate memories for hnsw visited in %d of %s.\n", __LINE__, __FILE__);
+      exit(1);
+    }
+    scratch->visited_size = size;
+    scratch->tag = 0;
+  }
+  if (++scratch->tag == 0)
+  {
+    memset(scratch->visited, 0, scratch->visited_size * sizeof(uint));
+    scratch->tag = 1;
+  }
+  return scratch->visited;
+}
+
+static uint*
+gnn_w2v_hnsw_ids(gnn_w2v_hnsw_scratch_t* scratch, uint size)
+{
+  void* grown;
+  if (scratch->ids_size < size)
+  {
+    grown = realloc(scratch->ids, size * sizeof(uint));
+    if (grown == NULL)
+    {
+      fprintf(stderr, "error: failed to allocate memories for hnsw ids in %d of %s.\n", __LINE__, __FILE__);
+      exit(1);
+    }
+    scratch->ids = (uint*) grown;
+    scratch->ids_size = size;
+  }
+  return scratch->ids;
+}
+
+static inline const float*
+gnn_w2v_hnsw_vector(gnn_w2v_hnsw_t const* hnsw, llong id)
+{
+  return hnsw->vectors + id * hnsw->stride;
+}
+
+static inline uint*
+gnn_w2v_hnsw_links(gnn_w2v_hnsw_t const* hnsw, llong id, int level)
+{
+  if (level == 0)
+    return hnsw->links0 + id * (hnsw->M0 + 1);
+  return hnsw->upper_links + hnsw->upper_offsets[id] + (ullong) (level - 1) * (hnsw->M + 1);
+}
+
+/*!
+** copies the neighbours of node at level, the node lock is held only when
+** building.
+*/
+static uint
+gnn_w2v_hnsw_neighbors(gnn_w2v_hnsw_t const* hnsw, llong id, int level, uint* ids)
+{
+  uint* links;
+  uint count;
+  if (hnsw->locks != NULL) pthread_mutex_lock(&hnsw->locks[id]);
+  links = gnn_w2v_hnsw_links(hnsw, id, level);
+  count = links[0];
+  memcpy(ids, links + 1, count * sizeof(uint));
+  if (hnsw->locks != NULL) pthread_mutex_unlock(&hnsw->locks[id]);
+  return count;
+}
+
+/*!
+** walks greedily to the most similar node on one level.
+*/
+static llong
+gnn_w2v_hnsw_greedy(gnn_w2v_hnsw_t const*   hnsw,
+                    gnn_w2v_hnsw_scratch_t* scratch,
+                    const float*            query,
+                    llong                   current,
+                    float*                  similarity,
+                    int                     level)
+{
+  uint* ids = gnn_w2v_hnsw_ids(scratch, hnsw->M0 + 1);
+  int changed = 1;
+  uint i, count;
+  float sim;
+
+  while (changed)
+  {
+    changed = 0;
+    count = gnn_w2v_hnsw_neighbors(hnsw, current, level, ids);
+    for (i = 0; i < count; i++)
+    {
+      sim = gnn_vec_dot(query, gnn_w2v_hnsw_vector(hnsw, ids[i]), hnsw->stride);
+      if (sim > *similarity)
+      {
+        *similarity = sim;
+        current = ids[i];
+        changed = 1;
+      }
+    }
+  }
+  return current;
+}
+
+/*!
+** the beam search on one level, the ef best nodes are left in scratch->results.
+*/
+static void
+gnn_w2v_hnsw_search_layer(gnn_w2v_hnsw_t const*     hnsw,
+                          gnn_w2v_hnsw_scratch_t*   scratch,
+                          const float*              query,
+                          llong                     entry,
+                          float                     entry_similarity,
+                          uint                      ef,
+                          int                       level)
+{
+  gnn_w2v_hnsw_heap_t* results = &scratch->results;
+  gnn_w2v_hnsw_heap_t* candidates = &scratch->candidates;
+  uint* visited = gnn_w2v_hnsw_visited(scratch, hnsw->size);
+  uint* ids = gnn_w2v_hnsw_ids(scratch, hnsw->M0 + 1);
+  uint tag = scratch->tag;
+  gnn_w2v_neighbor_t c;
+  uint i, count;
+  float sim;
+
+  results->size = 0;
+  candidates->size = 0;
+  visited[entry] = tag;
+  gnn_w2v_hnsw_heap_push(results, entry, entry_similarity);
+  gnn_w2v_hnsw_heap_push(candidates, entry, -entry_similarity);
+
+  while (candidates->size > 0)
+  {
+    c = gnn_w2v_hnsw_heap_pop(candidates);
+    if (-c.similarity < results->data[0].similarity && results->size >= ef)
+      break;
+    count = gnn_w2v_hnsw_neighbors(hnsw, c.id, level, ids);
+    for (i = 0; i < count; i++)
+      __builtin_prefetch(gnn_w2v_hnsw_vector(hnsw, ids[i]));
+    for (i = 0; i < count; i++)
+    {
+      if (visited[ids[i]] == tag) continue;
+      visited[ids[i]] = tag;
+      sim = gnn_vec_dot(query, gnn_w2v_hnsw_vector(hnsw, ids[i]), hnsw->stride);
+      if (results->size < ef || sim > results->data[0].similarity)
+      {
+        gnn_w2v_hnsw_heap_push(candidates, ids[i], -sim);
+        gnn_w2v_hnsw_heap_push(results, ids[i], sim);
+        if (results->size > ef)
+          gnn_w2v_hnsw_heap_pop(results);
+      }
+    }
+  }
+}
+
+/*!
+** selects at most m diverse neighbours: a candidate is kept only if it is
+** more similar to the base than to any kept one.
+*/
+static uint
+gnn_w2v_hnsw_select(gnn_w2v_hnsw_t const*   hnsw,
+                    gnn_w2v_neighbor_t*     candidates,
+                    uint                    count,
+                    uint                    m,
+                    uint*                   selected)
+{
+  uint i, j, ret = 0;
+  int good;
+
+  gnn_w2v_neighbors_sort(candidates, count);
+  for (i = 0; i < count && ret < m; i++)
+  {
+    const float* v = gnn_w2v_hnsw_vector(hnsw, candidates[i].id);
+    good = 1;
+    for (j = 0; j < ret; j++)
+    {
+      if (gnn_vec_dot(v, gnn_w2v_hnsw_vector(hnsw, selected[j]), hnsw->stride) > candidates[i].similarity)
+      {
+        good = 0;
+        break;
+      }
+    }
+    if (good)
+      selected[ret++] = (uint) candidates[i].id;
+  }
+  return ret;
+}
+
+static void
+gnn_w2v_hnsw_connect(gnn_w2v_hnsw_t*        hnsw,
+                     llong                  id,
+                     int                    level,
+                     gnn_w2v_neighbor_t*    found,
+                     uint                   found_num)
+{
+  uint mmax = level == 0 ? hnsw->M0 : hnsw->M;
+  uint selected[mmax + 1];
+  gnn_w2v_neighbor_t candidates[mmax + 1];
+  uint count, i, j, n;
+  uint* links;
+
+  count = gnn_w2v_hnsw_select(hnsw, found, found_num, hnsw->M, selected);
+
+  pthread_mutex_lock(&hnsw->locks[id]);
+  links = gnn_w2v_hnsw_links(hnsw, id, level);
+  links[0] = count;
+  memcpy(links + 1, selected, count * sizeof(uint));
+  pthread_mutex_unlock(&hnsw->locks[id]);
+
+  for (i = 0; i < count; i++)
+  {
+    llong other = selected[i];
+    const float* v = gnn_w2v_hnsw_vector(hnsw, other);
+    uint pruned[mmax];
+
+    pthread_mutex_lock(&hnsw->locks[other]);
+    links = gnn_w2v_hnsw_links(hnsw, other, level);
+    if (links[0] < mmax)
+    {
+      links[++links[0]] = (uint) id;
+    }
+    else
+    {
+      n = links[0];
+      for (j = 0; j < n; j++)
+      {
+        candidates[j].id = links[j + 1];
+        candidates[j].similarity = gnn_vec_dot(v, gnn_w2v_hnsw_vector(hnsw, links[j + 1]), hnsw->stride);
+      }
+      candidates[n].id = id;
+      candidates[n].similarity = gnn_vec_dot(v, gnn_w2v_hnsw_vector(hnsw, id), hnsw->stride);
+      links[0] = gnn_w2v_hnsw_select(hnsw, candidates, n + 1, mmax, pruned);
+      memcpy(links + 1, pruned, links[0] * sizeof(uint));
+    }
+    pthread_mutex_unlock(&hnsw->locks[other]);
+  }
+}
+
+static void
+gnn_w2v_hnsw_insert(gnn_w2v_hnsw_t* hnsw, gnn_w2v_hnsw_scratch_t* scratch, llong id)
+{
+  const float* query = gnn_w2v_hnsw_vector(hnsw, id);
+  int level = (int) hnsw->levels[id];
+  int max_level, l;
+  llong current;
+  float sim;
+  uint i, found_num;
+  gnn_w2v_neighbor_t* found;
+
+  /*!
+  ** the global lock is held through the insertion only if the new node
+  ** becomes the entry point.
+  */
+  pthread_mutex_lock(&hnsw->global);
+  max_level = hnsw->max_level;
+  current = hnsw->entry_point;
+  if (level <= max_level)
+    pthread_mutex_unlock(&hnsw->global);
+
+  sim = gnn_vec_dot(query, gnn_w2v_hnsw_vector(hnsw, current), hnsw->stride);
+  for (l = max_level; l > level; l--)
+    current = gnn_w2v_hnsw_greedy(hnsw, scratch, query, current, &sim, l);
+
+  for (l = level < max_level ? level : max_level; l >= 0; l--)
+  {
+    gnn_w2v_hnsw_search_layer(hnsw, scratch, query, current, sim, hnsw->ef_construction, l);
+
+    found_num = 0;
+    found = scratch->results.data;
+    for (i = 0; i < scratch->results.size; i++)
+    {
+      if (found[i].id == id) continue;
+      found[found_num++] = found[i];
+    }
+    for (i = 0; i < found_num; i++)
+    {
+      if (found[i].similarity > sim || found[i].id == current)
+      {
+        sim = found[i].similarity;
+        current = found[i].id;
+      }
+    }
+    gnn_w2v_hnsw_connect(hnsw, id, l, found, found_num);
+  }
+
+  if (level > max_level)
+  {
+    hnsw->entry_point = id;
+    hnsw->max_level = level;
+    pthread_mutex_unlock(&hnsw->global);
+  }
+}
+
+static void*
+gnn_w2v_hnsw_build_run(void* data)
+{
+  gnn_w2v_hnsw_build_t* build = (gnn_w2v_hnsw_build_t*) data;
+  gnn_w2v_hnsw_scratch_t scratch;
+  llong id;
+
+  memset(&scratch, 0, sizeof(scratch));
+  while ((id = __sync_fetch_and_add(&build->next, 1)) < build->hnsw->size)
+    gnn_w2v_hnsw_insert(build->hnsw, &scratch, id);
+  gnn_w2v_hnsw_scratch_free(&scratch);
+  return NULL;
+}
+
+/*!
+** the level of a node only depends on its id, so the graph layout is the
+** same for any thread number.
+*/
+static uint
+gnn_w2v_hnsw_level(llong id, double mult)
+{
+  ullong x = GANN_W2V_HNSW_SEED ^ (ullong) id;
+  double u;
+  int level;
+
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  x = x ^ (x >> 31);
+  u = ((x >> 11) + 1) * (1.0 / 9007199254740993.0);
+  level = (int) (-log(u) * mult);
+  return level > GANN_W2V_HNSW_MAX_LEVEL ? GANN_W2V_HNSW_MAX_LEVEL : level;
+}
+
+gnn_w2v_hnsw_t*
+gnn_w2v_hnsw_new(const float*   vectors,
+                 llong          size,
+                 uint           dim_num,
+                 uint           stride,
+                 uint           M,
+                 uint           ef_construction,
+                 uint           thread_num)
+{
+  gnn_w2v_hnsw_t* ret = (gnn_w2v_hnsw_t*) calloc(1, sizeof(gnn_w2v_hnsw_t));
+  gnn_w2v_hnsw_build_t build;
+  pthread_t* threads;
+  double mult;
+  llong a;
+  uint t;
+
+  if (ret == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for hnsw in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  if (M < 2) M = 2;
+  ret->dim_num = dim_num;
+  ret->stride = (dim_num + 15) / 16 * 16;
+  ret->size = size;
+  ret->M = M;
+  ret->M0 = M * 2;
+  ret->ef_construction = ef_construction < M ? M : ef_construction;
+  ret->ef_search = GANN_W2V_HNSW_EF_SEARCH;
+  ret->max_level = 0;
+  ret->entry_point = 0;
+
+  if (posix_memalign((void **)&ret->vectors, 128, size * ret->stride * sizeof(float)) != 0)
+  {
+    fprintf(stderr, "error: failed to allocate memories for hnsw vectors in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  for (a = 0; a < size; a++)
+  {
+    float* row = ret->vectors + a * ret->stride;
+    memcpy(row, vectors + a * stride, dim_num * sizeof(float));
+    memset(row + dim_num, 0, (ret->stride - dim_num) * sizeof(float));
+    gnn_vec_normalize(row, dim_num);
+  }
+
+  mult = 1.0 / log((double) M);
+  ret->levels = (uint*) malloc(size * sizeof(uint));
+  ret->upper_offsets = (ullong*) malloc(size * sizeof(ullong));
+  if (ret->levels == NULL || ret->upper_offsets == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for hnsw levels in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  ret->upper_size = 0;
+  for (a = 0; a < size; a++)
+  {
+    ret->levels[a] = gnn_w2v_hnsw_level(a, mult);
+    ret->upper_offsets[a] = ret->upper_size;
+    ret->upper_size += (ullong) ret->levels[a] * (M + 1);
+  }
+  ret->links0 = (uint*) calloc((size_t) size * (ret->M0 + 1), sizeof(uint));
+  ret->upper_links = (uint*) calloc(ret->upper_size + 1, sizeof(uint));
+  ret->locks = (pthread_mutex_t*) malloc(size * sizeof(pthread_mutex_t));
+  if (ret->links0 == NULL || ret->upper_links == NULL || ret->locks == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for hnsw graph in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  for (a = 0; a < size; a++)
+    pthread_mutex_init(&ret->locks[a], NULL);
+  pthread_mutex_init(&ret->global, NULL);
+
+  if (size == 0)
+    return ret;
+
+  ret->max_level = (int) ret->levels[0];
+
+  if (thread_num == 0) thread_num = 1;
+  build.hnsw = ret;
+  build.next = 1;
+  threads = (pthread_t*) calloc(thread_num, sizeof(pthread_t));
+  if (threads == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for hnsw threads in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  for (t = 1; t < thread_num; t++)
+    pthread_create(&threads[t], NULL, gnn_w2v_hnsw_build_run, &build);
+  gnn_w2v_hnsw_build_run(&build);
+  for (t = 1; t < thread_num; t++)
+    pthread_join(threads[t], NULL);
+  free(threads);
+
+  /*!
+  ** the graph is read-only from now on
+  */
+  for (a = 0; a < size; a++)
+    pthread_mutex_destroy(&ret->locks[a]);
+  free(ret->locks);
+  ret->locks = NULL;
+  return ret;
+}
+
+gnn_w2v_hnsw_t*
+gnn_w2v_hnsw_from_w2v(gnn_w2v_t const*      w2v,
+                      uint                  M,
+                      uint                  ef_construction,
+                      uint                  thread_num)
+{
+  return gnn_w2v_hnsw_new(w2v->hidden_weights, w2v->vocab_size, w2v->dim_num, w2v->dim_num,
+                          M, ef_construction, thread_num);
+}
+
+gnn_w2v_hnsw_t*
+gnn_w2v_hnsw_from_store(gnn_w2v_store_t const*  store,
+                        uint                    M,
+                        uint                    ef_construction,
+                        uint                    thread_num)
+{
+  return gnn_w2v_hnsw_new(store->vectors, store->vocab_size, store->dim_num, store->stride,
+                          M, ef_construction, thread_num);
+}
+
+void
+gnn_w2v_hnsw_free(gnn_w2v_hnsw_t* hnsw)
+{
+  llong a;
+  if (hnsw == NULL) return;
+  if (hnsw->base != NULL)
+  {
+    munmap(hnsw->base, hnsw->length);
+    free(hnsw);
+    return;
+  }
+  if (hnsw->locks != NULL)
+  {
+    for (a = 0; a < hnsw->size; a++)
+      pthread_mutex_destroy(&hnsw->locks[a]);
+    free(hnsw->locks);
+  }
+  pthread_mutex_destroy(&hnsw->global);
+  free(hnsw->vectors);
+  free(hnsw->levels);
+  free(hnsw->links0);
+  free(hnsw->upper_offsets);
+  free(hnsw->upper_links);
+  free(hnsw);
+}
+
+static ullong
+gnn_w2v_hnsw_align(ullong offset, ullong alignment)
+{
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+static int
+gnn_w2v_hnsw_write(FILE* fout, const void* data, ullong offset, ullong length)
+{
+  static const char zeros[GANN_W2V_STORE_ALIGN] = {0};
+  ullong pos = ftell(fout);
+  while (pos < offset)
+  {
+    ullong n = offset - pos;
+    if (n > GANN_W2V_STORE_ALIGN) n = GANN_W2V_STORE_ALIGN;
+    if (fwrite(zeros, 1, n, fout) != n) return -1;
+    pos += n;
+  }
+  if (length > 0 && fwrite(data, 1, length, fout) != length) return -1;
+  return 0;
+}
+
+int
+gnn_w2v_hnsw_save(gnn_w2v_hnsw_t const* hnsw, const char* path)
+{
+  gnn_w2v_hnsw_header_t header;
+  FILE* fout;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GANN_W2V_HNSW_MAGIC, sizeof(GANN_W2V_HNSW_MAGIC));
+  header.version = GANN_W2V_HNSW_VERSION;
+  header.dim_num = hnsw->dim_num;
+  header.stride = hnsw->stride;
+  header.M = hnsw->M;
+  header.M0 = hnsw->M0;
+  header.ef_construction = hnsw->ef_construction;
+  header.ef_search = hnsw->ef_search;
+  header.max_level = hnsw->max_level;
+  header.size = hnsw->size;
+  header.entry_point = hnsw->entry_point;
+  header.upper_size = hnsw->upper_size;
+  header.vectors_offset = gnn_w2v_hnsw_align(sizeof(header), GANN_W2V_STORE_ALIGN);
+  header.levels_offset = gnn_w2v_hnsw_align(header.vectors_offset + hnsw->size * hnsw->stride * sizeof(float), GANN_W2V_HNSW_ALIGN);
+  header.links0_offset = gnn_w2v_hnsw_align(header.levels_offset + hnsw->size * sizeof(uint), GANN_W2V_HNSW_ALIGN);
+  header.upper_offsets_offset = gnn_w2v_hnsw_align(header.links0_offset + hnsw->size * (hnsw->M0 + 1) * sizeof(uint), GANN_W2V_HNSW_ALIGN);
+  header.upper_links_offset = gnn_w2v_hnsw_align(header.upper_offsets_offset + hnsw->size * sizeof(ullong), GANN_W2V_HNSW_ALIGN);
+  header.file_size = header.upper_links_offset + (hnsw->upper_size + 1) * sizeof(uint);
+
+  fout = fopen(path, "wb");
+  if (fout == NULL)
+  {
+    fprintf(stderr, "error: failed to open '%s' for writing.\n", path);
+    return -1;
+  }
+  if (gnn_w2v_hnsw_write(fout, &header, 0, sizeof(header)) ||
+      gnn_w2v_hnsw_write(fout, hnsw->vectors, header.vectors_offset, hnsw->size * hnsw->stride * sizeof(float)) ||
+      gnn_w2v_hnsw_write(fout, hnsw->levels, header.levels_offset, hnsw->size * sizeof(uint)) ||
+      gnn_w2v_hnsw_write(fout, hnsw->links0, header.links0_offset, hnsw->size * (hnsw->M0 + 1) * sizeof(uint)) ||
+      gnn_w2v_hnsw_write(fout, hnsw->upper_offsets, header.upper_offsets_offset, hnsw->size * sizeof(ullong)) ||
+      gnn_w2v_hnsw_write(fout, hnsw->upper_links, header.upper_links_offset, (hnsw->upper_size + 1) * sizeof(uint)))
+  {
+    fprintf(stderr, "error: failed to write hnsw index '%s'.\n", path);
+    fclose(fout);
+    return -1;
+  }
+  return fclose(fout) == 0 ? 0 : -1;
+}
+
+/*!
+** 1 if count items of size bytes at offset lie inside length bytes, and the
+** offset is aligned to the item.
+*/
+static int
+gnn_w2v_hnsw_section(ullong offset, ullong count, ullong size, ullong length)
+{
+  if (offset % size != 0 || offset > length)
+    return 0;
+  return count <= (length - offset) / size;
+}
+
+/*!
+** 1 if the links of a node at a level are at most max ids of nodes that
+** reach the level.
+*/
+static int
+gnn_w2v_hnsw_valid_links(uint const* links, uint max, uint const* levels, llong size, uint level)
+{
+  uint i;
+  if (links[0] > max)
+    return 0;
+  for (i = 1; i <= links[0]; i++)
+    if (links[i] >= size || levels[links[i]] < level)
+      return 0;
+  return 1;
+}
+
+/*!
+** checks every section of the header against the mapping, and the graph
+** against its sizes, so a search in a corrupt or foreign file never leaves
+** the mapping.
+*/
+static int
+gnn_w2v_hnsw_valid(gnn_w2v_hnsw_header_t const* header, const char* base, ullong length)
+{
+  uint const* levels;
+  uint const* links0;
+  ullong const* upper_offsets;
+  uint const* upper_links;
+  llong a;
+  uint l;
+
+  if (memcmp(header->magic, GANN_W2V_HNSW_MAGIC, sizeof(GANN_W2V_HNSW_MAGIC)) != 0 ||
+      header->version != GANN_W2V_HNSW_VERSION ||
+      header->file_size != length)
+    return 0;
+  if (header->dim_num == 0 || header->stride < header->dim_num || header->M == 0 || header->M0 == 0 ||
+      header->M0 == (uint) -1 || header->M == (uint) -1 || header->size < 0 ||
+      header->max_level < 0 || header->max_level > GANN_W2V_HNSW_MAX_LEVEL ||
+      (ullong) header->size > length / sizeof(float) / header->stride ||
+      (ullong) header->size > length / sizeof(uint) / (header->M0 + 1))
+    return 0;
+  if (header->size > 0 ? header->entry_point < 0 || header->entry_point >= header->size : header->entry_point != 0)
+    return 0;
+  if (!gnn_w2v_hnsw_section(header->vectors_offset, header->size * header->stride, sizeof(float), length) ||
+      !gnn_w2v_hnsw_section(header->levels_offset, header->size, sizeof(uint), length) ||
+      !gnn_w2v_hnsw_section(header->links0_offset, header->size * (header->M0 + 1), sizeof(uint), length) ||
+      !gnn_w2v_hnsw_section(header->upper_offsets_offset, header->size, sizeof(ullong), length) ||
+      header->upper_size >= length / sizeof(uint) ||
+      !gnn_w2v_hnsw_section(header->upper_links_offset, header->upper_size + 1, sizeof(uint), length))
+    return 0;
+
+  levels = (uint const*) (base + header->levels_offset);
+  links0 = (uint const*) (base + header->links0_offset);
+  upper_offsets = (ullong const*) (base + header->upper_offsets_offset);
+  upper_links = (uint const*) (base + header->upper_links_offset);
+  if (header->size > 0 && levels[header->entry_point] != (uint) header->max_level)
+    return 0;
+  for (a = 0; a < header->size; a++)
+  {
+    if (levels[a] > (uint) header->max_level ||
+        upper_offsets[a] > header->upper_size ||
+        (ullong) levels[a] * (header->M + 1) > header->upper_size - upper_offsets[a])
+      return 0;
+    if (!gnn_w2v_hnsw_valid_links(links0 + a * (header->M0 + 1), header->M0, levels, header->size, 0))
+      return 0;
+    for (l = 1; l <= levels[a]; l++)
+      if (!gnn_w2v_hnsw_valid_links(upper_links + upper_offsets[a] + (ullong) (l - 1) * (header->M + 1),
+                                    header->M, levels, header->size, l))
+        return 0;
+  }
+  return 1;
+}
+
+gnn_w2v_hnsw_t*
+gnn_w2v_hnsw_open(const char* path)
+{
+  gnn_w2v_hnsw_header_t const* header;
+  gnn_w2v_hnsw_t* ret;
+  struct stat st;
+  char* base;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    perror("open");
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(gnn_w2v_hnsw_header_t))
+  {
+    fprintf(stderr, "error: '%s' is not a hnsw index.\n", path);
+    close(fd);
+    return NULL;
+  }
+  base = (char*) mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+  {
+    perror("mmap");
+    return NULL;
+  }
+
+  header = (gnn_w2v_hnsw_header_t const*) base;
+  if (!gnn_w2v_hnsw_valid(header, base, st.st_size))
+  {
+    fprintf(stderr, "error: '%s' is not a valid hnsw index.\n", path);
+    munmap(base, st.st_size);
+    return NULL;
+  }
+
+  ret = (gnn_w2v_hnsw_t*) calloc(1, sizeof(gnn_w2v_hnsw_t));
+  if (ret == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for hnsw index in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  ret->dim_num = header->dim_num;
+  ret->stride = header->stride;
+  ret->size = header->size;
+  ret->M = header->M;
+  ret->M0 = header->M0;
+  ret->ef_construction = header->ef_construction;
+  ret->ef_search = header->ef_search;
+  ret->max_level = header->max_level;
+  ret->entry_point = header->entry_point;
+  ret->upper_size = header->upper_size;
+  ret->vectors = (float*) (base + header->vectors_offset);
+  ret->levels = (uint*) (base + header->levels_offset);
+  ret->links0 = (uint*) (base + header->links0_offset);
+  ret->upper_offsets = (ullong*) (base + header->upper_offsets_offset);
+  ret->upper_links = (uint*) (base + header->upper_links_offset);
+  ret->locks = NULL;
+  ret->base = base;
+  ret->length = st.st_size;
+  return ret;
+}
+
+uint
+gnn_w2v_hnsw_search(gnn_w2v_hnsw_t const*   hnsw,
+                    const float*            query,
+                    uint                    k,
+                    gnn_w2v_neighbor_t*     result)
+{
+  uint ef = hnsw->ef_search > k ? hnsw->ef_search : k;
+  gnn_w2v_hnsw_scratch_t* scratch = &search_scratch;
+  llong current = hnsw->entry_point;
+  float sim;
+  int l;
+  uint ret;
+
+  if (hnsw->size == 0 || k == 0)
+    return 0;
+
+  if (scratch->query_size < hnsw->stride)
+  {
+    free(scratch->query);
+    if (posix_memalign((void **)&scratch->query, 128, hnsw->stride * sizeof(float)) != 0)
+    {
+      fprintf(stderr, "error: failed to allocate memories for hnsw query in %d of %s.\n", __LINE__, __FILE__);
+      exit(1);
+    }
+    scratch->query_size = hnsw->stride;
+  }
+  memcpy(scratch->query, query, hnsw->dim_num * sizeof(float));
+  memset(scratch->query + hnsw->dim_num, 0, (hnsw->stride - hnsw->dim_num) * sizeof(float));
+  gnn_vec_normalize(scratch->query, hnsw->dim_num);
+
+  sim = gnn_vec_dot(scratch->query, gnn_w2v_hnsw_vector(hnsw, current), hnsw->stride);
+  for (l = hnsw->max_level; l > 0; l--)
+    current = gnn_w2v_hnsw_greedy(hnsw, scratch, scratch->query, current, &sim, l);
+  gnn_w2v_hnsw_search_layer(hnsw, scratch, scratch->query, current, sim, ef, 0);
+
+  /*!
+  ** drop the worst until k are left
+  */
+  while (scratch->results.size > k)
+    gnn_w2v_hnsw_heap_pop(&scratch->results);
+  ret = scratch->results.size;
+  memcpy(result, scratch->results.data, ret * sizeof(gnn_w2v_neighbor_t));
+  gnn_w2v_neighbors_sort(result, ret);
+  return ret;
+}
+
+void
+gnn_w2v_hnsw_release(void)
+{
+  gnn_w2v_hnsw_scratch_free(&search_scratch);
+}
@@ -0,0 +1,349 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "gann-w2v-knn.h"
+
+typedef struct gnn_w2v_knn_batch_s
+{
+  gnn_w2v_knn_t const*    knn;
+
+  /*!
+  ** the normalized and padded queries
+  */
+  const float*            queries;
+
+  uint                    query_begin;
+
+  uint                    query_end;
+
+  uint                    k;
+
+  gnn_w2v_neighbor_t*     results;
+}
+gnn_w2v_knn_batch_t;
+
+void
+gnn_w2v_neighbors_push(gnn_w2v_neighbor_t*      heap,
+                       uint*                    size,
+                       uint                     k,
+                       llong                    id,
+                       float                    similarity)
+{
+  uint i, child;
+  gnn_w2v_neighbor_t tmp;
+
+  if (*size < k)
+  {
+    /*!
+    ** sift up
+    */
+    i = (*size)++;
+    while (i > 0 && heap[(i - 1) / 2].similarity > similarity)
+    {
+      heap[i] = heap[(i - 1) / 2];
+      i = (i - 1) / 2;
+    }
+    heap[i].id = id;
+    heap[i].similarity = similarity;
+    return;
+  }
+  if (k == 0 || similarity <= heap[0].similarity)
+    return;
+
+  /*!
+  ** replace the worst and sift down
+  */
+  i = 0;
+  while ((child = i * 2 + 1) < k)
+  {
+    if (child + 1 < k && heap[child + 1].similarity < heap[child].similarity)
+      child++;
+    if (heap[child].similarity >= similarity)
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  tmp.id = id;
+  tmp.similarity = similarity;
+  heap[i] = tmp;
+}
+
+static int
+gnn_w2v_neighbor_compare(const void* a, const void* b)
+{
+  float sa = ((gnn_w2v_neighbor_t*)a)->similarity;
+  float sb = ((gnn_w2v_neighbor_t*)b)->similarity;
+  return sa < sb ? 1 : (sa > sb ? -1 : 0);
+}
+
+void
+gnn_w2v_neighbors_sort(gnn_w2v_neighbor_t* heap, uint size)
+{
+  qsort(heap, size, sizeof(gnn_w2v_neighbor_t), gnn_w2v_neighbor_compare);
+}
+
+gnn_w2v_knn_t*
+gnn_w2v_knn_new(const float*    vectors,
+                llong           size,
+                uint            dim_num,
+                uint            stride)
+{
+  gnn_w2v_knn_t* ret = (gnn_w2v_knn_t*) malloc(sizeof(gnn_w2v_knn_t));
+  llong a;
+
+  if (ret == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for knn in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+
+  ret->dim_num = dim_num;
+  ret->stride = (dim_num + 15) / 16 * 16;
+  ret->size = size;
+
+  if (posix_memalign((void **)&ret->vectors, 128, size * ret->stride * sizeof(float)) != 0)
+  {
+    fprintf(stderr, "error: failed to allocate memories for knn vectors in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  for (a = 0; a < size; a++)
+  {
+    float* row = ret->vectors + a * ret->stride;
+    memcpy(row, vectors + a * stride, dim_num * sizeof(float));
+    memset(row + dim_num, 0, (ret->stride - dim_num) * sizeof(float));
+    gnn_vec_normalize(row, dim_num);
+  }
+  return ret;
+}
+
+gnn_w2v_knn_t*
+gnn_w2v_knn_from_w2v(gnn_w2v_t const* w2v)
+{
+  return gnn_w2v_knn_new(w2v->hidden_weights, w2v->vocab_size, w2v->dim_num, w2v->dim_num);
+}
+
+gnn_w2v_knn_t*
+gnn_w2v_knn_from_store(gnn_w2v_store_t const* store)
+{
+  return gnn_w2v_knn_new(store->vectors, store->vocab_size, store->dim_num, store->stride);
+}
+
+void
+gnn_w2v_knn_free(gnn_w2v_knn_t* knn)
+{
+  if (knn == NULL) return;
+  free(knn->vectors);
+  free(knn);
+}
+
+/*!
+** scans rows [begin, end) with the padded query and pushes into heap.
+*/
+static void
+gnn_w2v_knn_scan(gnn_w2v_knn_t const*   knn,
+                 const float*           query,
+                 llong                  begin,
+                 llong                  end,
+                 uint                   k,
+                 gnn_w2v_neighbor_t*    heap,
+                 uint*                  heap_size)
+{
+  float sims[4];
+  llong a = begin;
+  uint j;
+
+  for (; a + 4 <= end; a += 4)
+  {
+    gnn_vec_dot4(sims, query, knn->vectors + a * knn->stride, knn->stride, knn->stride);
+    for (j = 0; j < 4; j++)
+      gnn_w2v_neighbors_push(heap, heap_size, k, a + j, sims[j]);
+  }
+  for (; a < end; a++)
+    gnn_w2v_neighbors_push(heap, heap_size, k, a,
+                           gnn_vec_dot(query, knn->vectors + a * knn->stride, knn->stride));
+}
+
+/*!
+** scans rows [begin, end) with two consecutive padded queries, each tile of
+** 2 queries x 4 rows is computed in registers and pushed into the two heaps.
+*/
+static void
+gnn_w2v_knn_scan2(gnn_w2v_knn_t const*   knn,
+                  const float*           queries,
+                  llong                  begin,
+                  llong                  end,
+                  uint                   k,
+                  gnn_w2v_neighbor_t*    heaps,
+                  uint*                  heap_sizes)
+{
+  float sims[8];
+  llong a = begin;
+  uint j;
+
+  for (; a + 4 <= end; a += 4)
+  {
+    gnn_vec_dot2x4(sims, queries, knn->stride, knn->vectors + a * knn->stride, knn->stride, knn->stride);
+    for (j = 0; j < 4; j++)
+    {
+      gnn_w2v_neighbors_push(heaps, &heap_sizes[0], k, a + j, sims[j]);
+      gnn_w2v_neighbors_push(heaps + k, &heap_sizes[1], k, a + j, sims[4 + j]);
+    }
+  }
+  for (; a < end; a++)
+  {
+    gnn_w2v_neighbors_push(heaps, &heap_sizes[0], k, a,
+                           gnn_vec_dot(queries, knn->vectors + a * knn->stride, knn->stride));
+    gnn_w2v_neighbors_push(heaps + k, &heap_sizes[1], k, a,
+                           gnn_vec_dot(queries + knn->stride, knn->vectors + a * knn->stride, knn->stride));
+  }
+}
+
+static float*
+gnn_w2v_knn_queries(gnn_w2v_knn_t const* knn, const float* queries, uint query_num)
+{
+  float* ret;
+  uint q;
+
+  if (posix_memalign((void **)&ret, 128, (size_t) query_num * knn->stride * sizeof(float)) != 0)
+  {
+    fprintf(stderr, "error: failed to allocate memories for knn queries in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  for (q = 0; q < query_num; q++)
+  {
+    float* row = ret + (size_t) q * knn->stride;
+    memcpy(row, queries + (size_t) q * knn->dim_num, knn->dim_num * sizeof(float));
+    memset(row + knn->dim_num, 0, (knn->stride - knn->dim_num) * sizeof(float));
+    gnn_vec_normalize(row, knn->dim_num);
+  }
+  return ret;
+}
+
+uint
+gnn_w2v_knn_search(gnn_w2v_knn_t const*   knn,
+                   const float*           query,
+                   uint                   k,
+                   gnn_w2v_neighbor_t*    result)
+{
+  uint size = 0;
+  float* padded = gnn_w2v_knn_queries(knn, query, 1);
+
+  gnn_w2v_knn_scan(knn, padded, 0, knn->size, k, result, &size);
+  gnn_w2v_neighbors_sort(result, size);
+  free(padded);
+  return size;
+}
+
+static void*
+gnn_w2v_knn_batch_run(void* data)
+{
+  gnn_w2v_knn_batch_t* batch = (gnn_w2v_knn_batch_t*) data;
+  gnn_w2v_knn_t const* knn = batch->knn;
+  uint count = batch->query_end - batch->query_begin;
+  uint* sizes = (uint*) calloc(count, sizeof(uint));
+  llong begin, end;
+  uint q, i;
+
+  if (sizes == NULL && count > 0)
+  {
+    fprintf(stderr, "error: failed to allocate memories for knn heaps in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+
+  /*!
+  ** the outer loop walks row blocks, so one block is reused by all queries
+  ** of this thread before it is evicted. Inside a block the queries go in
+  ** pairs through the 2 x 4 register tile, an odd last query uses the one
+  ** query scan.
+  */
+  for (begin = 0; begin < knn->size; begin += GANN_W2V_KNN_ROW_BLOCK)
+  {
+    end = begin + GANN_W2V_KNN_ROW_BLOCK;
+    if (end > knn->size) end = knn->size;
+    for (q = 0; q + 2 <= count; q += 2)
+      gnn_w2v_knn_scan2(knn,
+                        batch->queries + (size_t) (batch->query_begin + q) * knn->stride,
+                        begin, end, batch->k,
+                        batch->results + (size_t) (batch->query_begin + q) * batch->k,
+                        &sizes[q]);
+    if (q < count)
+      gnn_w2v_knn_scan(knn,
+                       batch->queries + (size_t) (batch->query_begin + q) * knn->stride,
+                       begin, end, batch->k,
+                       batch->results + (size_t) (batch->query_begin + q) * batch->k,
+                       &sizes[q]);
+  }
+
+  for (q = 0; q < count; q++)
+  {
+    gnn_w2v_neighbor_t* heap = batch->results + (size_t) (batch->query_begin + q) * batch->k;
+    gnn_w2v_neighbors_sort(heap, sizes[q]);
+    for (i = sizes[q]; i < batch->k; i++)
+    {
+      heap[i].id = -1;
+      heap[i].similarity = 0;
+    }
+  }
+  free(sizes);
+  return NULL;
+}
+
+void
+gnn_w2v_knn_search_batch(gnn_w2v_knn_t const*   knn,
+                         const float*           queries,
+                         uint                   query_num,
+                         uint                   k,
+                         gnn_w2v_neighbor_t*    results,
+                         uint                   thread_num)
+{
+  float* padded = gnn_w2v_knn_queries(knn, queries, query_num);
+  gnn_w2v_knn_batch_t* batches;
+  pthread_t* threads;
+  uint t, per;
+
+  if (thread_num == 0) thread_num = 1;
+  if (thread_num > query_num) thread_num = query_num;
+  if (thread_num == 0)
+  {
+    free(padded);
+    return;
+  }
+
+  batches = (gnn_w2v_knn_batch_t*) calloc(thread_num, sizeof(gnn_w2v_knn_batch_t));
+  threads = (pthread_t*) calloc(thread_num, sizeof(pthread_t));
+  if (batches == NULL || threads == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for knn threads in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  per = (query_num + thread_num - 1) / thread_num;
+  for (t = 0; t < thread_num; t++)
+  {
+    batches[t].knn = knn;
+    batches[t].queries = padded;
+    batches[t].query_begin = t * per > query_num ? query_num : t * per;
+    batches[t].query_end = (t + 1) * per > query_num ? query_num : (t + 1) * per;
+    batches[t].k = k;
+    batches[t].results = results;
+    if (t > 0)
+      pthread_create(&threads[t], NULL, gnn_w2v_knn_batch_run, &batches[t]);
+  }
+  gnn_w2v_knn_batch_run(&batches[0]);
+  for (t = 1; t < thread_num; t++)
+    pthread_join(threads[t], NULL);
+
+  free(batches);
+  free(threads);
+  free(padded);
+}
@@ -0,0 +1,331 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "gann-w2v-model.h"
+
+static int
+gnn_w2v_model_write(FILE* fout, const real* matrix, ullong rows, uint dims)
+{
+  size_t size = (size_t) rows * dims;
+  return fwrite(matrix, sizeof(real), size, fout) == size ? 0 : -1;
+}
+
+static int
+gnn_w2v_model_read(FILE* fin, real* matrix, ullong rows, uint dims)
+{
+  size_t size = (size_t) rows * dims;
+  return fread(matrix, sizeof(real), size, fin) == size ? 0 : -1;
+}
+
+static int
+gnn_w2v_model_fwrite(FILE*                    fout,
+                     gnn_w2v_t const*         w2v,
+                     gnn_w2v_vocab_t const*   vocab)
+{
+  gnn_w2v_model_header_t header;
+  uint length;
+  size_t codelen;
+  llong a;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GANN_W2V_MODEL_MAGIC, sizeof(GANN_W2V_MODEL_MAGIC));
+  header.version = GANN_W2V_MODEL_VERSION;
+  header.dim_num = w2v->dim_num;
+  header.vocab_size = vocab->size;
+  header.char_size = w2v->char_size;
+  header.bucket_size = w2v->bucket_size;
+
+  if (fwrite(&header, sizeof(header), 1, fout) != 1) return -1;
+  for (a = 0; a < vocab->size; a++)
+  {
+    length = strlen(vocab->words[a].word);
+    if (fwrite(&vocab->words[a].count, sizeof(ullong), 1, fout) != 1) return -1;
+    if (fwrite(&length, sizeof(uint), 1, fout) != 1) return -1;
+    if (fwrite(vocab->words[a].word, 1, length, fout) != length) return -1;
+    codelen = vocab->words[a].codelen;
+    if (fwrite(&vocab->words[a].codelen, sizeof(char), 1, fout) != 1) return -1;
+    if (fwrite(vocab->words[a].code, sizeof(char), codelen, fout) != codelen) return -1;
+    if (fwrite(vocab->words[a].point, sizeof(int), codelen, fout) != codelen) return -1;
+  }
+  if (gnn_w2v_model_write(fout, w2v->hidden_weights, w2v->vocab_size, w2v->dim_num)) return -1;
+  if (gnn_w2v_model_write(fout, w2v->output_weights, w2v->vocab_size, w2v->dim_num)) return -1;
+  if (gnn_w2v_model_write(fout, w2v->negative_samplings, w2v->vocab_size, w2v->dim_num)) return -1;
+  if (gnn_w2v_model_write(fout, w2v->char_weights, w2v->char_size, w2v->dim_num)) return -1;
+  if (w2v->bucket_size > 0 &&
+      gnn_w2v_model_write(fout, w2v->bucket_weights, w2v->bucket_size, w2v->dim_num)) return -1;
+  return 0;
+}
+
+static int
+gnn_w2v_model_fread(FILE*                    fin,
+                    const char*              path,
+                    int                      mem_flags,
+                    gnn_w2v_vocab_t**        vocab,
+                    gnn_w2v_t**              w2v)
+{
+  gnn_w2v_model_header_t header;
+  char word[GANN_W2V_MAX_STRING];
+  gnn_w2v_vocab_t* ret = NULL;
+  gnn_w2v_t* net = NULL;
+  gnn_w2v_word_t* entry;
+  ullong count;
+  uint length;
+  ullong a;
+  int d;
+
+  if (fread(&header, sizeof(header), 1, fin) != 1 ||
+      memcmp(header.magic, GANN_W2V_MODEL_MAGIC, sizeof(GANN_W2V_MODEL_MAGIC)) != 0 ||
+      header.version != GANN_W2V_MODEL_VERSION || header.vocab_size == 0)
+  {
+    fprintf(stderr, "error: '%s' is not a valid model.\n", path);
+    return -1;
+  }
+
+  /*!
+  ** </s> is always the first word of a new vocabulary
+  */
+  ret = gnn_w2v_vocab_new();
+  for (a = 0; a < header.vocab_size; a++)
+  {
+    if (fread(&count, sizeof(ullong), 1, fin) != 1 ||
+        fread(&length, sizeof(uint), 1, fin) != 1 ||
+        length >= GANN_W2V_MAX_STRING ||
+        fread(word, 1, length, fin) != length)
+      goto failed;
+    word[length] = '\0';
+    if (a > 0 && gnn_w2v_vocab_add(ret, word, 0) != (int) a)
+      goto failed;
+    entry = &ret->words[a];
+    entry->count = count;
+
+    /*!
+    ** the codes are kept rather than rebuilt from the counts, a grown
+    ** vocabulary has codes that the counts do not give, and the points index
+    ** the output rows
+    */
+    entry->code = (char *)calloc(GANN_W2V_MAX_CODE_LENGTH, sizeof(char));
+    entry->point = (int *)calloc(GANN_W2V_MAX_CODE_LENGTH, sizeof(int));
+    if (entry->code == NULL || entry->point == NULL)
+    {
+      fprintf(stderr, "error: failed to allocate memories for huffman codes in %d of %s.\n", __LINE__, __FILE__);
+      exit(1);
+    }
+    if (fread(&entry->codelen, sizeof(char), 1, fin) != 1 || entry->codelen < 0 ||
+        fread(entry->code, sizeof(char), entry->codelen, fin) != (size_t) entry->codelen ||
+        fread(entry->point, sizeof(int), entry->codelen, fin) != (size_t) entry->codelen)
+      goto failed;
+    for (d = 0; d < entry->codelen; d++)
+      if ((entry->code[d] != 0 && entry->code[d] != 1) ||
+          entry->point[d] < 0 || (ullong) entry->point[d] + 1 >= header.vocab_size)
+        goto failed;
+  }
+  ret->bucket_size = header.bucket_size;
+  gnn_w2v_vocab_build(ret);
+  if ((ullong) ret->char_size != header.char_size)
+  {
+    fprintf(stderr, "error: '%s' was trained with another character embedding type.\n", path);
+    goto failed;
+  }
+
+  net = gnn_w2v_new(ret, header.dim_num, mem_flags, NULL);
+  if (gnn_w2v_model_read(fin, net->hidden_weights, net->vocab_size, net->dim_num)) goto failed;
+  if (gnn_w2v_model_read(fin, net->output_weights, net->vocab_size, net->dim_num)) goto failed;
+  if (gnn_w2v_model_read(fin, net->negative_samplings, net->vocab_size, net->dim_num)) goto failed;
+  if (gnn_w2v_model_read(fin, net->char_weights, net->char_size, net->dim_num)) goto failed;
+  if (net->bucket_size > 0 &&
+      gnn_w2v_model_read(fin, net->bucket_weights, net->bucket_size, net->dim_num)) goto failed;
+
+  *vocab = ret;
+  *w2v = net;
+  return 0;
+
+failed:
+  fprintf(stderr, "error: failed to read model '%s'.\n", path);
+  if (net != NULL)
+    gnn_w2v_free(net);
+  gnn_w2v_vocab_free(ret);
+  return -1;
+}
+
+int
+gnn_w2v_model_save(gnn_w2v_t const*         w2v,
+                   gnn_w2v_vocab_t const*   vocab,
+                   const char*              path)
+{
+  FILE* fout = fopen(path, "wb");
+  if (fout == NULL)
+  {
+    fprintf(stderr, "error: failed to open '%s' for writing.\n", path);
+    return -1;
+  }
+  if (gnn_w2v_model_fwrite(fout, w2v, vocab) != 0)
+  {
+    fprintf(stderr, "error: failed to write model '%s'.\n", path);
+    fclose(fout);
+    return -1;
+  }
+  return fclose(fout) == 0 ? 0 : -1;
+}
+
+int
+gnn_w2v_model_load(const char*              path,
+                   int                      mem_flags,
+                   gnn_w2v_vocab_t**        vocab,
+                   gnn_w2v_t**              w2v)
+{
+  int rc;
+  FILE* fin = fopen(path, "rb");
+  if (fin == NULL)
+  {
+    fprintf(stderr, "error: model file '%s' not found.\n", path);
+    return -1;
+  }
+  rc = gnn_w2v_model_fread(fin, path, mem_flags, vocab, w2v);
+  fclose(fin);
+  return rc;
+}
+
+/*!
+** flushes the directory of path, so a rename into it survives a power loss.
+*/
+static int
+gnn_w2v_checkpoint_sync_dir(const char* path)
+{
+  const char* slash = strrchr(path, '/');
+  char* dir;
+  int fd, rc;
+
+  dir = (char*) malloc(strlen(path) + 2);
+  if (dir == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for path in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  if (slash == NULL)
+    strcpy(dir, ".");
+  else if (slash == path)
+    strcpy(dir, "/");
+  else
+  {
+    memcpy(dir, path, slash - path);
+    dir[slash - path] = '\0';
+  }
+  fd = open(dir, O_RDONLY);
+  free(dir);
+  if (fd < 0)
+    return -1;
+  rc = fsync(fd);
+  close(fd);
+  return rc;
+}
+
+int
+gnn_w2v_checkpoint_save(gnn_w2v_t const*                w2v,
+                        gnn_w2v_vocab_t const*          vocab,
+                        gnn_w2v_checkpoint_t const*     checkpoint,
+                        const char*                     path)
+{
+  gnn_w2v_checkpoint_header_t header;
+  char* temp;
+  FILE* fout;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GANN_W2V_CHECKPOINT_MAGIC, sizeof(GANN_W2V_CHECKPOINT_MAGIC));
+  header.alpha = checkpoint->alpha;
+  header.thread_num = checkpoint->thread_num;
+  header.reader = checkpoint->reader;
+
+  /*!
+  ** the file is written aside, synced and renamed, and the directory is
+  ** synced, so a crash or a power loss while writing leaves the last
+  ** checkpoint complete
+  */
+  temp = (char*) malloc(strlen(path) + 5);
+  if (temp == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for path in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  sprintf(temp, "%s.tmp", path);
+  fout = fopen(temp, "wb");
+  if (fout == NULL)
+  {
+    fprintf(stderr, "error: failed to open '%s' for writing.\n", temp);
+    free(temp);
+    return -1;
+  }
+  if (gnn_w2v_model_fwrite(fout, w2v, vocab) != 0 ||
+      fwrite(&header, sizeof(header), 1, fout) != 1 ||
+      fwrite(checkpoint->rngs, sizeof(gnn_rng_t), checkpoint->thread_num, fout) != checkpoint->thread_num ||
+      fflush(fout) != 0 ||
+      fsync(fileno(fout)) != 0)
+  {
+    fprintf(stderr, "error: failed to write checkpoint '%s'.\n", temp);
+    fclose(fout);
+    free(temp);
+    return -1;
+  }
+  if (fclose(fout) != 0 || rename(temp, path) != 0 || gnn_w2v_checkpoint_sync_dir(path) != 0)
+  {
+    fprintf(stderr, "error: failed to write checkpoint '%s'.\n", path);
+    free(temp);
+    return -1;
+  }
+  free(temp);
+  return 0;
+}
+
+int
+gnn_w2v_checkpoint_load(const char*                     path,
+                        int                             mem_flags,
+                        gnn_w2v_vocab_t**               vocab,
+                        gnn_w2v_t**                     w2v,
+                        gnn_w2v_checkpoint_t*           checkpoint)
+{
+  gnn_w2v_checkpoint_header_t header;
+  FILE* fin;
+
+  fin = fopen(path, "rb");
+  if (fin == NULL)
+  {
+    fprintf(stderr, "error: checkpoint file '%s' not found.\n", path);
+    return -1;
+  }
+  if (gnn_w2v_model_fread(fin, path, mem_flags, vocab, w2v) != 0)
+  {
+    fclose(fin);
+    return -1;
+  }
+  checkpoint->rngs = NULL;
+  if (fread(&header, sizeof(header), 1, fin) != 1 ||
+      memcmp(header.magic, GANN_W2V_CHECKPOINT_MAGIC, sizeof(GANN_W2V_CHECKPOINT_MAGIC)) != 0 ||
+      header.thread_num == 0 ||
+      (checkpoint->rngs = (gnn_rng_t*) malloc(header.thread_num * sizeof(gnn_rng_t))) == NULL ||
+      fread(checkpoint->rngs, sizeof(gnn_rng_t), header.thread_num, fin) != header.thread_num)
+  {
+    fprintf(stderr, "error: '%s' is not a valid checkpoint.\n", path);
+    free(checkpoint->rngs);
+    checkpoint->rngs = NULL;
+    gnn_w2v_free(*w2v);
+    gnn_w2v_vocab_free(*vocab);
+    fclose(fin);
+    return -1;
+  }
+  fclose(fin);
+  checkpoint->alpha = header.alpha;
+  checkpoint->thread_num = header.thread_num;
+  checkpoint->reader = header.reader;
+  return 0;
+}
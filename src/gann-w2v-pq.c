@@ -0,0 +1,507 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gann-w2v-pq.h"
+
+typedef struct gnn_w2v_pq_job_s
+{
+  gnn_w2v_pq_t*         pq;
+
+  const float*          vectors;
+
+  uint                  stride;
+
+  /*!
+  ** the normalized and padded training vectors
+  */
+  const float*          training;
+
+  llong                 training_num;
+
+  uint                  thread_id;
+
+  uint                  thread_num;
+}
+gnn_w2v_pq_job_t;
+
+/*!
+** copies the vector into m * sub_dim floats and normalizes it.
+*/
+static void
+gnn_w2v_pq_pad(gnn_w2v_pq_t const* pq, const float* vector, float* padded)
+{
+  memcpy(padded, vector, pq->dim_num * sizeof(float));
+  memset(padded + pq->dim_num, 0, (pq->m * pq->sub_dim - pq->dim_num) * sizeof(float));
+  gnn_vec_normalize(padded, pq->dim_num);
+}
+
+static float
+gnn_w2v_pq_distance(const float* a, const float* b, uint size)
+{
+  float ret = 0, d;
+  uint i;
+  for (i = 0; i < size; i++)
+  {
+    d = a[i] - b[i];
+    ret += d * d;
+  }
+  return ret;
+}
+
+static uint
+gnn_w2v_pq_nearest(const float* centroids, uint centroid_num, const float* sub, uint sub_dim)
+{
+  float best = FLT_MAX, d;
+  uint c, ret = 0;
+  for (c = 0; c < centroid_num; c++)
+  {
+    d = gnn_w2v_pq_distance(centroids + c * sub_dim, sub, sub_dim);
+    if (d < best)
+    {
+      best = d;
+      ret = c;
+    }
+  }
+  return ret;
+}
+
+/*!
+** trains the codebook of subspace j with Lloyd's k-means.
+*/
+static void
+gnn_w2v_pq_kmeans(gnn_w2v_pq_job_t* job, uint j)
+{
+  gnn_w2v_pq_t* pq = job->pq;
+  uint sub_dim = pq->sub_dim;
+  uint dim = pq->m * sub_dim;
+  uint k = pq->centroid_num;
+  float* centroids = pq->centroids + (size_t) j * GANN_W2V_PQ_CENTROIDS * sub_dim;
+  float* sums = (float*) calloc((size_t) k * sub_dim, sizeof(float));
+  llong* counts = (llong*) calloc(k, sizeof(llong));
+  llong* order = (llong*) malloc(job->training_num * sizeof(llong));
+  gnn_rng_t rng;
+  llong a, r, tmp;
+  uint c, d, it;
+
+  if (sums == NULL || counts == NULL || order == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for k-means in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+
+  /*!
+  ** the initial centroids are k distinct training vectors
+  */
+  gnn_rng_init(&rng, GANN_RNG_SEED, j);
+  for (a = 0; a < job->training_num; a++)
+    order[a] = a;
+  for (c = 0; c < k; c++)
+  {
+    r = c + (llong) (gnn_rng_next(&rng) % (ullong) (job->training_num - c));
+    tmp = order[c]; order[c] = order[r]; order[r] = tmp;
+    memcpy(centroids + c * sub_dim, job->training + order[c] * dim + j * sub_dim, sub_dim * sizeof(float));
+  }
+
+  for (it = 0; it < GANN_W2V_PQ_ITERATIONS; it++)
+  {
+    memset(sums, 0, (size_t) k * sub_dim * sizeof(float));
+    memset(counts, 0, k * sizeof(llong));
+    for (a = 0; a < job->training_num; a++)
+    {
+      const float* sub = job->training + a * dim + j * sub_dim;
+      c = gnn_w2v_pq_nearest(centroids, k, sub, sub_dim);
+      counts[c]++;
+      for (d = 0; d < sub_dim; d++)
+        sums[c * sub_dim + d] += sub[d];
+    }
+    for (c = 0; c < k; c++)
+    {
+      if (counts[c] == 0)
+      {
+        /*!
+        ** an empty cluster restarts from a random training vector
+        */
+        r = (llong) (gnn_rng_next(&rng) % (ullong) job->training_num);
+        memcpy(centroids + c * sub_dim, job->training + r * dim + j * sub_dim, sub_dim * sizeof(float));
+        continue;
+      }
+      for (d = 0; d < sub_dim; d++)
+        centroids[c * sub_dim + d] = sums[c * sub_dim + d] / counts[c];
+    }
+  }
+
+  free(sums);
+  free(counts);
+  free(order);
+}
+
+static void*
+gnn_w2v_pq_train_run(void* data)
+{
+  gnn_w2v_pq_job_t* job = (gnn_w2v_pq_job_t*) data;
+  uint j;
+  for (j = job->thread_id; j < job->pq->m; j += job->thread_num)
+    gnn_w2v_pq_kmeans(job, j);
+  return NULL;
+}
+
+static void*
+gnn_w2v_pq_encode_run(void* data)
+{
+  gnn_w2v_pq_job_t* job = (gnn_w2v_pq_job_t*) data;
+  gnn_w2v_pq_t* pq = job->pq;
+  llong a;
+  for (a = job->thread_id; a < pq->size; a += job->thread_num)
+    gnn_w2v_pq_encode(pq, job->vectors + a * job->stride, pq->codes + a * pq->m);
+  return NULL;
+}
+
+static void
+gnn_w2v_pq_parallel(gnn_w2v_pq_job_t* job, uint thread_num, void* (*run)(void*))
+{
+  gnn_w2v_pq_job_t* jobs = (gnn_w2v_pq_job_t*) calloc(thread_num, sizeof(gnn_w2v_pq_job_t));
+  pthread_t* threads = (pthread_t*) calloc(thread_num, sizeof(pthread_t));
+  uint t;
+  if (jobs == NULL || threads == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for product quantizer threads in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  for (t = 0; t < thread_num; t++)
+  {
+    jobs[t] = *job;
+    jobs[t].thread_id = t;
+    jobs[t].thread_num = thread_num;
+    if (t > 0)
+      pthread_create(&threads[t], NULL, run, &jobs[t]);
+  }
+  run(&jobs[0]);
+  for (t = 1; t < thread_num; t++)
+    pthread_join(threads[t], NULL);
+  free(jobs);
+  free(threads);
+}
+
+gnn_w2v_pq_t*
+gnn_w2v_pq_new(const float*   vectors,
+               llong          size,
+               uint           dim_num,
+               uint           stride,
+               uint           m,
+               uint           thread_num)
+{
+  gnn_w2v_pq_t* ret = (gnn_w2v_pq_t*) calloc(1, sizeof(gnn_w2v_pq_t));
+  gnn_w2v_pq_job_t job;
+  float* training;
+  llong a, step;
+  uint dim;
+
+  if (ret == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for product quantizer in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  if (m == 0) m = 1;
+  if (m > dim_num) m = dim_num;
+  if (thread_num == 0) thread_num = 1;
+
+  ret->dim_num = dim_num;
+  ret->m = m;
+  ret->sub_dim = (dim_num + m - 1) / m;
+  ret->size = size;
+  ret->centroid_num = size < GANN_W2V_PQ_CENTROIDS ? (uint) size : GANN_W2V_PQ_CENTROIDS;
+  dim = m * ret->sub_dim;
+
+  ret->centroids = (float*) calloc((size_t) m * GANN_W2V_PQ_CENTROIDS * ret->sub_dim, sizeof(float));
+  ret->codes = (unsigned char*) malloc((size_t) size * m);
+  if (ret->centroids == NULL || ret->codes == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for product quantizer in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  if (size == 0)
+    return ret;
+
+  /*!
+  ** an evenly strided sample is used for training large vocabularies
+  */
+  memset(&job, 0, sizeof(job));
+  job.training_num = size < GANN_W2V_PQ_MAX_TRAINING ? size : GANN_W2V_PQ_MAX_TRAINING;
+  step = size / job.training_num;
+  training = (float*) malloc((size_t) job.training_num * dim * sizeof(float));
+  if (training == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for product quantizer in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  for (a = 0; a < job.training_num; a++)
+    gnn_w2v_pq_pad(ret, vectors + a * step * stride, training + a * dim);
+
+  job.pq = ret;
+  job.vectors = vectors;
+  job.stride = stride;
+  job.training = training;
+  gnn_w2v_pq_parallel(&job, thread_num > m ? m : thread_num, gnn_w2v_pq_train_run);
+  free(training);
+
+  gnn_w2v_pq_parallel(&job, thread_num, gnn_w2v_pq_encode_run);
+  return ret;
+}
+
+gnn_w2v_pq_t*
+gnn_w2v_pq_from_w2v(gnn_w2v_t const* w2v, uint m, uint thread_num)
+{
+  return gnn_w2v_pq_new(w2v->hidden_weights, w2v->vocab_size, w2v->dim_num, w2v->dim_num, m, thread_num);
+}
+
+gnn_w2v_pq_t*
+gnn_w2v_pq_from_store(gnn_w2v_store_t const* store, uint m, uint thread_num)
+{
+  return gnn_w2v_pq_new(store->vectors, store->vocab_size, store->dim_num, store->stride, m, thread_num);
+}
+
+void
+gnn_w2v_pq_free(gnn_w2v_pq_t* pq)
+{
+  if (pq == NULL) return;
+  if (pq->base != NULL)
+    munmap(pq->base, pq->length);
+  else
+  {
+    free(pq->centroids);
+    free(pq->codes);
+  }
+  free(pq);
+}
+
+void
+gnn_w2v_pq_encode(gnn_w2v_pq_t const* pq, const float* vector, unsigned char* code)
+{
+  uint dim = pq->m * pq->sub_dim;
+  float padded[dim];
+  uint j;
+
+  gnn_w2v_pq_pad(pq, vector, padded);
+  for (j = 0; j < pq->m; j++)
+    code[j] = (unsigned char) gnn_w2v_pq_nearest(pq->centroids + (size_t) j * GANN_W2V_PQ_CENTROIDS * pq->sub_dim,
+                                                 pq->centroid_num,
+                                                 padded + j * pq->sub_dim,
+                                                 pq->sub_dim);
+}
+
+void
+gnn_w2v_pq_decode(gnn_w2v_pq_t const* pq, llong id, float* vector)
+{
+  const unsigned char* code = pq->codes + id * pq->m;
+  uint j, d, i = 0;
+  for (j = 0; j < pq->m; j++)
+  {
+    const float* c = pq->centroids + ((size_t) j * GANN_W2V_PQ_CENTROIDS + code[j]) * pq->sub_dim;
+    for (d = 0; d < pq->sub_dim && i < pq->dim_num; d++)
+      vector[i++] = c[d];
+  }
+}
+
+uint
+gnn_w2v_pq_search(gnn_w2v_pq_t const*     pq,
+                  const float*            query,
+                  uint                    k,
+                  gnn_w2v_neighbor_t*     result)
+{
+  uint dim = pq->m * pq->sub_dim;
+  float padded[dim];
+  float* table = (float*) malloc((size_t) pq->m * GANN_W2V_PQ_CENTROIDS * sizeof(float));
+  const unsigned char* code;
+  uint j, c, size = 0;
+  llong a;
+  float sim;
+
+  if (table == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for lookup table in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+
+  /*!
+  ** the lookup table holds the similarity of query to every centroid
+  */
+  gnn_w2v_pq_pad(pq, query, padded);
+  for (j = 0; j < pq->m; j++)
+    for (c = 0; c < pq->centroid_num; c++)
+      table[j * GANN_W2V_PQ_CENTROIDS + c] =
+          gnn_vec_dot(padded + j * pq->sub_dim,
+                      pq->centroids + ((size_t) j * GANN_W2V_PQ_CENTROIDS + c) * pq->sub_dim,
+                      pq->sub_dim);
+
+  for (a = 0; a < pq->size; a++)
+  {
+    code = pq->codes + a * pq->m;
+    sim = 0;
+    for (j = 0; j < pq->m; j++)
+      sim += table[j * GANN_W2V_PQ_CENTROIDS + code[j]];
+    gnn_w2v_neighbors_push(result, &size, k, a, sim);
+  }
+  gnn_w2v_neighbors_sort(result, size);
+  free(table);
+  return size;
+}
+
+int
+gnn_w2v_pq_save(gnn_w2v_pq_t const* pq, const char* path)
+{
+  static const char zeros[64] = {0};
+  gnn_w2v_pq_header_t header;
+  ullong centroids_size = (ullong) pq->m * GANN_W2V_PQ_CENTROIDS * pq->sub_dim * sizeof(float);
+  ullong codes_size = (ullong) pq->size * pq->m;
+  FILE* fout;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GANN_W2V_PQ_MAGIC, sizeof(GANN_W2V_PQ_MAGIC));
+  header.version = GANN_W2V_PQ_VERSION;
+  header.dim_num = pq->dim_num;
+  header.m = pq->m;
+  header.sub_dim = pq->sub_dim;
+  header.centroid_num = pq->centroid_num;
+  header.size = pq->size;
+  header.centroids_offset = 64;
+  header.codes_offset = header.centroids_offset + centroids_size;
+  header.file_size = header.codes_offset + codes_size;
+
+  fout = fopen(path, "wb");
+  if (fout == NULL)
+  {
+    fprintf(stderr, "error: failed to open '%s' for writing.\n", path);
+    return -1;
+  }
+  if (fwrite(&header, sizeof(header), 1, fout) != 1 ||
+      fwrite(zeros, 1, header.centroids_offset - sizeof(header), fout) != header.centroids_offset - sizeof(header) ||
+      fwrite(pq->centroids, 1, centroids_size, fout) != centroids_size ||
+      fwrite(pq->codes, 1, codes_size, fout) != codes_size)
+  {
+    fprintf(stderr, "error: failed to write product quantizer '%s'.\n", path);
+    fclose(fout);
+    return -1;
+  }
+  return fclose(fout) == 0 ? 0 : -1;
+}
+
+/*!
+** 1 if count items of size bytes at offset lie inside length bytes, and the
+** offset is aligned to the item.
+*/
+static int
+gnn_w2v_pq_section(ullong offset, ullong count, ullong size, ullong length)
+{
+  if (offset % size != 0 || offset > length)
+    return 0;
+  return count <= (length - offset) / size;
+}
+
+/*!
+** checks the shape and both sections of the header against the mapping,
+** and that every code names a trained centroid, so a corrupt or foreign
+** file is never read out of bounds.
+*/
+static int
+gnn_w2v_pq_valid(gnn_w2v_pq_header_t const* header, const char* base, ullong length)
+{
+  const unsigned char* codes;
+  ullong a;
+
+  if (memcmp(header->magic, GANN_W2V_PQ_MAGIC, sizeof(GANN_W2V_PQ_MAGIC)) != 0 ||
+      header->version != GANN_W2V_PQ_VERSION ||
+      header->file_size != length)
+    return 0;
+  if (header->dim_num == 0 || header->m == 0 || header->sub_dim == 0 ||
+      header->centroid_num == 0 || header->centroid_num > GANN_W2V_PQ_CENTROIDS ||
+      header->size < 0)
+    return 0;
+
+  // sub_dim rounds dim_num / m up, so the padding is less than m
+  if (header->dim_num > (ullong) header->m * header->sub_dim ||
+      (ullong) header->m * header->sub_dim - header->dim_num >= header->m)
+    return 0;
+  if (header->m > length / sizeof(float) / GANN_W2V_PQ_CENTROIDS / header->sub_dim ||
+      !gnn_w2v_pq_section(header->centroids_offset,
+                          (ullong) header->m * GANN_W2V_PQ_CENTROIDS * header->sub_dim, sizeof(float), length) ||
+      (ullong) header->size > length / header->m ||
+      !gnn_w2v_pq_section(header->codes_offset, (ullong) header->size * header->m, 1, length))
+    return 0;
+
+  codes = (const unsigned char*) base + header->codes_offset;
+  for (a = 0; a < (ullong) header->size * header->m; a++)
+    if (codes[a] >= header->centroid_num)
+      return 0;
+  return 1;
+}
+
+gnn_w2v_pq_t*
+gnn_w2v_pq_open(const char* path)
+{
+  gnn_w2v_pq_header_t const* header;
+  gnn_w2v_pq_t* ret;
+  struct stat st;
+  char* base;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    perror("open");
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(gnn_w2v_pq_header_t))
+  {
+    fprintf(stderr, "error: '%s' is not a product quantizer.\n", path);
+    close(fd);
+    return NULL;
+  }
+  base = (char*) mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+  {
+    perror("mmap");
+    return NULL;
+  }
+
+  header = (gnn_w2v_pq_header_t const*) base;
+  if (!gnn_w2v_pq_valid(header, base, st.st_size))
+  {
+    fprintf(stderr, "error: '%s' is not a valid product quantizer.\n", path);
+    munmap(base, st.st_size);
+    return NULL;
+  }
+
+  ret = (gnn_w2v_pq_t*) calloc(1, sizeof(gnn_w2v_pq_t));
+  if (ret == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for product quantizer in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  ret->dim_num = header->dim_num;
+  ret->m = header->m;
+  ret->sub_dim = header->sub_dim;
+  ret->centroid_num = header->centroid_num;
+  ret->size = header->size;
+  ret->centroids = (float*) (base + header->centroids_offset);
+  ret->codes = (unsigned char*) (base + header->codes_offset);
+  ret->base = base;
+  ret->length = st.st_size;
+  return ret;
+}
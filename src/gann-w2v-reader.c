@@ -0,0 +1,270 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+
+#include "gann-w2v-reader.h"
+
+static void
+gnn_w2v_reader_push(gnn_w2v_reader_t* reader, gnn_w2v_sentence_t const* sentence)
+{
+  ullong pos = reader->tail;
+  atomic_ullong* sequence = &reader->sequences[pos & (reader->capacity - 1)];
+  gnn_w2v_sentence_t* slot = &reader->slots[pos & (reader->capacity - 1)];
+
+  // full, waits for the slowest consumer to release the slot
+  while (atomic_load_explicit(sequence, memory_order_acquire) != pos)
+    sched_yield();
+
+  slot->length = sentence->length;
+  memcpy(slot->ids, sentence->ids, sentence->length * sizeof(int));
+  atomic_store_explicit(sequence, pos + 1, memory_order_release);
+  atomic_fetch_add_explicit(&reader->word_count, sentence->length, memory_order_relaxed);
+  reader->tail = pos + 1;
+}
+
+/*!
+** pushes a sentence, and tells whether the limit of words is reached.
+*/
+static int
+gnn_w2v_reader_flush(gnn_w2v_reader_t* reader, gnn_w2v_sentence_t* sentence, ullong* pushed)
+{
+  gnn_w2v_reader_push(reader, sentence);
+  *pushed += sentence->length;
+  sentence->length = 0;
+  return reader->limit > 0 && *pushed >= reader->limit;
+}
+
+static void*
+gnn_w2v_reader_run(void* data)
+{
+  gnn_w2v_reader_t* reader = (gnn_w2v_reader_t*) data;
+  gnn_w2v_vocab_t* vocab = (gnn_w2v_vocab_t*) reader->vocab;
+  gnn_w2v_reader_state_t* state = &reader->state;
+  gnn_w2v_sentence_t* sentence;
+  char word[GANN_W2V_MAX_STRING];
+  ullong count, pushed = 0;
+  int index;
+  real ran;
+  FILE* fin;
+
+  sentence = (gnn_w2v_sentence_t*) malloc(sizeof(gnn_w2v_sentence_t));
+  fin = fopen(reader->path, "rb");
+  if (sentence == NULL || fin == NULL)
+  {
+    fprintf(stderr, "error: failed to read '%s' in %d of %s.\n", reader->path, __LINE__, __FILE__);
+    exit(1);
+  }
+
+  /*!
+  ** the state always points at the next word to read, so a reader started
+  ** from it pushes the same sentences
+  */
+  for (; state->iteration < reader->iterations; state->iteration++, state->offset = 0)
+  {
+    fseek(fin, state->offset, SEEK_SET);
+    sentence->length = 0;
+    while (1)
+    {
+      word[0] = '\0';
+      gnn_w2v_word_read(word, fin);
+      if (feof(fin)) break;
+      index = gnn_w2v_word_index(vocab, word);
+      if (index == -1) continue;
+
+      if (reader->sample > 0)
+      {
+        count = vocab->words[index].count;
+        ran = (sqrt(count / (reader->sample * vocab->size)) + 1) * (reader->sample * reader->train_words) / count;
+        if (ran < gnn_rng_uniform(&state->rng)) continue;
+      }
+      sentence->ids[sentence->length++] = index;
+      if (sentence->length >= GANN_W2V_MAX_SENTENCE_LENGTH &&
+          gnn_w2v_reader_flush(reader, sentence, &pushed))
+      {
+        state->offset = ftell(fin);
+        goto stopped;
+      }
+    }
+    if (sentence->length > 0 && gnn_w2v_reader_flush(reader, sentence, &pushed))
+    {
+      state->iteration++;
+      state->offset = 0;
+      goto stopped;
+    }
+  }
+
+stopped:
+  fclose(fin);
+  free(sentence);
+  atomic_store_explicit(&reader->done, 1, memory_order_release);
+  return NULL;
+}
+
+gnn_w2v_reader_t*
+gnn_w2v_reader_new(const char*              path,
+                   gnn_w2v_vocab_t const*   vocab,
+                   uint                     sample,
+                   uint                     iterations,
+                   uint                     capacity,
+                   ullong                   seed)
+{
+  gnn_w2v_reader_state_t state;
+
+  state.iteration = 0;
+  state.offset = 0;
+  gnn_rng_init(&state.rng, seed, 0);
+  return gnn_w2v_reader_resume(path, vocab, sample, iterations, capacity, &state, 0);
+}
+
+gnn_w2v_reader_t*
+gnn_w2v_reader_resume(const char*                     path,
+                      gnn_w2v_vocab_t const*          vocab,
+                      uint                            sample,
+                      uint                            iterations,
+                      uint                            capacity,
+                      gnn_w2v_reader_state_t const*   state,
+                      ullong                          limit)
+{
+  gnn_w2v_reader_t* ret;
+  FILE* fin;
+  llong a;
+  uint i;
+
+  fin = fopen(path, "rb");
+  if (fin == NULL)
+  {
+    fprintf(stderr, "error: training data file '%s' not found.\n", path);
+    return NULL;
+  }
+  fclose(fin);
+
+  ret = (gnn_w2v_reader_t*) calloc(1, sizeof(gnn_w2v_reader_t));
+  if (ret == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for reader in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  ret->capacity = 1;
+  while (ret->capacity < capacity)
+    ret->capacity <<= 1;
+  ret->vocab = vocab;
+  ret->path = strdup(path);
+  ret->sample = sample;
+  ret->state = *state;
+  ret->limit = limit;
+  ret->iterations = iterations;
+  for (a = 0; a < vocab->size; a++)
+    ret->train_words += vocab->words[a].count;
+
+  ret->slots = (gnn_w2v_sentence_t*) malloc(ret->capacity * sizeof(gnn_w2v_sentence_t));
+  ret->sequences = (atomic_ullong*) malloc(ret->capacity * sizeof(atomic_ullong));
+  if (ret->path == NULL || ret->slots == NULL || ret->sequences == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for reader in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  for (i = 0; i < ret->capacity; i++)
+    atomic_init(&ret->sequences[i], i);
+  atomic_init(&ret->head, 0);
+  atomic_init(&ret->word_count, 0);
+  atomic_init(&ret->done, 0);
+
+  if (pthread_create(&ret->thread, NULL, gnn_w2v_reader_run, ret) != 0)
+  {
+    fprintf(stderr, "error: failed to start reader thread in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  return ret;
+}
+
+uint
+gnn_w2v_reader_next(gnn_w2v_reader_t* reader, int* ids)
+{
+  gnn_w2v_sentence_t const* slot;
+  atomic_ullong* sequence;
+  ullong pos, seq;
+  uint ret;
+  int done;
+
+  pos = atomic_load_explicit(&reader->head, memory_order_relaxed);
+  while (1)
+  {
+    sequence = &reader->sequences[pos & (reader->capacity - 1)];
+    seq = atomic_load_explicit(sequence, memory_order_acquire);
+    if (seq == pos + 1)
+    {
+      if (atomic_compare_exchange_weak_explicit(&reader->head, &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed))
+        break;
+      // pos is reloaded by the failed exchange
+    }
+    else if ((llong) (seq - (pos + 1)) < 0)
+    {
+      // empty, finished only if nothing was pushed after the check
+      done = atomic_load_explicit(&reader->done, memory_order_acquire);
+      if (done && atomic_load_explicit(sequence, memory_order_acquire) != pos + 1)
+        return 0;
+      sched_yield();
+      pos = atomic_load_explicit(&reader->head, memory_order_relaxed);
+    }
+    else
+      pos = atomic_load_explicit(&reader->head, memory_order_relaxed);
+  }
+
+  slot = &reader->slots[pos & (reader->capacity - 1)];
+  ret = slot->length;
+  memcpy(ids, slot->ids, ret * sizeof(int));
+  atomic_store_explicit(sequence, pos + reader->capacity, memory_order_release);
+  return ret;
+}
+
+uint
+gnn_w2v_reader_take(gnn_w2v_reader_t* reader, ullong* position, uint consumer_num, int* ids)
+{
+  ullong pos = *position;
+  atomic_ullong* sequence = &reader->sequences[pos & (reader->capacity - 1)];
+  gnn_w2v_sentence_t const* slot = &reader->slots[pos & (reader->capacity - 1)];
+  uint ret;
+
+  /*!
+  ** the position belongs to this consumer only, so it waits for the push
+  ** instead of racing for the head. the producer never waits on a slot whose
+  ** consumer waits for a later position, so the ring can not lock up.
+  */
+  while (atomic_load_explicit(sequence, memory_order_acquire) != pos + 1)
+  {
+    // finished only if nothing was pushed after the check
+    if (atomic_load_explicit(&reader->done, memory_order_acquire) &&
+        atomic_load_explicit(sequence, memory_order_acquire) != pos + 1)
+      return 0;
+    sched_yield();
+  }
+
+  ret = slot->length;
+  memcpy(ids, slot->ids, ret * sizeof(int));
+  atomic_store_explicit(sequence, pos + reader->capacity, memory_order_release);
+  *position = pos + consumer_num;
+  return ret;
+}
+
+void
+gnn_w2v_reader_free(gnn_w2v_reader_t* reader)
+{
+  if (reader == NULL) return;
+  pthread_join(reader->thread, NULL);
+  free(reader->path);
+  free(reader->slots);
+  free(reader->sequences);
+  free(reader);
+}
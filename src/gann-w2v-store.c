@@ -0,0 +1,341 @@
+/*!
+**   .oooooo.          .o.       ooooo      ooo ooooo      ooo
+**  d8P'  `Y8b        .888.      `888b.     `8' `888b.     `8'
+** 888               .8"888.      8 `88b.    8   8 `88b.    8
+** 888              .8' `888.     8   `88b.  8   8   `88b.  8
+** 888     ooooo   .88ooo8888.    8     `88b.8   8     `88b.8
+** `88.    .88'   .8'     `888.   8       `888   8       `888
+**  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gann-w2v-store.h"
+
+static ullong
+gnn_w2v_store_align(ullong offset, ullong alignment)
+{
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+static ullong
+gnn_w2v_store_hash(const char* word)
+{
+  const unsigned char* p = (const unsigned char*) word;
+  ullong hash = 0;
+  while (*p)
+    hash = hash * 257 + *p++;
+  return hash;
+}
+
+static int
+gnn_w2v_store_pad(FILE* fout, ullong offset)
+{
+  static const char zeros[GANN_W2V_STORE_ALIGN] = {0};
+  ullong pos = ftell(fout);
+  while (pos < offset)
+  {
+    ullong n = offset - pos;
+    if (n > GANN_W2V_STORE_ALIGN) n = GANN_W2V_STORE_ALIGN;
+    if (fwrite(zeros, 1, n, fout) != n) return -1;
+    pos += n;
+  }
+  return 0;
+}
+
+int
+gnn_w2v_store_write(const char*         path,
+                    const float*        vectors,
+                    const char* const*  words,
+                    llong               vocab_size,
+                    uint                dim_num)
+{
+  gnn_w2v_store_header_t header;
+  FILE*   fout;
+  ullong* offsets;
+  uint*   hashes;
+  float*  row;
+  ullong  strings_size = 0;
+  ullong  hash;
+  llong   a;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GANN_W2V_STORE_MAGIC, sizeof(GANN_W2V_STORE_MAGIC));
+  header.version = GANN_W2V_STORE_VERSION;
+  header.dim_num = dim_num;
+  header.vocab_size = vocab_size;
+  header.stride = gnn_w2v_store_align(dim_num, GANN_W2V_STORE_ROW_FLOATS);
+
+  /*!
+  ** load factor is at most 0.5, so the probe sequence stays short
+  */
+  header.hash_size = 1;
+  while (header.hash_size < (ullong) vocab_size * 2)
+    header.hash_size <<= 1;
+
+  offsets = (ullong*) malloc((vocab_size + 1) * sizeof(ullong));
+  hashes = (uint*) malloc(header.hash_size * sizeof(uint));
+  row = (float*) calloc(header.stride, sizeof(float));
+  if (offsets == NULL || hashes == NULL || row == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for store in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+
+  for (a = 0; a < vocab_size; a++)
+  {
+    offsets[a] = strings_size;
+    strings_size += strlen(words[a]) + 1;
+  }
+  offsets[vocab_size] = strings_size;
+
+  memset(hashes, 0xFF, header.hash_size * sizeof(uint));
+  for (a = 0; a < vocab_size; a++)
+  {
+    hash = gnn_w2v_store_hash(words[a]) & (header.hash_size - 1);
+    while (hashes[hash] != GANN_W2V_STORE_EMPTY)
+      hash = (hash + 1) & (header.hash_size - 1);
+    hashes[hash] = (uint) a;
+  }
+
+  header.vectors_offset = gnn_w2v_store_align(sizeof(header), GANN_W2V_STORE_ALIGN);
+  header.offsets_offset = header.vectors_offset + vocab_size * header.stride * sizeof(float);
+  header.strings_offset = header.offsets_offset + (vocab_size + 1) * sizeof(ullong);
+  header.hashes_offset = gnn_w2v_store_align(header.strings_offset + strings_size, sizeof(ullong));
+  header.file_size = header.hashes_offset + header.hash_size * sizeof(uint);
+
+  fout = fopen(path, "wb");
+  if (fout == NULL)
+  {
+    fprintf(stderr, "error: failed to open '%s' for writing.\n", path);
+    free(offsets);
+    free(hashes);
+    free(row);
+    return -1;
+  }
+
+  if (fwrite(&header, sizeof(header), 1, fout) != 1) goto failed;
+  if (gnn_w2v_store_pad(fout, header.vectors_offset)) goto failed;
+  for (a = 0; a < vocab_size; a++)
+  {
+    memcpy(row, vectors + a * dim_num, dim_num * sizeof(float));
+    if (fwrite(row, sizeof(float), header.stride, fout) != header.stride) goto failed;
+  }
+  if (fwrite(offsets, sizeof(ullong), vocab_size + 1, fout) != (size_t) vocab_size + 1) goto failed;
+  for (a = 0; a < vocab_size; a++)
+    if (fwrite(words[a], 1, offsets[a + 1] - offsets[a], fout) != offsets[a + 1] - offsets[a]) goto failed;
+  if (gnn_w2v_store_pad(fout, header.hashes_offset)) goto failed;
+  if (fwrite(hashes, sizeof(uint), header.hash_size, fout) != header.hash_size) goto failed;
+
+  free(offsets);
+  free(hashes);
+  free(row);
+  return fclose(fout) == 0 ? 0 : -1;
+
+failed:
+  fprintf(stderr, "error: failed to write embedding store '%s'.\n", path);
+  free(offsets);
+  free(hashes);
+  free(row);
+  fclose(fout);
+  return -1;
+}
+
+int
+gnn_w2v_save(gnn_w2v_t const*           w2v,
+             gnn_w2v_vocab_t const*     vocab,
+             const char*                path)
+{
+  int rc;
+  llong a;
+  real* vectors = w2v->hidden_weights;
+  const char** words = (const char**) malloc(vocab->size * sizeof(char*));
+  if (words == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for words in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  for (a = 0; a < vocab->size; a++)
+    words[a] = vocab->words[a].word;
+
+  /*!
+  ** the character enhanced and subword vectors are composed before writing
+  */
+  if (w2v->char_size > 0 || w2v->bucket_size > 0)
+  {
+    vectors = (real*) malloc((size_t) vocab->size * w2v->dim_num * sizeof(real));
+    if (vectors == NULL)
+    {
+      fprintf(stderr, "error: failed to allocate memories for vectors in %d of %s.\n", __LINE__, __FILE__);
+      exit(1);
+    }
+    for (a = 0; a < vocab->size; a++)
+      gnn_w2v_vector(w2v, vocab, a, vectors + a * w2v->dim_num);
+  }
+  rc = gnn_w2v_store_write(path, vectors, words, vocab->size, w2v->dim_num);
+  if (vectors != w2v->hidden_weights)
+    free(vectors);
+  free(words);
+  return rc;
+}
+
+/*!
+** 1 if count items of size bytes at offset lie inside length bytes, and the
+** offset is aligned to the item.
+*/
+static int
+gnn_w2v_store_section(ullong offset, ullong count, ullong size, ullong length)
+{
+  if (offset % size != 0 || offset > length)
+    return 0;
+  return count <= (length - offset) / size;
+}
+
+/*!
+** checks every section of the header against the mapping, and the offsets
+** and hashes against the vocabulary, so a corrupt or foreign file is never
+** read out of bounds.
+*/
+static int
+gnn_w2v_store_valid(gnn_w2v_store_header_t const* header, const char* base, ullong length)
+{
+  const ullong* offsets;
+  const char* strings;
+  const uint* hashes;
+  ullong a, empty = 0;
+
+  if (memcmp(header->magic, GANN_W2V_STORE_MAGIC, sizeof(GANN_W2V_STORE_MAGIC)) != 0 ||
+      header->version != GANN_W2V_STORE_VERSION ||
+      header->file_size != length)
+    return 0;
+  if (header->dim_num == 0 || header->stride < header->dim_num || header->stride > (uint) -1 ||
+      header->stride > length / sizeof(float) ||
+      header->vocab_size > length / sizeof(float) / header->stride)
+    return 0;
+  if (!gnn_w2v_store_section(header->vectors_offset, header->vocab_size * header->stride, sizeof(float), length) ||
+      !gnn_w2v_store_section(header->offsets_offset, header->vocab_size + 1, sizeof(ullong), length) ||
+      !gnn_w2v_store_section(header->hashes_offset, header->hash_size, sizeof(uint), length))
+    return 0;
+
+  // the probing stops at an empty slot, so there must be one
+  if (header->hash_size == 0 || (header->hash_size & (header->hash_size - 1)) != 0 ||
+      header->hash_size <= header->vocab_size)
+    return 0;
+
+  offsets = (const ullong*) (base + header->offsets_offset);
+  if (offsets[0] != 0 || !gnn_w2v_store_section(header->strings_offset, offsets[header->vocab_size], 1, length))
+    return 0;
+  strings = base + header->strings_offset;
+  for (a = 0; a < header->vocab_size; a++)
+    if (offsets[a + 1] <= offsets[a] || offsets[a + 1] > offsets[header->vocab_size] ||
+        strings[offsets[a + 1] - 1] != '\0')
+      return 0;
+
+  hashes = (const uint*) (base + header->hashes_offset);
+  for (a = 0; a < header->hash_size; a++)
+  {
+    if (hashes[a] == GANN_W2V_STORE_EMPTY)
+      empty++;
+    else if (hashes[a] >= header->vocab_size)
+      return 0;
+  }
+  return empty > 0;
+}
+
+gnn_w2v_store_t*
+gnn_w2v_store_open(const char* path)
+{
+  gnn_w2v_store_header_t const* header;
+  gnn_w2v_store_t* ret;
+  struct stat st;
+  void* base;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    perror("open");
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(gnn_w2v_store_header_t))
+  {
+    fprintf(stderr, "error: '%s' is not an embedding store.\n", path);
+    close(fd);
+    return NULL;
+  }
+  base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+  {
+    perror("mmap");
+    return NULL;
+  }
+
+  header = (gnn_w2v_store_header_t const*) base;
+  if (!gnn_w2v_store_valid(header, (const char*) base, st.st_size))
+  {
+    fprintf(stderr, "error: '%s' is not a valid embedding store.\n", path);
+    munmap(base, st.st_size);
+    return NULL;
+  }
+
+  ret = (gnn_w2v_store_t*) calloc(1, sizeof(gnn_w2v_store_t));
+  if (ret == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for store in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  ret->dim_num = header->dim_num;
+  ret->stride = (uint) header->stride;
+  ret->vocab_size = (llong) header->vocab_size;
+  ret->vectors = (const float*) ((const char*) base + header->vectors_offset);
+  ret->offsets = (const ullong*) ((const char*) base + header->offsets_offset);
+  ret->strings = (const char*) base + header->strings_offset;
+  ret->hashes = (const uint*) ((const char*) base + header->hashes_offset);
+  ret->hash_mask = header->hash_size - 1;
+  ret->base = base;
+  ret->length = st.st_size;
+  return ret;
+}
+
+void
+gnn_w2v_store_close(gnn_w2v_store_t* store)
+{
+  if (store == NULL) return;
+  if (store->base != NULL)
+    munmap(store->base, store->length);
+  free(store);
+}
+
+llong
+gnn_w2v_store_index(gnn_w2v_store_t const* store, const char* word)
+{
+  ullong hash = gnn_w2v_store_hash(word) & store->hash_mask;
+  while (store->hashes[hash] != GANN_W2V_STORE_EMPTY)
+  {
+    uint id = store->hashes[hash];
+    if (!strcmp(word, store->strings + store->offsets[id]))
+      return id;
+    hash = (hash + 1) & store->hash_mask;
+  }
+  return -1;
+}
+
+const char*
+gnn_w2v_store_word(gnn_w2v_store_t const* store, llong id)
+{
+  if (id < 0 || id >= store->vocab_size) return NULL;
+  return store->strings + store->offsets[id];
+}
+
+const float*
+gnn_w2v_store_vector(gnn_w2v_store_t const* store, llong id)
+{
+  if (id < 0 || id >= store->vocab_size) return NULL;
+  return store->vectors + id * store->stride;
+}
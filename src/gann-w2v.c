@@ -10,11 +10,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
 
 #include <gfc.h>
 #include <gnum.h>
 
 #include "gann-w2v.h"
+#include "gann-w2v-reader.h"
+#include "gann-w2v-model.h"
 
 #define MAX_EXP             6
 #define EXP_TABLE_SIZE      1000
@@ -29,11 +33,35 @@ typedef struct gnn_w2v_train_params_s
 
   llong                 id;
 
+  /*!
+  ** the training threads, thread id takes every thread_num-th sentence
+  */
+  uint                  thread_num;
+
   ullong                file_size;
 
   char                  file_path[4096];
 
   gnn_w2v_vocab_t*      vocab;
+
+  gnn_w2v_t*            w2v;
+
+  /*!
+  ** the shared sentence source of all training threads
+  */
+  gnn_w2v_reader_t*     reader;
+
+  uint                  window;
+
+  uint                  negative;
+
+  int                   hierarchical_softmax;
+
+  /*!
+  ** the stream of the thread, it goes on over the segments between two
+  ** checkpoints
+  */
+  gnn_rng_t             rng;
 }
 gnn_w2v_train_params_t;
 
@@ -48,45 +76,119 @@ const static int table_size = 1e8;
 int cbow = 1, debug_mode = 2, window = 5, min_count = 0, num_threads = 12, min_reduce = 1;
 int cwe_type = 2, multi_emb = 3, *embed_count, cwin = 5;
 
+// the placement of the embedding matrices, see GANN_MEM_HUGE_PAGES
+int mem_flags = GANN_MEM_DEFAULT;
+
+// the seed of the initialization and of the samplers of every thread
+ullong random_seed = GANN_RNG_SEED;
+
+// the passes over the training text
+uint iter = 100;
+
+static size_t
+gnn_w2v_matrix_size(uint rows, uint dims)
+{
+  return (size_t) rows * dims * sizeof(real);
+}
+
 static int
 gnn_w2v_word_compare(const void* a, const void* b)
 {
   return ((gnn_w2v_word_t*)b)->count - ((gnn_w2v_word_t*)a)->count;
 }
 
+/*!
+** a leaf of Huffman tree, the count is copied so that sorting needs nothing
+** but the leaves.
+*/
+typedef struct gnn_w2v_leaf_s
+{
+  ullong      count;
+
+  llong       index;
+}
+gnn_w2v_leaf_t;
+
+/*!
+** the leaf order of Huffman tree, by descending count and then by index, so
+** a sorted vocabulary keeps its own order.
+*/
+static int
+gnn_w2v_leaf_compare(const void* a, const void* b)
+{
+  gnn_w2v_leaf_t const* i = (gnn_w2v_leaf_t const*) a;
+  gnn_w2v_leaf_t const* j = (gnn_w2v_leaf_t const*) b;
+  if (i->count != j->count)
+    return i->count < j->count ? 1 : -1;
+  return i->index < j->index ? -1 : (i->index > j->index);
+}
+
+/*!
+** builds the Huffman tree of the words from first on, its inner nodes take the
+** output rows from base on and its root hangs below the given path, a fresh
+** vocabulary starts both at 0 with an empty path.
+*/
 static void
-gnn_w2v_vocab_huffman(gnn_w2v_vocab_t* vocab)
+gnn_w2v_vocab_huffman(gnn_w2v_vocab_t*    vocab,
+                      llong               first,
+                      llong               base,
+                      char const*         prefix_code,
+                      int const*          prefix_point,
+                      int                 prefix_length)
 {
 #ifdef DEBUG
   FILE* jsout = fopen("../../debug.json", "w");
 #endif
   long long a, b, i, min1i, min2i, pos1, pos2, point[GANN_W2V_MAX_CODE_LENGTH];
   char code[GANN_W2V_MAX_CODE_LENGTH];
-  long long* count = (long long *)calloc(vocab->size * 2 + 1, sizeof(long long));
-  long long* binary = (long long *)calloc(vocab->size * 2 + 1, sizeof(long long));
-  long long* parent_node = (long long *)calloc(vocab->size * 2 + 1, sizeof(long long));
-  for (a = 0; a < vocab->size; a++)
+  long long size = vocab->size - first;
+  gnn_w2v_word_t* word;
+  long long* count = (long long *)calloc(size * 2 + 1, sizeof(long long));
+  long long* binary = (long long *)calloc(size * 2 + 1, sizeof(long long));
+  long long* parent_node = (long long *)calloc(size * 2 + 1, sizeof(long long));
+  gnn_w2v_leaf_t* order = (gnn_w2v_leaf_t*) malloc(size * sizeof(gnn_w2v_leaf_t));
+  if (count == NULL || binary == NULL || parent_node == NULL || order == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for huffman tree in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+
+  /*!
+  ** the two-queue construction needs the leaves sorted by count, a grown
+  ** vocabulary appends its new words unsorted, and </s> of a fresh tree stays
+  ** the first
+  */
+  for (a = 0; a < size; a++)
   {
-    count[a] = vocab->words[a].count;
+    order[a].count = vocab->words[first + a].count;
+    order[a].index = first + a;
+  }
+  if (first == 0 && size > 2)
+    qsort(order + 1, size - 1, sizeof(gnn_w2v_leaf_t), gnn_w2v_leaf_compare);
+  else if (first > 0 && size > 1)
+    qsort(order, size, sizeof(gnn_w2v_leaf_t), gnn_w2v_leaf_compare);
+  for (a = 0; a < size; a++)
+  {
+    count[a] = order[a].count;
 #ifdef DEBUG
     fprintf(jsout, "SetCount(%d, %d, 0);\n", a, count[a]);
 #endif
   }
-  for (a = vocab->size; a < vocab->size * 2; a++)
+  for (a = size; a < size * 2; a++)
   {
     count[a] = 1e15;
 #ifdef DEBUG
     fprintf(jsout, "SetCount(%d, '-', 1);\n",a);
 #endif
   }
-  pos1 = vocab->size - 1;
-  pos2 = vocab->size;
+  pos1 = size - 1;
+  pos2 = size;
 #ifdef DEBUG
   fprintf(jsout, "SetPos1(%d)\n",pos1);
   fprintf(jsout, "SetPos2(%d)\n",pos2);
 #endif
   // following algorithm constructs the Huffman tree by adding one node at a time
-  for (a = 0; a < vocab->size - 1; a++) {
+  for (a = 0; a < size - 1; a++) {
     // first, find two smallest nodes 'min1, min2'
     if (pos1 >= 0) {
       if (count[pos1] < count[pos2])
@@ -141,54 +243,95 @@ gnn_w2v_vocab_huffman(gnn_w2v_vocab_t* vocab)
       fprintf(jsout, "SetPos2(%d)\n",pos2);
 #endif
     }
-    count[vocab->size + a] = count[min1i] + count[min2i];
-    parent_node[min1i] = vocab->size + a;
-    parent_node[min2i] = vocab->size + a;
+    count[size + a] = count[min1i] + count[min2i];
+    parent_node[min1i] = size + a;
+    parent_node[min2i] = size + a;
     binary[min2i] = 1;
 #ifdef DEBUG
-    fprintf(jsout, "SetCount(%d, %d, 2)\n", vocab->size + a, count[vocab->size + a]);
+    fprintf(jsout, "SetCount(%d, %d, 2)\n", size + a, count[size + a]);
     fprintf(jsout, "SetParent(%d, %d)\n", min1i, parent_node[min1i]);
     fprintf(jsout, "SetParent(%d, %d)\n",min2i, parent_node[min2i]);
     fprintf(jsout, "SetBinary(%d, %d);\n\n", min2i, binary[min2i]);
 #endif
   }
 
-  for (a = 0; a < vocab->size; a++)
+  for (a = 0; a < size; a++)
   {
+    word = &vocab->words[order[a].index];
     b = a;
     i = 0;
-    while (1)
+    while (size > 1)
     {
       code[i] = binary[b];
       point[i] = b;
       i++;
       b = parent_node[b];
-      if (b == vocab->size * 2 - 2) break;
+      if (b == size * 2 - 2) break;
     }
-    vocab->words[a].codelen = i;
-    vocab->words[a].point[0] = vocab->size - 2;
+    if (prefix_length + i >= GANN_W2V_MAX_CODE_LENGTH || prefix_length + i > CHAR_MAX)
+    {
+      fprintf(stderr, "error: the huffman code of '%s' is too long.\n", word->word);
+      exit(1);
+    }
+    if (prefix_length > 0)
+    {
+      memcpy(word->code, prefix_code, prefix_length);
+      memcpy(word->point, prefix_point, prefix_length * sizeof(int));
+    }
+    word->codelen = prefix_length + i;
+    if (i == 0)
+      continue;
+    word->point[prefix_length] = base + size - 2;
     for (b = 0; b < i; b++)
     {
-      vocab->words[a].code[i - b - 1] = code[b];
-      vocab->words[a].point[i - b] = point[b] - vocab->size;
+      word->code[prefix_length + i - b - 1] = code[b];
+      word->point[prefix_length + i - b] = base + point[b] - size;
     }
   }
 
-  FILE* pout = fopen("../../parent.txt", "w");
-  for (a = 0; a < vocab->size * 2 - 2; a++)
-  {
-    fprintf(pout, "%d = %lld = %lld\n", a, parent_node[a], count[a]);
-  }
-  fclose(pout);
-
   free(count);
   free(binary);
   free(parent_node);
+  free(order);
 #ifdef DEBUG
   fclose(jsout);
 #endif
 }
 
+/*!
+** hangs the words appended from first on below the leaf of </s>, which turns
+** into a new inner node, so the known words keep their paths and the output
+** rows trained on them. </s> is never a target of the training and a fresh
+** tree puts it close to the root.
+*/
+static void
+gnn_w2v_vocab_huffman_extend(gnn_w2v_vocab_t* vocab, llong first)
+{
+  gnn_w2v_word_t* end = &vocab->words[0];
+  char code[GANN_W2V_MAX_CODE_LENGTH];
+  int point[GANN_W2V_MAX_CODE_LENGTH];
+  int length = end->codelen;
+
+  if (length + 1 >= GANN_W2V_MAX_CODE_LENGTH || length + 1 > CHAR_MAX)
+  {
+    fprintf(stderr, "error: the huffman code of '%s' is too long.\n", end->word);
+    exit(1);
+  }
+
+  /*!
+  ** the new inner node takes the row after the known ones, and the inner
+  ** nodes of the new words follow it
+  */
+  memcpy(code, end->code, length);
+  memcpy(point, end->point, length * sizeof(int));
+  code[length] = 1;
+  point[length] = first - 1;
+  end->code[length] = 0;
+  end->point[length] = first - 1;
+  end->codelen = length + 1;
+  gnn_w2v_vocab_huffman(vocab, first, first, code, point, length + 1);
+}
+
 //static void
 //gnn_w2v_cbow_train(gnn_w2v_vocab_t* vocab, float* neurons, int neuron_size)
 //{
@@ -532,7 +675,13 @@ gnn_w2v_vocab_unigram(gnn_w2v_vocab_t* vocab)
   int a, i;
   long long train_words_pow = 0;
   float d1, power = 0.75;
+  free(vocab->unigram);
   vocab->unigram = (int*) malloc(table_size * sizeof(int));
+  if (vocab->unigram == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for unigram table in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
   for (a = 0; a < vocab->size; a++)
     train_words_pow += pow(vocab->words[a].count, power);
   i = 0;
@@ -554,6 +703,7 @@ int
 gnn_w2v_vocab_add(gnn_w2v_vocab_t* vocab, char* word, int is_non_comp) {
   unsigned int hash, length = strlen(word) + 1, len, i, pos;
 
+  memset(&vocab->words[vocab->size], 0, sizeof(gnn_w2v_word_t));
   vocab->words[vocab->size].word = (char *)calloc(length, sizeof(char));
   strcpy(vocab->words[vocab->size].word, word);
   vocab->words[vocab->size].utf8len = gfc_utf8_length(word);
@@ -562,10 +712,15 @@ gnn_w2v_vocab_add(gnn_w2v_vocab_t* vocab, char* word, int is_non_comp) {
   vocab->size++;
 
   // reallocate memory if needed
-  if (vocab->size + 2 >= vocab_max_size)
+  if (vocab->size + 2 >= vocab->max_size)
   {
-    vocab_max_size += 1000;
-    vocab->words = (gnn_w2v_word_t *)realloc(vocab->words, vocab_max_size * sizeof(gnn_w2v_word_t));
+    vocab->max_size += vocab_max_size;
+    vocab->words = (gnn_w2v_word_t *)realloc(vocab->words, vocab->max_size * sizeof(gnn_w2v_word_t));
+    if (vocab->words == NULL)
+    {
+      fprintf(stderr, "error: failed to allocate memories for words in %d of %s.\n", __LINE__, __FILE__);
+      exit(1);
+    }
   }
   hash = gnn_w2v_word_hash(word);
   while (vocab->hashes[hash] != -1) hash = (hash + 1) % vocab_hash_size;
@@ -596,44 +751,234 @@ gnn_w2v_vocab_sort(gnn_w2v_vocab_t* vocab) {
     }
   }
   vocab->words = (gnn_w2v_word_t *) realloc(vocab->words, (vocab->size + 1) * sizeof(gnn_w2v_word_t));
-  // Allocate memory for the binary tree construction
+  vocab->max_size = vocab->size + 1;
+}
+
+/*!
+** decodes one UTF-8 code point and advances the pointer.
+*/
+static int
+gnn_w2v_utf8_next(const unsigned char** p)
+{
+  const unsigned char* s = *p;
+  int ret;
+  if (s[0] < 0x80)
+  {
+    ret = s[0];
+    *p += 1;
+  }
+  else if ((s[0] & 0xE0) == 0xC0 && s[1])
+  {
+    ret = ((s[0] & 0x1F) << 6) | (s[1] & 0x3F);
+    *p += 2;
+  }
+  else if ((s[0] & 0xF0) == 0xE0 && s[1] && s[2])
+  {
+    ret = ((s[0] & 0x0F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+    *p += 3;
+  }
+  else if ((s[0] & 0xF8) == 0xF0 && s[1] && s[2] && s[3])
+  {
+    ret = ((s[0] & 0x07) << 18) | ((s[1] & 0x3F) << 12) | ((s[2] & 0x3F) << 6) | (s[3] & 0x3F);
+    *p += 4;
+  }
+  else
+  {
+    ret = -1;
+    *p += 1;
+  }
+  return ret;
+}
+
+int
+gnn_w2v_characters(const char* word, int* ids, int max_size)
+{
+  const unsigned char* p = (const unsigned char*) word;
+  int len = gfc_utf8_length(word);
+  int i = 0, ret = 0, ch, pos;
+
+  if (!cwe_type) return 0;
+  while (*p && ret < max_size)
+  {
+    ch = gnn_w2v_utf8_next(&p);
+    if (ch >= GANN_W2V_MIN_CHINESE && ch <= GANN_W2V_MAX_CHINESE)
+    {
+      if (cwe_type == 2)
+      {
+        // s, b, e, m
+        if (len == 1) pos = 0;
+        else if (i == 0) pos = 1;
+        else if (i == len - 1) pos = 2;
+        else pos = 3;
+        ids[ret++] = (ch - GANN_W2V_MIN_CHINESE) * GANN_W2V_CHAR_POSITIONS + pos;
+      }
+      else
+        ids[ret++] = ch - GANN_W2V_MIN_CHINESE;
+    }
+    i++;
+  }
+  return ret;
+}
+
+void
+gnn_w2v_vocab_characters(gnn_w2v_vocab_t* vocab)
+{
+  int ids[GANN_W2V_MAX_STRING];
+  llong a, total = 0;
+  int n;
+
   for (a = 0; a < vocab->size; a++)
+    total += gnn_w2v_characters(vocab->words[a].word, ids, GANN_W2V_MAX_STRING);
+
+  free(vocab->characters);
+  vocab->characters = (int*) malloc((total + 1) * sizeof(int));
+  if (vocab->characters == NULL)
   {
-    vocab->words[a].code = (char *)calloc(GANN_W2V_MAX_CODE_LENGTH, sizeof(char));
-    vocab->words[a].point = (int *)calloc(GANN_W2V_MAX_CODE_LENGTH, sizeof(int));
+    fprintf(stderr, "error: failed to allocate memories for characters in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  total = 0;
+  for (a = 0; a < vocab->size; a++)
+  {
+    n = gnn_w2v_characters(vocab->words[a].word, vocab->characters + total, GANN_W2V_MAX_STRING);
+    vocab->words[a].character = vocab->characters + total;
+    vocab->words[a].character_size = n;
+    total += n;
+  }
+
+  if (!cwe_type)
+    vocab->char_size = 0;
+  else
+    vocab->char_size = (GANN_W2V_MAX_CHINESE - GANN_W2V_MIN_CHINESE + 1) *
+                       (cwe_type == 2 ? GANN_W2V_CHAR_POSITIONS : 1);
+}
+
+int
+gnn_w2v_subwords(const char* word, int* ids, int max_size, uint bucket_size)
+{
+  char buf[GANN_W2V_MAX_STRING + 2];
+  int starts[GANN_W2V_MAX_STRING + 3];
+  const unsigned char* p;
+  int len, ret = 0, i, j, n;
+  uint hash;
+
+  if (bucket_size == 0) return 0;
+
+  /*!
+  ** the boundary symbols tell prefixes and suffixes from the inner n-grams
+  */
+  len = snprintf(buf, sizeof(buf), "<%s>", word);
+  if (len >= (int) sizeof(buf)) len = sizeof(buf) - 1;
+  p = (const unsigned char*) buf;
+  n = 0;
+  while (*p)
+  {
+    starts[n++] = (const char*) p - buf;
+    gnn_w2v_utf8_next(&p);
+  }
+  starts[n] = (const char*) p - buf;
+
+  for (i = 0; i < n; i++)
+  {
+    // fnv-1a over the bytes
+    hash = 2166136261u;
+    for (j = 1; j <= GANN_W2V_MAX_NGRAM && i + j <= n; j++)
+    {
+      const unsigned char* b = (const unsigned char*) buf + starts[i + j - 1];
+      const unsigned char* e = (const unsigned char*) buf + starts[i + j];
+      while (b < e)
+      {
+        hash ^= *b++;
+        hash *= 16777619u;
+      }
+      if (j < GANN_W2V_MIN_NGRAM) continue;
+      // the whole word has its own vector
+      if (j == n) continue;
+      if (ret >= max_size) return ret;
+      ids[ret++] = hash % bucket_size;
+    }
   }
+  return ret;
+}
+
+void
+gnn_w2v_vocab_subwords(gnn_w2v_vocab_t* vocab, uint bucket_size)
+{
+  int ids[GANN_W2V_MAX_SUBWORDS];
+  llong a, total = 0;
+  int n;
+
+  /*!
+  ** the sentence end (index 0) has no subwords
+  */
+  for (a = 1; a < vocab->size; a++)
+    total += gnn_w2v_subwords(vocab->words[a].word, ids, GANN_W2V_MAX_SUBWORDS, bucket_size);
+
+  free(vocab->subwords);
+  vocab->subwords = (int*) malloc((total + 1) * sizeof(int));
+  if (vocab->subwords == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for subwords in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  vocab->words[0].subword = vocab->subwords;
+  vocab->words[0].subword_size = 0;
+  total = 0;
+  for (a = 1; a < vocab->size; a++)
+  {
+    n = gnn_w2v_subwords(vocab->words[a].word, vocab->subwords + total, GANN_W2V_MAX_SUBWORDS, bucket_size);
+    vocab->words[a].subword = vocab->subwords + total;
+    vocab->words[a].subword_size = n;
+    total += n;
+  }
+  vocab->bucket_size = bucket_size;
 }
 
 gnn_w2v_vocab_t*
-gnn_w2v_read(const char* train_file_path)
+gnn_w2v_vocab_new(void)
 {
-  char            word[GANN_W2V_MAX_STRING];
-  FILE*           fin;
-  llong           a, i;
-  llong           train_words = 0;
+  llong a;
 
   /*!
   ** 初始化词汇表, UTF-8编码
   */
   gnn_w2v_vocab_t* vocab = (gnn_w2v_vocab_t*) calloc(1, sizeof(gnn_w2v_vocab_t));
-  vocab->words = (gnn_w2v_word_t *)calloc(vocab_max_size, sizeof(gnn_w2v_word_t));
+  if (vocab == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for vocabulary in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  vocab->max_size = vocab_max_size;
+  vocab->words = (gnn_w2v_word_t *)calloc(vocab->max_size, sizeof(gnn_w2v_word_t));
   vocab->hashes = calloc(vocab_hash_size, sizeof(uint));
-  vocab->size = 0;
-  for (a = 0; a < vocab_hash_size; a++)
-    vocab->hashes[a] = -1;
-
-  fin = fopen(train_file_path, "rb");
-  if (fin == NULL)
+  if (vocab->words == NULL || vocab->hashes == NULL)
   {
-    fprintf(stderr, "ERROR: training data file '%s' not found!\n", train_file_path);
+    fprintf(stderr, "error: failed to allocate memories for vocabulary in %d of %s.\n", __LINE__, __FILE__);
     exit(1);
   }
+  vocab->size = 0;
+  for (a = 0; a < vocab_hash_size; a++)
+    vocab->hashes[a] = -1;
 
   /*!
   ** 首个词汇永远是</s>
   */
   gnn_w2v_vocab_add(vocab, (char *)"</s>", 0);
-//  if (strlen(non_comp)) LearnNonCompWord();
+  return vocab;
+}
+
+/*!
+** counts the words of a text into the vocabulary, the unseen words are
+** appended.
+**
+** @return the number of words read
+*/
+static llong
+gnn_w2v_vocab_count(gnn_w2v_vocab_t* vocab, FILE* fin)
+{
+  char            word[GANN_W2V_MAX_STRING];
+  llong           a, i;
+  llong           train_words = 0;
 
   while (1)
   {
@@ -659,119 +1004,251 @@ gnn_w2v_read(const char* train_file_path)
     word[0] = '\0';
 //    if (vocab->size > vocab_hash_size * 0.7) ReduceVocab();
   }
+#ifdef DEBUG
+  fprintf(stdout, "Words in train file: %lld\n", train_words);
+#endif
+  return train_words;
+}
+
+void
+gnn_w2v_vocab_build(gnn_w2v_vocab_t* vocab)
+{
+  llong a, first = vocab->size;
+
+  // Allocate memory for the binary tree construction
+  for (a = 0; a < vocab->size; a++)
+  {
+    if (vocab->words[a].code != NULL)
+      continue;
+    if (first == vocab->size)
+      first = a;
+    vocab->words[a].code = (char *)calloc(GANN_W2V_MAX_CODE_LENGTH, sizeof(char));
+    vocab->words[a].point = (int *)calloc(GANN_W2V_MAX_CODE_LENGTH, sizeof(int));
+    if (vocab->words[a].code == NULL || vocab->words[a].point == NULL)
+    {
+      fprintf(stderr, "error: failed to allocate memories for huffman codes in %d of %s.\n", __LINE__, __FILE__);
+      exit(1);
+    }
+  }
+  gnn_w2v_vocab_unigram(vocab);
 
+  /*!
+  ** the words with codes keep them, the output rows of hierarchical softmax
+  ** are trained on their paths
+  */
+  if (first == 0)
+    gnn_w2v_vocab_huffman(vocab, 0, 0, NULL, NULL, 0);
+  else if (first < vocab->size)
+    gnn_w2v_vocab_huffman_extend(vocab, first);
+  gnn_w2v_vocab_characters(vocab);
+  if (vocab->bucket_size > 0)
+    gnn_w2v_vocab_subwords(vocab, vocab->bucket_size);
+}
+
+gnn_w2v_vocab_t*
+gnn_w2v_read(const char* train_file_path)
+{
+  FILE*           fin;
+
+  fin = fopen(train_file_path, "rb");
+  if (fin == NULL)
+  {
+    fprintf(stderr, "ERROR: training data file '%s' not found!\n", train_file_path);
+    exit(1);
+  }
+
+  gnn_w2v_vocab_t* vocab = gnn_w2v_vocab_new();
+//  if (strlen(non_comp)) LearnNonCompWord();
+  gnn_w2v_vocab_count(vocab, fin);
 
 #ifdef DEBUG
   fprintf(stdout, "Vocab size: %lld\n", vocab->size);
-  fprintf(stdout, "Words in train file: %lld\n", train_words);
 #endif
   fclose(fin);
 
-  gnn_w2v_vocab_unigram(vocab);
+  // the unigram table is built on the sorted ids
   gnn_w2v_vocab_sort(vocab);
-  gnn_w2v_vocab_huffman(vocab);
+  gnn_w2v_vocab_build(vocab);
   return vocab;
 }
 
-void
-gnn_w2v_skipgram(const char*            text_path,
-                 gnn_w2v_vocab_t*       vocab,
-                 uint                   sample,
-                 uint                   window)
+llong
+gnn_w2v_vocab_grow(gnn_w2v_vocab_t* vocab, const char* train_file_path)
 {
-  uint i = 0;
-  uint a, b, c, d;
-  long long l1, l2, target, label;
-  uint sentence_length = 0;
-  uint sentence_position = 0;
-  uint local_iter = 100;
-  uint word_index;
-  uint negative = 3;
-  uint last_word;
-  ullong next_random;
-  ullong train_words = 0;
-  ullong sen[GANN_W2V_MAX_SENTENCE_LENGTH];
-  real f, g;
-  int hierarchical_softmax = 1;
-  real learning_rate = 0.003;
-
-  uint feature_size = 300;
-  gnn_w2v_t* w2v = gnn_w2v_new(vocab, feature_size);
-
-  // Allocate the table, 1000 floats.
-  real* expTable = (real *)malloc((EXP_TABLE_SIZE + 1) * sizeof(real));
+  FILE*           fin;
+  llong           size = vocab->size;
 
-    // For each position in the table...
-  for (i = 0; i < EXP_TABLE_SIZE; i++)
+  fin = fopen(train_file_path, "rb");
+  if (fin == NULL)
   {
-    expTable[i] = exp((i / (real)EXP_TABLE_SIZE * 2 - 1) * MAX_EXP);
-    expTable[i] = expTable[i] / (expTable[i] + 1);
+    fprintf(stderr, "error: training data file '%s' not found.\n", train_file_path);
+    return -1;
   }
 
-  for (i = 0; i < vocab->size; i++)
-    train_words += vocab->words[i].count;
+  /*!
+  ** the known words keep their ids and their Huffman paths, so the trained
+  ** rows stay valid, the new words are appended below the tree
+  */
+  gnn_w2v_vocab_count(vocab, fin);
+  fclose(fin);
+  gnn_w2v_vocab_build(vocab);
+  return vocab->size - size;
+}
 
-  FILE *fi = fopen(text_path, "rb");
-  fseek(fi, 0, SEEK_SET);
+void
+gnn_w2v_vocab_free(gnn_w2v_vocab_t* vocab)
+{
+  llong a;
 
-  i = 0;
-  char word[128] = {'\0'};
-  while(1)
+  if (vocab == NULL) return;
+  for (a = 0; a < vocab->size; a++)
   {
-    if (sentence_length == 0)
-    {
-      while(1)
-      {
-        gnn_w2v_word_read(word, fi);
-
-        word_index = gnn_w2v_word_index(vocab, word);
-//        printf("%d = %s\n", word_index, word);
-
-        if (feof(fi)) break;
-        if (word_index == -1) continue;
-//        if (word_index == 0 /* skip '<s/>' */) break;
+    free(vocab->words[a].word);
+    free(vocab->words[a].code);
+    free(vocab->words[a].point);
+  }
+  free(vocab->words);
+  free(vocab->hashes);
+  free(vocab->unigram);
+  free(vocab->characters);
+  free(vocab->subwords);
+  free(vocab);
+}
 
-        if (sample > 0)
-        {
-          real ran = (sqrt(vocab->words[word_index].count / (sample * vocab->size)) + 1) * (sample * train_words) / vocab->words[word_index].count;
-          next_random = next_random * (unsigned long long)25214903917 + 11;
-          if (ran < (next_random & 0xFFFF) / (real)65536) continue;
-        }
-        sen[sentence_length] = word_index;
-        sentence_length++;
-        if (sentence_length >= GANN_W2V_MAX_SENTENCE_LENGTH) break;
-      }
-      sentence_position = 0;
-    }
-    if (feof(fi))
+/*!
+** draws the random window and the negative samples of the word at position
+** ahead of its training, and prefetches every row it is going to touch, so
+** the DRAM misses overlap the math of the word before.
+**
+** @param negatives
+**        the output, negative samples of the context at window offset a
+**        start at a * negative
+**
+** @return the window reduction b
+*/
+static llong
+gnn_w2v_skipgram_ahead(gnn_w2v_train_params_t const*  params,
+                       const int*                     sen,
+                       llong                          sentence_length,
+                       llong                          position,
+                       gnn_rng_t*                     rng,
+                       llong*                         negatives)
+{
+  gnn_w2v_t const* w2v = params->w2v;
+  gnn_w2v_vocab_t const* vocab = params->vocab;
+  gnn_w2v_word_t const* word = &vocab->words[sen[position]];
+  uint feature_size = w2v->dim_num;
+  uint window = params->window;
+  uint negative = params->negative;
+  llong a, b, c, d, target;
+  ullong r;
+
+  b = gnn_rng_next(rng) % window;
+
+  gnn_vec_prefetch(w2v->negative_samplings + (llong) sen[position] * feature_size, feature_size);
+  if (params->hierarchical_softmax)
+    for (d = 0; d < word->codelen; d++)
+      gnn_vec_prefetch(w2v->output_weights + (llong) word->point[d] * feature_size, feature_size);
+
+  for (a = b; a < window * 2 + 1 - b; a++)
+  {
+    if (a == window) continue;
+    c = position - window + a;
+    if (c < 0 || c >= sentence_length) continue;
+    gnn_vec_prefetch(w2v->hidden_weights + (llong) sen[c] * feature_size, feature_size);
+    for (d = 0; d < negative; d++)
     {
-      local_iter--;
-      if (local_iter == 0)
-      {
-        break;
-      }
-//      sentence_length = 0;
-      fseek(fi, 0, SEEK_SET);
-//      continue;
+      r = gnn_rng_next(rng);
+      target = vocab->unigram[(r >> 16) % table_size];
+      if (target == 0) target = r % (vocab->size - 1) + 1;
+      negatives[a * negative + d] = target;
+      gnn_vec_prefetch(w2v->negative_samplings + target * feature_size, feature_size);
     }
+  }
+  return b;
+}
 
-    word_index = sen[sentence_position];
-
-    if (word_index == -1) continue;
-
-    for (c = 0; c < feature_size; c++) w2v->hidden_neurons[c] = 0;
-    for (c = 0; c < feature_size; c++) w2v->hidden_neurons[c] = 0;
+/*!
+** trains the skip-gram pairs of the sentences popped from the reader, the
+** threads update the shared weights without locks (hogwild).
+*/
+static void*
+gnn_w2v_skipgram_thread(void* data)
+{
+  gnn_w2v_train_params_t* params = (gnn_w2v_train_params_t*) data;
+  gnn_w2v_t* w2v = params->w2v;
+  gnn_w2v_vocab_t* vocab = params->vocab;
+  uint feature_size = w2v->dim_num;
+  uint window = params->window;
+  llong a, b, c, d, l1, l2, target, label;
+  llong sentence_length, sentence_position;
+  llong word_index, last_word, n;
+  gnn_rng_t* rng = &params->rng;
+  real g;
+  real learning_rate = params->alpha;
+  real char_rate;
+  real* neu1e;
+  real* composed;
+  const real* input;
+  gnn_w2v_word_t* context;
+  int* sen;
+  llong* targets;
+  int* labels;
+  real* fs;
+  real* sigmoids;
+  llong* ahead[2];
+  llong* negatives;
+  llong bs[2];
+  ullong position = params->id;
 
-    next_random = next_random * (unsigned long long)25214903917 + 11;
-    b = next_random % window;
+  /*!
+  ** the outputs of one (input, targets) batch, the longest batch is a
+  ** Huffman path or the negative samples plus one
+  */
+  n = GANN_W2V_MAX_CODE_LENGTH > params->negative + 1 ? GANN_W2V_MAX_CODE_LENGTH : params->negative + 1;
+  sen = (int*) malloc(GANN_W2V_MAX_SENTENCE_LENGTH * sizeof(int));
+  targets = (llong*) malloc(n * sizeof(llong));
+  labels = (int*) malloc(n * sizeof(int));
+  fs = (real*) malloc(n * sizeof(real));
+  sigmoids = (real*) malloc(n * sizeof(real));
+  ahead[0] = (llong*) malloc(((llong) window * 2 + 1) * (params->negative + 1) * sizeof(llong));
+  ahead[1] = (llong*) malloc(((llong) window * 2 + 1) * (params->negative + 1) * sizeof(llong));
+  if (ahead[0] == NULL || ahead[1] == NULL ||
+      sen == NULL || targets == NULL || labels == NULL || fs == NULL || sigmoids == NULL ||
+      posix_memalign((void **)&neu1e, 128, feature_size * sizeof(real)) != 0 ||
+      posix_memalign((void **)&composed, 128, feature_size * sizeof(real)) != 0)
+  {
+    fprintf(stderr, "error: failed to allocate memories for training thread in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
 
+  /*!
+  ** the sentences of a thread are fixed by its id, so its samples are the
+  ** same on every run
+  */
+  while ((sentence_length = gnn_w2v_reader_take(params->reader, &position, params->thread_num, sen)) > 0)
+  {
     /*!
-    ** sliding window algorithm
+    ** the samples of the next word are drawn and prefetched while the
+    ** current word trains, and the two sample buffers take turns
     */
-    for (a = b; a < window * 2 + 1 - b; a++)
+    bs[0] = gnn_w2v_skipgram_ahead(params, sen, sentence_length, 0, rng, ahead[0]);
+    for (sentence_position = 0; sentence_position < sentence_length; sentence_position++)
     {
-      if (a != window)
+      word_index = sen[sentence_position];
+      b = bs[sentence_position & 1];
+      negatives = ahead[sentence_position & 1];
+      if (sentence_position + 1 < sentence_length)
+        bs[(sentence_position + 1) & 1] = gnn_w2v_skipgram_ahead(params, sen, sentence_length,
+                                                                 sentence_position + 1, rng,
+                                                                 ahead[(sentence_position + 1) & 1]);
+
+      /*!
+      ** sliding window algorithm
+      */
+      for (a = b; a < window * 2 + 1 - b; a++)
       {
+        if (a == window) continue;
 
         // Convert the window offset 'a' into an index 'c' into the sentence
         // array.
@@ -783,45 +1260,48 @@ gnn_w2v_skipgram(const char*            text_path,
         // Get the context word. That is, get the id of the word (its index in
         // the vocab table).
         last_word = sen[c];
-//        printf("last word = %d\n", last_word);
-        // At this point we have two words identified:
-        //   'word' - The word at our current position in the sentence (in the
-        //            center of a context window).
-        //   'last_word' - The word at a position within the context window.
-
-        // Verify that the word exists in the vocab (I don't think this should
-        // ever be the case?)
-        if (last_word == -1) continue;
-        if (word_index >= vocab->size) continue;
-//        printf("(%d, %d)\n", word_index, last_word);
-//        printf("(%s, %s)\n", vocab->words[word_index].word, vocab->words[last_word].word);
 
         // Calculate the index of the start of the weights for 'last_word'.
         l1 = last_word * feature_size;
 
-        for (c = 0; c < feature_size; c++) w2v->hidden_neurons[c] = 0;
+        for (c = 0; c < feature_size; c++) neu1e[c] = 0;
+
+        /*!
+        ** the input of a word with subwords is the mean of its word vector
+        ** and subword vectors, and the input of a word with Chinese
+        ** characters is further averaged with its mean character vector (CWE).
+        */
+        context = &vocab->words[last_word];
+        input = w2v->hidden_weights + l1;
+        if ((w2v->char_size > 0 && context->character_size > 0) ||
+            (w2v->bucket_size > 0 && context->subword_size > 0))
+        {
+          gnn_w2v_vector(w2v, vocab, last_word, composed);
+          input = composed;
+        }
 
         // HIERARCHICAL SOFTMAX
-        if (hierarchical_softmax)
+        // The dot products of all inner nodes on the path are computed
+        // first, so the sigmoid runs once over the whole path.
+        if (params->hierarchical_softmax)
         {
-          for (d = 0; d < vocab->words[word_index].codelen; d++)
+          n = vocab->words[word_index].codelen;
+          for (d = 0; d < n; d++)
           {
-            f = 0;
-            l2 = vocab->words[word_index].point[d] * feature_size;
+            l2 = (llong) vocab->words[word_index].point[d] * feature_size;
             // Propagate hidden -> output
-            for (c = 0; c < feature_size; c++)
-              f += w2v->hidden_weights[c + l1] * w2v->output_weights[c + l2];
-            if (f <= -MAX_EXP) continue;
-            else if (f >= MAX_EXP) continue;
-            else f = expTable[(int)((f + MAX_EXP) * (EXP_TABLE_SIZE / MAX_EXP / 2))];
+            fs[d] = gnn_vec_dot(input, w2v->output_weights + l2, feature_size);
+          }
+          gnn_vec_sigmoid(sigmoids, fs, n);
+          for (d = 0; d < n; d++)
+          {
+            if (fs[d] <= -MAX_EXP || fs[d] >= MAX_EXP) continue;
+            l2 = (llong) vocab->words[word_index].point[d] * feature_size;
             // 'g' is the gradient multiplied by the learning rate
-            g = (1 - vocab->words[word_index].code[d] - f) * learning_rate;
-            // Propagate errors output -> hidden
-            for (c = 0; c < feature_size; c++)
-              w2v->hidden_neurons[c] += g * w2v->output_weights[c + l2];
-            // Learn weights hidden -> output
-            for (c = 0; c < feature_size; c++)
-              w2v->output_weights[c + l2] += g * w2v->hidden_weights[c + l1];
+            g = (1 - vocab->words[word_index].code[d] - sigmoids[d]) * learning_rate;
+            // Propagate errors output -> hidden, and learn weights hidden ->
+            // output, in one pass over the row
+            gnn_vec_fused_axpy(neu1e, w2v->output_weights + l2, g, input, feature_size);
           }
         }
 
@@ -831,9 +1311,10 @@ gnn_w2v_skipgram(const char*            text_path,
         // is given by 'negative').
         // These words are selected using a "unigram" distribution, which is generated
         // in the function InitUnigramTable
-        if (negative > 0)
+        if (params->negative > 0)
         {
-          for (d = 0; d < negative + 1; d++)
+          n = 0;
+          for (d = 0; d < params->negative + 1; d++)
           {
             // On the first iteration, we're going to train the positive sample.
             if (d == 0)
@@ -842,19 +1323,9 @@ gnn_w2v_skipgram(const char*            text_path,
               label = 1;
             // On the other iterations, we'll train the negative samples.
             } else {
-              // Pick a random word to use as a 'negative sample'; do this using
-              // the unigram table.
-
-              // Get a random integer.
-              next_random = next_random * (unsigned long long)25214903917 + 11;
-
-              // 'target' becomes the index of the word in the vocab to use as
-              // the negative sample.
-              target = vocab->unigram[(next_random >> 16) % table_size];
-
-              // If the target is the special end of sentence token, then just
-              // pick a random word from the vocabulary instead.
-              if (target == 0) target = next_random % (vocab->size - 1) + 1;
+              // 'target' is the negative sample drawn from the unigram
+              // table ahead of time, and its row is already prefetched.
+              target = negatives[a * params->negative + d - 1];
 
               // Don't use the positive sample as a negative sample!
               if (target == word_index) continue;
@@ -862,49 +1333,29 @@ gnn_w2v_skipgram(const char*            text_path,
               // Mark this as a negative example.
               label = 0;
             }
-
+            targets[n] = target;
+            labels[n] = label;
             // Get the index of the target word in the output layer.
-            l2 = target * feature_size;
-            printf("l1 = %lld, l2 = %lld\n", l1, l2);
-            /*!
-            ** At this point, our two words are represented by their index into
-            ** the layer weights.
-            ** l1 - The index of our input word within the hidden layer weights.
-            ** l2 - The index of our output word within the output layer weights.
-            ** label - Whether this is a positive (1) or negative (0) example.
-            **
-            ** Calculate the dot-product between the input words weights (in
-            ** syn0) and the output word's weights (in syn1neg).
-            ** Note that this calculates the dot-product manually using a for
-            ** loop over the vector elements!
-            */
-            f = 0;
-            for (c = 0; c < feature_size; c++)
-              f += w2v->hidden_weights[c + l1] * w2v->negative_samplings[c + l2];
-
-            // This block does two things:
-            //   1. Calculates the output of the network for this training
-            //      pair, using the expTable to evaluate the output layer
-            //      activation function.
-            //   2. Calculate the error at the output, stored in 'g', by
-            //      subtracting the network output from the desired output,
-            //      and finally multiply this by the learning rate.
-            if (f > MAX_EXP) g = (label - 1) * learning_rate;
-            else if (f < -MAX_EXP) g = (label - 0) * learning_rate;
-            else g = (label - expTable[(int)((f + MAX_EXP) * (EXP_TABLE_SIZE / MAX_EXP / 2))]) * learning_rate;
-
-            // Multiply the error by the output layer weights.
-            // Accumulate these gradients over the negative samples and the one
-            // positive sample.
-            for (c = 0; c < feature_size; c++)
-              w2v->hidden_neurons[c] += g * w2v->negative_samplings[c + l2];
-
-            // Update the output layer weights by multiplying the output error
-            // by the hidden layer weights.
-            for (c = 0; c < feature_size; c++)
-              w2v->hidden_weights[c + l2] += g * w2v->hidden_weights[c + l1];
+            fs[n] = gnn_vec_dot(input, w2v->negative_samplings + target * feature_size, feature_size);
+            n++;
           }
-        } // if (negative > 0)
+
+          // The K + 1 outputs go through the sigmoid at once.
+          gnn_vec_sigmoid(sigmoids, fs, n);
+          for (d = 0; d < n; d++)
+          {
+            // Calculate the error at the output, stored in 'g', by
+            // subtracting the network output from the desired output, and
+            // finally multiply this by the learning rate.
+            if (fs[d] > MAX_EXP) g = (labels[d] - 1) * learning_rate;
+            else if (fs[d] < -MAX_EXP) g = (labels[d] - 0) * learning_rate;
+            else g = (labels[d] - sigmoids[d]) * learning_rate;
+
+            // Accumulate the gradients over the negative samples and the one
+            // positive sample, and update the output layer weights.
+            gnn_vec_fused_axpy(neu1e, w2v->negative_samplings + targets[d] * feature_size, g, input, feature_size);
+          }
+        }
 
         /*!
         ** Once the hidden layer gradients for the negative samples plus the
@@ -912,31 +1363,340 @@ gnn_w2v_skipgram(const char*            text_path,
         ** weights.
         ** Note that we do not average the gradient before applying it.
         */
-        for (c = 0; c < feature_size; c++) w2v->hidden_weights[c + l1] += w2v->hidden_neurons[c];
+        gnn_vec_axpy(w2v->hidden_weights + l1, 1, neu1e, feature_size);
+        if (w2v->bucket_size > 0)
+        {
+          // like fastText, every subword row takes the whole error
+          for (c = 0; c < context->subword_size; c++)
+            gnn_vec_axpy(w2v->bucket_weights + (llong) context->subword[c] * feature_size,
+                         1, neu1e, feature_size);
+        }
+        if (w2v->char_size > 0 && context->character_size > 0)
+        {
+          char_rate = 1.0 / context->character_size;
+          for (c = 0; c < context->character_size; c++)
+            gnn_vec_axpy(w2v->char_weights + (llong) context->character[c] * feature_size,
+                         char_rate, neu1e, feature_size);
+        }
       }
     }
-    sentence_position++;
-    if (sentence_position >= sentence_length)
+  }
+  free(sen);
+  free(targets);
+  free(labels);
+  free(fs);
+  free(sigmoids);
+  free(ahead[0]);
+  free(ahead[1]);
+  free(neu1e);
+  free(composed);
+  return NULL;
+}
+
+/*!
+** the background writer of checkpoints, it owns a snapshot of the weights,
+** so the training goes on while the file is written.
+*/
+typedef struct gnn_w2v_writer_s
+{
+  const char*             path;
+
+  gnn_w2v_t               snapshot;
+
+  gnn_w2v_vocab_t const*  vocab;
+
+  gnn_w2v_checkpoint_t    checkpoint;
+
+  pthread_t               thread;
+
+  int                     running;
+}
+gnn_w2v_writer_t;
+
+static void*
+gnn_w2v_writer_run(void* data)
+{
+  gnn_w2v_writer_t* writer = (gnn_w2v_writer_t*) data;
+  gnn_w2v_checkpoint_save(&writer->snapshot, writer->vocab, &writer->checkpoint, writer->path);
+  return NULL;
+}
+
+static void
+gnn_w2v_writer_wait(gnn_w2v_writer_t* writer)
+{
+  if (!writer->running) return;
+  pthread_join(writer->thread, NULL);
+  writer->running = 0;
+}
+
+/*!
+** copies the weights and the state, and starts writing them. The training
+** threads are joined when it is called, so the copy is consistent, and they
+** only start again after it.
+*/
+static void
+gnn_w2v_writer_start(gnn_w2v_writer_t*              writer,
+                     gnn_w2v_t const*               w2v,
+                     gnn_w2v_vocab_t const*         vocab,
+                     gnn_w2v_checkpoint_t const*    checkpoint)
+{
+  gnn_w2v_t* snapshot = &writer->snapshot;
+  size_t size = gnn_w2v_matrix_size(w2v->vocab_size, w2v->dim_num);
+
+  // the disk is slower than one segment, waits for the last checkpoint
+  gnn_w2v_writer_wait(writer);
+  if (writer->checkpoint.rngs == NULL)
+  {
+    *snapshot = *w2v;
+    snapshot->hidden_weights = (real*) gnn_mem_alloc(size, GANN_MEM_DEFAULT, 0);
+    snapshot->output_weights = (real*) gnn_mem_alloc(size, GANN_MEM_DEFAULT, 0);
+    snapshot->negative_samplings = (real*) gnn_mem_alloc(size, GANN_MEM_DEFAULT, 0);
+    snapshot->char_weights = (real*) gnn_mem_alloc(gnn_w2v_matrix_size(w2v->char_size, w2v->dim_num),
+                                                   GANN_MEM_DEFAULT, 0);
+    snapshot->bucket_weights = NULL;
+    if (w2v->bucket_size > 0)
+      snapshot->bucket_weights = (real*) gnn_mem_alloc(gnn_w2v_matrix_size(w2v->bucket_size, w2v->dim_num),
+                                                       GANN_MEM_DEFAULT, 0);
+    writer->checkpoint.rngs = (gnn_rng_t*) malloc(checkpoint->thread_num * sizeof(gnn_rng_t));
+    if (writer->checkpoint.rngs == NULL)
     {
-      sentence_length = 0;
-      continue;
+      fprintf(stderr, "error: failed to allocate memories for checkpoint in %d of %s.\n", __LINE__, __FILE__);
+      exit(1);
+    }
+  }
+
+  memcpy(snapshot->hidden_weights, w2v->hidden_weights, size);
+  memcpy(snapshot->output_weights, w2v->output_weights, size);
+  memcpy(snapshot->negative_samplings, w2v->negative_samplings, size);
+  memcpy(snapshot->char_weights, w2v->char_weights, gnn_w2v_matrix_size(w2v->char_size, w2v->dim_num));
+  if (w2v->bucket_size > 0)
+    memcpy(snapshot->bucket_weights, w2v->bucket_weights, gnn_w2v_matrix_size(w2v->bucket_size, w2v->dim_num));
+  writer->vocab = vocab;
+  writer->checkpoint.alpha = checkpoint->alpha;
+  writer->checkpoint.thread_num = checkpoint->thread_num;
+  writer->checkpoint.reader = checkpoint->reader;
+  memcpy(writer->checkpoint.rngs, checkpoint->rngs, checkpoint->thread_num * sizeof(gnn_rng_t));
+
+  if (pthread_create(&writer->thread, NULL, gnn_w2v_writer_run, writer) != 0)
+  {
+    fprintf(stderr, "error: failed to start checkpoint thread in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  writer->running = 1;
+}
+
+static void
+gnn_w2v_writer_free(gnn_w2v_writer_t* writer)
+{
+  gnn_w2v_t* snapshot = &writer->snapshot;
+  size_t size = gnn_w2v_matrix_size(snapshot->vocab_size, snapshot->dim_num);
+
+  gnn_w2v_writer_wait(writer);
+  if (writer->checkpoint.rngs == NULL) return;
+  gnn_mem_free(snapshot->hidden_weights, size, GANN_MEM_DEFAULT);
+  gnn_mem_free(snapshot->output_weights, size, GANN_MEM_DEFAULT);
+  gnn_mem_free(snapshot->negative_samplings, size, GANN_MEM_DEFAULT);
+  gnn_mem_free(snapshot->char_weights, gnn_w2v_matrix_size(snapshot->char_size, snapshot->dim_num), GANN_MEM_DEFAULT);
+  gnn_mem_free(snapshot->bucket_weights, gnn_w2v_matrix_size(snapshot->bucket_size, snapshot->dim_num), GANN_MEM_DEFAULT);
+  free(writer->checkpoint.rngs);
+}
+
+/*!
+** the state of a new job: the first word of the corpus, and the streams of
+** the random seed, stream 0 is the reader.
+*/
+static void
+gnn_w2v_checkpoint_init(gnn_w2v_checkpoint_t* state)
+{
+  uint i;
+
+  state->alpha = 0.003;
+  state->thread_num = num_threads;
+  state->reader.iteration = 0;
+  state->reader.offset = 0;
+  gnn_rng_init(&state->reader.rng, random_seed, 0);
+  state->rngs = (gnn_rng_t*) malloc(state->thread_num * sizeof(gnn_rng_t));
+  if (state->rngs == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for training threads in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+  for (i = 0; i < state->thread_num; i++)
+    gnn_rng_init(&state->rngs[i], random_seed, i + 1);
+}
+
+/*!
+** runs the training threads over the passes of a text from a state, the
+** vocabulary and the network must have the same words.
+**
+** with checkpoints on, the passes are cut into segments of
+** options->checkpoint_words at sentence ends. After every segment the
+** threads are joined and the weights are copied while they are stopped,
+** then the copy is handed to the background writer and a new reader and
+** new threads start from the saved state.
+**
+** @return 0 if success, or -1 if the text can not be opened
+*/
+static int
+gnn_w2v_skipgram_run(gnn_w2v_t*                             w2v,
+                     const char*                            text_path,
+                     gnn_w2v_vocab_t*                       vocab,
+                     uint                                   sample,
+                     uint                                   window,
+                     gnn_w2v_skipgram_options_t const*      options,
+                     gnn_w2v_checkpoint_t*                  state)
+{
+  const char* checkpoint_path = options != NULL && options->checkpoint_words > 0 ? options->checkpoint_path : NULL;
+  uint i = 0;
+  gnn_w2v_train_params_t* params;
+  gnn_w2v_reader_t* reader;
+  gnn_w2v_writer_t writer;
+  pthread_t* threads;
+  int rc = 0;
+
+  memset(&writer, 0, sizeof(writer));
+  writer.path = checkpoint_path;
+  params = (gnn_w2v_train_params_t*) calloc(state->thread_num, sizeof(gnn_w2v_train_params_t));
+  threads = (pthread_t*) malloc(state->thread_num * sizeof(pthread_t));
+  if (params == NULL || threads == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for training threads in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+
+  while (state->reader.iteration < iter)
+  {
+    /*!
+    ** the reader thread parses and subsamples ahead, so the training threads
+    ** only run the math
+    */
+    reader = gnn_w2v_reader_resume(text_path, vocab, sample, iter, GANN_W2V_READER_CAPACITY, &state->reader,
+                                   checkpoint_path != NULL ? options->checkpoint_words : 0);
+    if (reader == NULL)
+    {
+      rc = -1;
+      break;
+    }
+    for (i = 0; i < state->thread_num; i++)
+    {
+      params[i].alpha = state->alpha;
+      params[i].dimensions = w2v->dim_num;
+      params[i].sample = sample;
+      params[i].id = i;
+      params[i].thread_num = state->thread_num;
+      params[i].vocab = vocab;
+      params[i].w2v = w2v;
+      params[i].reader = reader;
+      params[i].window = window;
+      params[i].negative = 3;
+      params[i].hierarchical_softmax = 1;
+      params[i].rng = state->rngs[i];
+      pthread_create(&threads[i], NULL, gnn_w2v_skipgram_thread, &params[i]);
     }
+    for (i = 0; i < state->thread_num; i++)
+    {
+      pthread_join(threads[i], NULL);
+      state->rngs[i] = params[i].rng;
+    }
+    state->reader = reader->state;
+    gnn_w2v_reader_free(reader);
+
+    if (checkpoint_path != NULL && state->reader.iteration < iter)
+      gnn_w2v_writer_start(&writer, w2v, vocab, state);
+  }
+
+  gnn_w2v_writer_free(&writer);
+  free(threads);
+  free(params);
+  return rc;
+}
+
+gnn_w2v_t*
+gnn_w2v_skipgram(const char*                            text_path,
+                 gnn_w2v_vocab_t*                       vocab,
+                 uint                                   sample,
+                 uint                                   window,
+                 gnn_w2v_skipgram_options_t const*      options)
+{
+  uint feature_size = 300;
+  gnn_w2v_checkpoint_t state;
+  gnn_rng_t rng;
+  gnn_w2v_t* w2v;
+  int rc;
+
+  gnn_rng_init(&rng, random_seed, 0);
+  w2v = gnn_w2v_new(vocab, feature_size, mem_flags, &rng);
+  gnn_w2v_checkpoint_init(&state);
+  rc = gnn_w2v_skipgram_run(w2v, text_path, vocab, sample, window, options, &state);
+  free(state.rngs);
+  if (rc != 0)
+  {
+    gnn_w2v_free(w2v);
+    return NULL;
   }
-  fclose(fi);
-  gnn_w2v_free(w2v);
+  return w2v;
+}
+
+int
+gnn_w2v_skipgram_continue(gnn_w2v_t*                            w2v,
+                          const char*                           text_path,
+                          gnn_w2v_vocab_t*                      vocab,
+                          uint                                  sample,
+                          uint                                  window,
+                          gnn_w2v_skipgram_options_t const*     options)
+{
+  gnn_w2v_checkpoint_t state;
+  int rc;
+
+  if (w2v->vocab_size != vocab->size || w2v->bucket_size != vocab->bucket_size)
+  {
+    fprintf(stderr, "error: the network has %u words and the vocabulary %lld, grow it first.\n",
+            w2v->vocab_size, vocab->size);
+    return -1;
+  }
+  gnn_w2v_checkpoint_init(&state);
+  rc = gnn_w2v_skipgram_run(w2v, text_path, vocab, sample, window, options, &state);
+  free(state.rngs);
+  return rc;
+}
+
+gnn_w2v_t*
+gnn_w2v_skipgram_resume(const char*                             checkpoint,
+                        const char*                             text_path,
+                        uint                                    sample,
+                        uint                                    window,
+                        gnn_w2v_skipgram_options_t const*       options,
+                        gnn_w2v_vocab_t**                       vocab)
+{
+  gnn_w2v_checkpoint_t state;
+  gnn_w2v_t* w2v;
+  int rc;
+
+  if (gnn_w2v_checkpoint_load(checkpoint, mem_flags, vocab, &w2v, &state) != 0)
+    return NULL;
+  rc = gnn_w2v_skipgram_run(w2v, text_path, *vocab, sample, window, options, &state);
+  free(state.rngs);
+  if (rc != 0)
+  {
+    gnn_w2v_free(w2v);
+    gnn_w2v_vocab_free(*vocab);
+    *vocab = NULL;
+    return NULL;
+  }
+  return w2v;
 }
 
 void
-gnn_w2v_train(gnn_w2v_vocab_t*          vocab,
-              uint                      dims,
-              uint                      layer_size,
+gnn_w2v_train(gnn_w2v_t const*          w2v,
+              gnn_w2v_vocab_t const*    vocab,
               const char*               model_file_path)
 {
   long a, b, c, d, charv_id;
   long long tot;
   wchar_t ch[10];
   char buf[10], pos;
-  float* vec = calloc(dims, sizeof(float));
+  uint dims = w2v->dim_num;
+  real* vec = (real*) calloc(dims, sizeof(real));
   FILE *fo;
 //  pthread_t *pt = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
 //  printf("Starting training using file %s\n", train_file);
@@ -955,25 +1715,14 @@ gnn_w2v_train(gnn_w2v_vocab_t*          vocab,
   {
     for (b = 0; vocab->words[a].word[b] != 0; b++)
       fputc(vocab->words[a].word[b], fo);
-//    for (b = 0; b < layer_size; b++)
-//      fwrite(&syn0[a * layer_size + b], sizeof(float), 1, fo);
-//    fputc('\t', fo);
-//    for (b = 0; b < dims; b++) vec[b] = 0;
-//    for (b = 0; b < dims; b++) vec[b] = syn0[b + a * dim];
-//    if (cwe_type && vocab[a].character_size) {
-//      for (b = 0; b < vocab[a].character_size; b++) {
-//        charv_id = vocab[a].character[b];
-//        if (cwe_type == 3 || cwe_type == 4 || cwe_type == 5) {
-//          charv_id = get_res_emb(a, b, charv_id);
-//        }
-//        for (c = 0; c < dims; c++) vec[c] += charv[c + charv_id * dim] / vocab[a].character_size;
-//      }
-//    }
+    fputc('\t', fo);
+    gnn_w2v_vector(w2v, vocab, a, vec);
     for (b = 0; b < dims; b++)
-      fprintf(fo, "%lf\t", vec[b]);
+      fprintf(fo, "%f\t", vec[b]);
     fprintf(fo, "\n");
   }
   fclose(fo);
+  free(vec);
 //  if (strlen(output_char))
 //  {
 //    fo = fopen(output_char, "wb");
@@ -1026,61 +1775,36 @@ gnn_w2v_train(gnn_w2v_vocab_t*          vocab,
 
 
 gnn_w2v_t*
-gnn_w2v_new(gnn_w2v_vocab_t* vocab, uint dimensions)
+gnn_w2v_new(gnn_w2v_vocab_t* vocab, uint dimensions, int mem_flags, gnn_rng_t* rng)
 {
   gnn_w2v_t* ret = (gnn_w2v_t*) malloc(sizeof(gnn_w2v_t));
   ret->vocab_size = vocab->size;
   ret->dim_num = dimensions;
   ret->char_size = vocab->char_size;
+  ret->mem_flags = mem_flags;
 
   int rs = 0;
   int i, j;
-  ullong next_random = 1;
+  float range = 0.5f / dimensions;
 
-  rs = posix_memalign((void **)&ret->hidden_weights,
-                      128,
-                      ret->vocab_size * ret->dim_num * sizeof(real));
-  if (ret->hidden_weights == NULL)
-  {
-    fprintf(stderr, "error: failed to allocate memories for hidden weights in %d of %s.\n", __LINE__, __FILE__);
-    exit(1);
-  }
-  for (i = 0; i < ret->vocab_size; i++)
-    for (j = 0; j < ret->dim_num; j++)
-    {
-      next_random = next_random * (unsigned long long)25214903917 + 11;
-      ret->hidden_weights[i * ret->dim_num + j] = (((next_random & 0xFFFF) / (real)65536) - 0.5) / ret->dim_num;
-    }
+  /*!
+  ** the large matrices are placed by the memory flags, the threads of
+  ** first-touch and of the random fill are the training threads
+  */
+  ret->hidden_weights = (real*) gnn_mem_alloc(gnn_w2v_matrix_size(ret->vocab_size, ret->dim_num),
+                                              mem_flags, num_threads);
+  if (rng != NULL)
+    gnn_vec_fill_uniform(ret->hidden_weights, (size_t) ret->vocab_size * ret->dim_num, -range, range, rng, num_threads);
 
-  rs = posix_memalign((void **)&ret->output_weights,
-                      128,
-                      ret->vocab_size * ret->dim_num * sizeof(real));
-  if (ret->output_weights == NULL)
-  {
-    fprintf(stderr, "error: failed to allocate memories for output weights in %d of %s.\n", __LINE__, __FILE__);
-    exit(1);
-  }
-  for (i = 0; i < ret->vocab_size; i++)
-    for (j = 0; j < ret->dim_num; j++)
-    {
-      next_random = next_random * (unsigned long long)25214903917 + 11;
-      ret->output_weights[i * ret->dim_num + j] = (((next_random & 0xFFFF) / (real)65536) - 0.5) / ret->dim_num;
-    }
+  ret->output_weights = (real*) gnn_mem_alloc(gnn_w2v_matrix_size(ret->vocab_size, ret->dim_num),
+                                              mem_flags, num_threads);
+  if (rng != NULL)
+    gnn_vec_fill_uniform(ret->output_weights, (size_t) ret->vocab_size * ret->dim_num, -range, range, rng, num_threads);
 
-  rs = posix_memalign((void **)&ret->negative_samplings,
-                      128,
-                      ret->vocab_size * ret->dim_num * sizeof(real));
-  if (ret->negative_samplings == NULL)
-  {
-    fprintf(stderr, "error: failed to allocate memories for negative samplings in %d of %s.\n", __LINE__, __FILE__);
-    exit(1);
-  }
-  for (i = 0; i < ret->vocab_size; i++)
-    for (j = 0; j < ret->dim_num; j++)
-    {
-      next_random = next_random * (unsigned long long)25214903917 + 11;
-      ret->negative_samplings[i * ret->dim_num + j] = (((next_random & 0xFFFF) / (real)65536) - 0.5) / ret->dim_num;
-    }
+  ret->negative_samplings = (real*) gnn_mem_alloc(gnn_w2v_matrix_size(ret->vocab_size, ret->dim_num),
+                                                  mem_flags, num_threads);
+  if (rng != NULL)
+    gnn_vec_fill_uniform(ret->negative_samplings, (size_t) ret->vocab_size * ret->dim_num, -range, range, rng, num_threads);
 
   rs = posix_memalign((void **)&ret->hidden_neurons,
                       128,
@@ -1104,31 +1828,24 @@ gnn_w2v_new(gnn_w2v_vocab_t* vocab, uint dimensions)
   for (j = 0; j < ret->dim_num; j++)
     ret->softmax_neurons[j] = 0;
 
-  rs = posix_memalign((void **)&ret->negative_samplings,
-                      128,
-                      ret->vocab_size * ret->dim_num * sizeof(real));
-  if (ret->negative_samplings == NULL)
-  {
-    fprintf(stderr, "error: failed to allocate memories for negative samplings in %d of %s.\n", __LINE__, __FILE__);
-    exit(1);
-  }
+  ret->char_weights = (real*) gnn_mem_alloc(gnn_w2v_matrix_size(ret->char_size, ret->dim_num),
+                                            mem_flags, num_threads);
+  if (rng != NULL)
+    gnn_vec_fill_uniform(ret->char_weights, (size_t) ret->char_size * ret->dim_num, -range, range, rng, num_threads);
 
-  rs = posix_memalign((void **)&ret->char_weights,
-                      128,
-                      ret->char_size * ret->dim_num * sizeof(real));
-  if (ret->char_weights == NULL)
+  ret->bucket_weights = NULL;
+  ret->bucket_size = vocab->bucket_size;
+  if (ret->bucket_size > 0)
   {
-    fprintf(stderr, "error: failed to allocate memories for character weights in %d of %s.\n", __LINE__, __FILE__);
-    exit(1);
-  }
-  for (i = 0; i < (long long)ret->char_size * ret->dim_num; i++) {
-    next_random = next_random * (unsigned long long)25214903917 + 11;
-    ret->char_weights[i] = (((next_random & 0xFFFF) / (real)65536) - 0.5) / ret->dim_num;
+    ret->bucket_weights = (real*) gnn_mem_alloc(gnn_w2v_matrix_size(ret->bucket_size, ret->dim_num),
+                                                mem_flags, num_threads);
+    if (rng != NULL)
+      gnn_vec_fill_uniform(ret->bucket_weights, (size_t) ret->bucket_size * ret->dim_num, -range, range, rng, num_threads);
   }
 
   rs = posix_memalign((void **)&ret->embedded_count,
                       128,
-                      (GANN_W2V_MAX_CHINESE - GANN_W2V_MIN_CHINESE) * sizeof(uint));
+                      (GANN_W2V_MAX_CHINESE - GANN_W2V_MIN_CHINESE + 1) * sizeof(uint));
   if (ret->embedded_count == NULL)
   {
     fprintf(stderr, "error: failed to allocate memories for embedded count in %d of %s.\n", __LINE__, __FILE__);
@@ -1140,7 +1857,7 @@ gnn_w2v_new(gnn_w2v_vocab_t* vocab, uint dimensions)
 
   rs = posix_memalign((void **)&ret->last_embedded_count,
                       128,
-                      (GANN_W2V_MAX_CHINESE - GANN_W2V_MIN_CHINESE) * sizeof(uint));
+                      (GANN_W2V_MAX_CHINESE - GANN_W2V_MIN_CHINESE + 1) * sizeof(uint));
   if (ret->last_embedded_count == NULL)
   {
     fprintf(stderr, "error: failed to allocate memories for last embedded count in %d of %s.\n", __LINE__, __FILE__);
@@ -1150,22 +1867,109 @@ gnn_w2v_new(gnn_w2v_vocab_t* vocab, uint dimensions)
   return ret;
 }
 
+/*!
+** moves the rows of a matrix into a larger one, and randomizes the new rows
+** like gnn_w2v_new.
+*/
+static real*
+gnn_w2v_matrix_grow(real*         matrix,
+                    uint          rows,
+                    uint          new_rows,
+                    uint          dims,
+                    int           mem_flags,
+                    gnn_rng_t*    rng)
+{
+  real* ret = (real*) gnn_mem_alloc(gnn_w2v_matrix_size(new_rows, dims), mem_flags, num_threads);
+  memcpy(ret, matrix, gnn_w2v_matrix_size(rows, dims));
+  gnn_vec_fill_uniform(ret + (size_t) rows * dims, (size_t) (new_rows - rows) * dims,
+                       -0.5f / dims, 0.5f / dims, rng, num_threads);
+  gnn_mem_free(matrix, gnn_w2v_matrix_size(rows, dims), mem_flags);
+  return ret;
+}
+
+void
+gnn_w2v_grow(gnn_w2v_t* w2v, gnn_w2v_vocab_t const* vocab, gnn_rng_t* rng)
+{
+  uint size = vocab->size;
+
+  if (size <= w2v->vocab_size)
+    return;
+  w2v->hidden_weights = gnn_w2v_matrix_grow(w2v->hidden_weights, w2v->vocab_size, size,
+                                            w2v->dim_num, w2v->mem_flags, rng);
+  w2v->output_weights = gnn_w2v_matrix_grow(w2v->output_weights, w2v->vocab_size, size,
+                                            w2v->dim_num, w2v->mem_flags, rng);
+  w2v->negative_samplings = gnn_w2v_matrix_grow(w2v->negative_samplings, w2v->vocab_size, size,
+                                                w2v->dim_num, w2v->mem_flags, rng);
+  w2v->vocab_size = size;
+}
+
+void
+gnn_w2v_vector(gnn_w2v_t const*         w2v,
+               gnn_w2v_vocab_t const*   vocab,
+               llong                    id,
+               real*                    vec)
+{
+  gnn_w2v_word_t const* word = &vocab->words[id];
+  uint dims = w2v->dim_num;
+  real rate;
+  int c;
+
+  gnn_vec_copy(vec, w2v->hidden_weights + id * dims, dims);
+  if (w2v->bucket_size > 0 && word->subword_size > 0)
+  {
+    for (c = 0; c < word->subword_size; c++)
+      gnn_vec_axpy(vec, 1, w2v->bucket_weights + (llong) word->subword[c] * dims, dims);
+    gnn_vec_multiply_scalar(vec, 1.0 / (word->subword_size + 1), dims);
+  }
+  if (w2v->char_size == 0 || word->character_size == 0)
+    return;
+  rate = 1.0 / word->character_size;
+  for (c = 0; c < word->character_size; c++)
+    gnn_vec_axpy(vec, rate, w2v->char_weights + (llong) word->character[c] * dims, dims);
+  gnn_vec_multiply_scalar(vec, 0.5, dims);
+}
+
+int
+gnn_w2v_oov_vector(gnn_w2v_t const* w2v, const char* word, real* vec)
+{
+  int ids[GANN_W2V_MAX_SUBWORDS];
+  uint dims = w2v->dim_num;
+  int m = 0, n = 0, c;
+
+  for (c = 0; c < dims; c++) vec[c] = 0;
+  if (w2v->bucket_size > 0)
+  {
+    m = gnn_w2v_subwords(word, ids, GANN_W2V_MAX_SUBWORDS, w2v->bucket_size);
+    for (c = 0; c < m; c++)
+      gnn_vec_axpy(vec, 1.0 / m, w2v->bucket_weights + (llong) ids[c] * dims, dims);
+  }
+  if (w2v->char_size > 0)
+  {
+    n = gnn_w2v_characters(word, ids, GANN_W2V_MAX_SUBWORDS);
+    if (n > 0 && m > 0)
+      gnn_vec_multiply_scalar(vec, 0.5, dims);
+    for (c = 0; c < n; c++)
+      gnn_vec_axpy(vec, (m > 0 ? 0.5 : 1.0) / n, w2v->char_weights + (llong) ids[c] * dims, dims);
+  }
+  return m + n;
+}
+
 void
 gnn_w2v_free(gnn_w2v_t* w2v)
 {
+  size_t size = gnn_w2v_matrix_size(w2v->vocab_size, w2v->dim_num);
   if (w2v->hidden_neurons != NULL)
     free(w2v->hidden_neurons);
-  if (w2v->hidden_weights != NULL)
-    free(w2v->hidden_weights);
-  if (w2v->output_weights != NULL)
-    free(w2v->output_weights);
+  gnn_mem_free(w2v->hidden_weights, size, w2v->mem_flags);
+  gnn_mem_free(w2v->output_weights, size, w2v->mem_flags);
   if (w2v->softmax_neurons != NULL)
     free(w2v->softmax_neurons);
-  if (w2v->char_weights != NULL)
-    free(w2v->char_weights);
+  gnn_mem_free(w2v->char_weights, gnn_w2v_matrix_size(w2v->char_size, w2v->dim_num), w2v->mem_flags);
+  gnn_mem_free(w2v->bucket_weights, gnn_w2v_matrix_size(w2v->bucket_size, w2v->dim_num), w2v->mem_flags);
   if (w2v->embedded_count != NULL)
     free(w2v->embedded_count);
-  if (w2v->negative_samplings != NULL)
-    free(w2v->negative_samplings);
+  if (w2v->last_embedded_count != NULL)
+    free(w2v->last_embedded_count);
+  gnn_mem_free(w2v->negative_samplings, size, w2v->mem_flags);
   free(w2v);
 }
@@ -8,43 +8,85 @@
 **  `Y8bood8P'   o88o     o8888o o8o        `8  o8o        `8
 */
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
 
 #include "gann.h"
 
+#define GANN_RNG_GOLDEN                   0x9E3779B97F4A7C15ULL
+
+ullong
+gnn_rng_mix(ullong x)
+{
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+void
+gnn_rng_init(gnn_rng_t* rng, ullong seed, ullong stream)
+{
+  rng->key = gnn_rng_mix(seed + gnn_rng_mix((stream + 1) * GANN_RNG_GOLDEN));
+  rng->counter = 0;
+  rng->spare = 0;
+  rng->has_spare = 0;
+}
+
+ullong
+gnn_rng_next(gnn_rng_t* rng)
+{
+  return gnn_rng_mix(rng->key + ++rng->counter * GANN_RNG_GOLDEN);
+}
+
+float
+gnn_rng_uniform(gnn_rng_t* rng)
+{
+  return (gnn_rng_next(rng) >> 40) * (1.0f / 16777216.0f);
+}
+
 /*!
 ** Gaussian generator:
 **   https://phoxis.org/2013/05/04/generating-random-numbers-from-normal-distribution-in-c/
 */
 float
-gnn_num_random(float mu, float sigma)
+gnn_rng_gaussian(gnn_rng_t* rng)
 {
-
   float U1, U2, W, mult;
-  static float X1, X2;
-  static int call = 0;
 
-  if (call == 1)
+  if (rng->has_spare)
   {
-    call = !call;
-    return (mu + sigma * (float) X2);
+    rng->has_spare = 0;
+    return rng->spare;
   }
 
   do
   {
-    U1 = -1 + ((float) rand () / RAND_MAX) * 2;
-    U2 = -1 + ((float) rand () / RAND_MAX) * 2;
-    W = pow (U1, 2) + pow (U2, 2);
+    U1 = -1 + gnn_rng_uniform(rng) * 2;
+    U2 = -1 + gnn_rng_uniform(rng) * 2;
+    W = U1 * U1 + U2 * U2;
   } while ( W >= 1 || W == 0 );
 
-  mult = sqrt ((-2 * log (W)) / W);
-  X1 = U1 * mult;
-  X2 = U2 * mult;
-
-  call = !call;
+  mult = sqrtf((-2 * logf(W)) / W);
+  rng->spare = U2 * mult;
+  rng->has_spare = 1;
+  return U1 * mult;
+}
 
-  return (mu + sigma * (float) X1);
+float
+gnn_num_random(gnn_rng_t* rng, float mu, float sigma)
+{
+  return mu + sigma * gnn_rng_gaussian(rng);
 }
 
 void
@@ -60,21 +102,210 @@ gnn_vec_print(float const* vec, uint size)
   printf("]\n");
 }
 
+/*!
+** the floats hashed between two stores, and the least floats per thread.
+*/
+#define GANN_FILL_BLOCK                   1024
+#define GANN_FILL_GRAIN                   (1 << 18)
+
+#if defined(__AVX2__) && !(defined(__AVX512F__) && defined(__AVX512DQ__))
+/*!
+** the low 64 bits of a * b, AVX2 has only 32 x 32 bit products.
+*/
+static inline __m256i
+gnn_rng_mul256(__m256i a, __m256i b)
+{
+  __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                                   _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+  return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+}
+
+/*!
+** gnn_rng_mix on 4 lanes, shifted down to the 24 bits of a float.
+*/
+static inline __m256i
+gnn_rng_mix256(__m256i x)
+{
+  x = gnn_rng_mul256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 30)), _mm256_set1_epi64x(0xBF58476D1CE4E5B9ULL));
+  x = gnn_rng_mul256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 27)), _mm256_set1_epi64x(0x94D049BB133111EBULL));
+  return _mm256_srli_epi64(_mm256_xor_si256(x, _mm256_srli_epi64(x, 31)), 40);
+}
+#endif
+
+/*!
+** dst[i] is the uniform number of counter + i + 1 of the key.
+*/
+static void
+gnn_rng_uniform_block(float* dst, ullong key, ullong counter, size_t size)
+{
+  size_t i = 0;
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+  const __m512i m1 = _mm512_set1_epi64(0xBF58476D1CE4E5B9ULL);
+  const __m512i m2 = _mm512_set1_epi64(0x94D049BB133111EBULL);
+  const __m512i step = _mm512_set1_epi64(8 * GANN_RNG_GOLDEN);
+  const __m256 scale = _mm256_set1_ps(1.0f / 16777216.0f);
+  __m512i x = _mm512_mullo_epi64(_mm512_add_epi64(_mm512_set1_epi64(counter + 1),
+                                                  _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7)),
+                                 _mm512_set1_epi64(GANN_RNG_GOLDEN));
+  x = _mm512_add_epi64(x, _mm512_set1_epi64(key));
+  for (; i + 8 <= size; i += 8)
+  {
+    __m512i h = _mm512_mullo_epi64(_mm512_xor_si512(x, _mm512_srli_epi64(x, 30)), m1);
+    h = _mm512_mullo_epi64(_mm512_xor_si512(h, _mm512_srli_epi64(h, 27)), m2);
+    h = _mm512_srli_epi64(_mm512_xor_si512(h, _mm512_srli_epi64(h, 31)), 40);
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm512_cvtepi64_ps(h), scale));
+    x = _mm512_add_epi64(x, step);
+  }
+#elif defined(__AVX2__)
+  const __m256i step = _mm256_set1_epi64x(8 * GANN_RNG_GOLDEN);
+  const __m256i order = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  const __m256 scale = _mm256_set1_ps(1.0f / 16777216.0f);
+  __m256i lo = _mm256_setr_epi64x(key + (counter + 1) * GANN_RNG_GOLDEN, key + (counter + 2) * GANN_RNG_GOLDEN,
+                                  key + (counter + 3) * GANN_RNG_GOLDEN, key + (counter + 4) * GANN_RNG_GOLDEN);
+  __m256i hi = _mm256_add_epi64(lo, _mm256_set1_epi64x(4 * GANN_RNG_GOLDEN));
+  for (; i + 8 <= size; i += 8)
+  {
+    // both halves are below 2^24, so they interleave into 32 bit lanes
+    __m256i h = _mm256_blend_epi32(gnn_rng_mix256(lo), _mm256_slli_epi64(gnn_rng_mix256(hi), 32), 0xAA);
+    h = _mm256_permutevar8x32_epi32(h, order);
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(h), scale));
+    lo = _mm256_add_epi64(lo, step);
+    hi = _mm256_add_epi64(hi, step);
+  }
+#endif
+  for (; i < size; i++)
+    dst[i] = (gnn_rng_mix(key + (counter + i + 1) * GANN_RNG_GOLDEN) >> 40) * (1.0f / 16777216.0f);
+}
+
+/*!
+** the elements [begin, end) of one fill thread.
+*/
+typedef struct gnn_vec_fill_s
+{
+  float*                vec;
+
+  size_t                begin;
+
+  size_t                end;
+
+  /*!
+  ** low and high, or mu and sigma
+  */
+  float                 a;
+
+  float                 b;
+
+  int                   gaussian;
+
+  ullong                key;
+
+  ullong                counter;
+}
+gnn_vec_fill_t;
+
+static void*
+gnn_vec_fill_run(void* data)
+{
+  gnn_vec_fill_t* fill = (gnn_vec_fill_t*) data;
+  float u[GANN_FILL_BLOCK + 1];
+  float r, theta;
+  size_t i, k, n;
+
+  for (i = fill->begin; i < fill->end; i += n)
+  {
+    n = fill->end - i < GANN_FILL_BLOCK ? fill->end - i : GANN_FILL_BLOCK;
+    if (!fill->gaussian)
+    {
+      gnn_rng_uniform_block(fill->vec + i, fill->key, fill->counter + i, n);
+      for (k = 0; k < n; k++)
+        fill->vec[i + k] = fill->a + fill->vec[i + k] * (fill->b - fill->a);
+      continue;
+    }
+
+    // i is even, and an odd tail still draws both numbers of its pair
+    gnn_rng_uniform_block(u, fill->key, fill->counter + i, n + (n & 1));
+    for (k = 0; k < n; k += 2)
+    {
+      r = fill->b * sqrtf(-2 * logf(1 - u[k]));
+      theta = 6.28318530717958647692f * u[k + 1];
+      fill->vec[i + k] = fill->a + r * cosf(theta);
+      if (k + 1 < n)
+        fill->vec[i + k + 1] = fill->a + r * sinf(theta);
+    }
+  }
+  return NULL;
+}
+
+static void
+gnn_vec_fill(float* vec, size_t size, float a, float b, int gaussian, gnn_rng_t* rng, uint thread_num)
+{
+  gnn_vec_fill_t* fills;
+  pthread_t* threads;
+  size_t chunk;
+  uint i;
+
+  if (thread_num == 0)
+  {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_num = cpus > 0 ? (uint) cpus : 1;
+  }
+  if (thread_num > (size + GANN_FILL_GRAIN - 1) / GANN_FILL_GRAIN)
+    thread_num = (uint) ((size + GANN_FILL_GRAIN - 1) / GANN_FILL_GRAIN);
+  if (thread_num < 1)
+    thread_num = 1;
+
+  fills = (gnn_vec_fill_t*) malloc(thread_num * sizeof(gnn_vec_fill_t));
+  threads = (pthread_t*) malloc(thread_num * sizeof(pthread_t));
+  if (fills == NULL || threads == NULL)
+  {
+    fprintf(stderr, "error: failed to allocate memories for threads in %d of %s.\n", __LINE__, __FILE__);
+    exit(1);
+  }
+
+  // whole blocks per thread keep the Box-Muller pairs together
+  chunk = (size / thread_num + GANN_FILL_BLOCK - 1) / GANN_FILL_BLOCK * GANN_FILL_BLOCK;
+  for (i = 0; i < thread_num; i++)
+  {
+    fills[i].vec = vec;
+    fills[i].begin = i * chunk < size ? i * chunk : size;
+    fills[i].end = (i + 1) * chunk < size && i + 1 < thread_num ? (i + 1) * chunk : size;
+    fills[i].a = a;
+    fills[i].b = b;
+    fills[i].gaussian = gaussian;
+    fills[i].key = rng->key;
+    fills[i].counter = rng->counter;
+  }
+  for (i = 1; i < thread_num; i++)
+    pthread_create(&threads[i], NULL, gnn_vec_fill_run, &fills[i]);
+  gnn_vec_fill_run(&fills[0]);
+  for (i = 1; i < thread_num; i++)
+    pthread_join(threads[i], NULL);
+
+  rng->counter += gaussian ? size + (size & 1) : size;
+  free(fills);
+  free(threads);
+}
+
+void
+gnn_vec_fill_uniform(float* vec, size_t size, float low, float high, gnn_rng_t* rng, uint thread_num)
+{
+  gnn_vec_fill(vec, size, low, high, 0, rng, thread_num);
+}
+
+void
+gnn_vec_fill_gaussian(float* vec, size_t size, float mu, float sigma, gnn_rng_t* rng, uint thread_num)
+{
+  gnn_vec_fill(vec, size, mu, sigma, 1, rng, thread_num);
+}
+
 float*
-gnn_vec_new(uint size, float random)
+gnn_vec_new(uint size, float random, gnn_rng_t* rng)
 {
-  int         l       = 0;
   float*     ret;
   ret = (float*) calloc(size, sizeof(float));
 
-  while ( l < size )
-  {
-    if (random <= 0)
-      ret[l] = 0;
-    else
-      ret[l] = gnn_num_random(0,1) / sqrt(random / 5);
-    ++l;
-  }
+  if (random > 0)
+    gnn_vec_fill_gaussian(ret, size, 0, 1 / sqrtf(random / 5), rng, 0);
 
   return ret;
 }
@@ -150,3 +381,588 @@ gnn_vec_divide_scalar(float* dst, float dividend, uint size)
   for (i = 0; i < size; i++)
     dst[i] /= dividend;
 }
+
+#if defined(__AVX2__)
+static inline float
+gnn_vec_hsum256(__m256 v)
+{
+  __m128 lo = _mm256_castps256_ps128(v);
+  __m128 hi = _mm256_extractf128_ps(v, 1);
+  lo = _mm_add_ps(lo, hi);
+  lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+  lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 0x55));
+  return _mm_cvtss_f32(lo);
+}
+#endif
+
+float
+gnn_vec_dot(const float* a, const float* b, uint size)
+{
+  uint i = 0;
+  float ret = 0;
+#if defined(__AVX512F__)
+  __m512 s0 = _mm512_setzero_ps();
+  __m512 s1 = _mm512_setzero_ps();
+  for (; i + 32 <= size; i += 32)
+  {
+    s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+    s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), s1);
+  }
+  for (; i + 16 <= size; i += 16)
+    s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+  ret = _mm512_reduce_add_ps(_mm512_add_ps(s0, s1));
+#elif defined(__AVX2__)
+  __m256 s0 = _mm256_setzero_ps();
+  __m256 s1 = _mm256_setzero_ps();
+  for (; i + 16 <= size; i += 16)
+  {
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+    s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), s1);
+  }
+  for (; i + 8 <= size; i += 8)
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+  ret = gnn_vec_hsum256(_mm256_add_ps(s0, s1));
+#endif
+  for (; i < size; i++)
+    ret += a[i] * b[i];
+  return ret;
+}
+
+/*!
+** computes the dot products of one vector x with four vectors in a row-major
+** matrix, the loads of x are shared by the four rows.
+*/
+void
+gnn_vec_dot4(float* ret, const float* x, const float* rows, uint stride, uint size)
+{
+  const float* r0 = rows;
+  const float* r1 = rows + stride;
+  const float* r2 = rows + stride * 2;
+  const float* r3 = rows + stride * 3;
+  uint i = 0;
+  ret[0] = ret[1] = ret[2] = ret[3] = 0;
+#if defined(__AVX512F__)
+  __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+  __m512 s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+  for (; i + 16 <= size; i += 16)
+  {
+    __m512 v = _mm512_loadu_ps(x + i);
+    s0 = _mm512_fmadd_ps(v, _mm512_loadu_ps(r0 + i), s0);
+    s1 = _mm512_fmadd_ps(v, _mm512_loadu_ps(r1 + i), s1);
+    s2 = _mm512_fmadd_ps(v, _mm512_loadu_ps(r2 + i), s2);
+    s3 = _mm512_fmadd_ps(v, _mm512_loadu_ps(r3 + i), s3);
+  }
+  ret[0] = _mm512_reduce_add_ps(s0);
+  ret[1] = _mm512_reduce_add_ps(s1);
+  ret[2] = _mm512_reduce_add_ps(s2);
+  ret[3] = _mm512_reduce_add_ps(s3);
+#elif defined(__AVX2__)
+  __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+  __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+  for (; i + 8 <= size; i += 8)
+  {
+    __m256 v = _mm256_loadu_ps(x + i);
+    s0 = _mm256_fmadd_ps(v, _mm256_loadu_ps(r0 + i), s0);
+    s1 = _mm256_fmadd_ps(v, _mm256_loadu_ps(r1 + i), s1);
+    s2 = _mm256_fmadd_ps(v, _mm256_loadu_ps(r2 + i), s2);
+    s3 = _mm256_fmadd_ps(v, _mm256_loadu_ps(r3 + i), s3);
+  }
+  ret[0] = gnn_vec_hsum256(s0);
+  ret[1] = gnn_vec_hsum256(s1);
+  ret[2] = gnn_vec_hsum256(s2);
+  ret[3] = gnn_vec_hsum256(s3);
+#endif
+  for (; i < size; i++)
+  {
+    ret[0] += x[i] * r0[i];
+    ret[1] += x[i] * r1[i];
+    ret[2] += x[i] * r2[i];
+    ret[3] += x[i] * r3[i];
+  }
+}
+
+/*!
+** computes the 2 x 4 dot products of two vectors x and x + x_stride with four
+** vectors in a row-major matrix, each load of a row is shared by both
+** vectors and each load of a vector by the four rows. ret[q * 4 + r] is the
+** dot product of vector q and row r, summed in the same order as
+** gnn_vec_dot4.
+*/
+void
+gnn_vec_dot2x4(float* ret, const float* x, uint x_stride, const float* rows, uint stride, uint size)
+{
+  const float* x0 = x;
+  const float* x1 = x + x_stride;
+  const float* r0 = rows;
+  const float* r1 = rows + stride;
+  const float* r2 = rows + stride * 2;
+  const float* r3 = rows + stride * 3;
+  uint i = 0, j;
+  for (j = 0; j < 8; j++)
+    ret[j] = 0;
+#if defined(__AVX512F__)
+  __m512 s00 = _mm512_setzero_ps(), s01 = _mm512_setzero_ps();
+  __m512 s02 = _mm512_setzero_ps(), s03 = _mm512_setzero_ps();
+  __m512 s10 = _mm512_setzero_ps(), s11 = _mm512_setzero_ps();
+  __m512 s12 = _mm512_setzero_ps(), s13 = _mm512_setzero_ps();
+  for (; i + 16 <= size; i += 16)
+  {
+    __m512 v0 = _mm512_loadu_ps(x0 + i);
+    __m512 v1 = _mm512_loadu_ps(x1 + i);
+    __m512 w = _mm512_loadu_ps(r0 + i);
+    s00 = _mm512_fmadd_ps(v0, w, s00);
+    s10 = _mm512_fmadd_ps(v1, w, s10);
+    w = _mm512_loadu_ps(r1 + i);
+    s01 = _mm512_fmadd_ps(v0, w, s01);
+    s11 = _mm512_fmadd_ps(v1, w, s11);
+    w = _mm512_loadu_ps(r2 + i);
+    s02 = _mm512_fmadd_ps(v0, w, s02);
+    s12 = _mm512_fmadd_ps(v1, w, s12);
+    w = _mm512_loadu_ps(r3 + i);
+    s03 = _mm512_fmadd_ps(v0, w, s03);
+    s13 = _mm512_fmadd_ps(v1, w, s13);
+  }
+  ret[0] = _mm512_reduce_add_ps(s00);
+  ret[1] = _mm512_reduce_add_ps(s01);
+  ret[2] = _mm512_reduce_add_ps(s02);
+  ret[3] = _mm512_reduce_add_ps(s03);
+  ret[4] = _mm512_reduce_add_ps(s10);
+  ret[5] = _mm512_reduce_add_ps(s11);
+  ret[6] = _mm512_reduce_add_ps(s12);
+  ret[7] = _mm512_reduce_add_ps(s13);
+#elif defined(__AVX2__)
+  __m256 s00 = _mm256_setzero_ps(), s01 = _mm256_setzero_ps();
+  __m256 s02 = _mm256_setzero_ps(), s03 = _mm256_setzero_ps();
+  __m256 s10 = _mm256_setzero_ps(), s11 = _mm256_setzero_ps();
+  __m256 s12 = _mm256_setzero_ps(), s13 = _mm256_setzero_ps();
+  for (; i + 8 <= size; i += 8)
+  {
+    __m256 v0 = _mm256_loadu_ps(x0 + i);
+    __m256 v1 = _mm256_loadu_ps(x1 + i);
+    __m256 w = _mm256_loadu_ps(r0 + i);
+    s00 = _mm256_fmadd_ps(v0, w, s00);
+    s10 = _mm256_fmadd_ps(v1, w, s10);
+    w = _mm256_loadu_ps(r1 + i);
+    s01 = _mm256_fmadd_ps(v0, w, s01);
+    s11 = _mm256_fmadd_ps(v1, w, s11);
+    w = _mm256_loadu_ps(r2 + i);
+    s02 = _mm256_fmadd_ps(v0, w, s02);
+    s12 = _mm256_fmadd_ps(v1, w, s12);
+    w = _mm256_loadu_ps(r3 + i);
+    s03 = _mm256_fmadd_ps(v0, w, s03);
+    s13 = _mm256_fmadd_ps(v1, w, s13);
+  }
+  ret[0] = gnn_vec_hsum256(s00);
+  ret[1] = gnn_vec_hsum256(s01);
+  ret[2] = gnn_vec_hsum256(s02);
+  ret[3] = gnn_vec_hsum256(s03);
+  ret[4] = gnn_vec_hsum256(s10);
+  ret[5] = gnn_vec_hsum256(s11);
+  ret[6] = gnn_vec_hsum256(s12);
+  ret[7] = gnn_vec_hsum256(s13);
+#endif
+  for (; i < size; i++)
+  {
+    ret[0] += x0[i] * r0[i];
+    ret[1] += x0[i] * r1[i];
+    ret[2] += x0[i] * r2[i];
+    ret[3] += x0[i] * r3[i];
+    ret[4] += x1[i] * r0[i];
+    ret[5] += x1[i] * r1[i];
+    ret[6] += x1[i] * r2[i];
+    ret[7] += x1[i] * r3[i];
+  }
+}
+
+void
+gnn_vec_axpy(float* dst, float alpha, const float* x, uint size)
+{
+  uint i = 0;
+#if defined(__AVX512F__)
+  __m512 a = _mm512_set1_ps(alpha);
+  for (; i + 16 <= size; i += 16)
+    _mm512_storeu_ps(dst + i, _mm512_fmadd_ps(a, _mm512_loadu_ps(x + i), _mm512_loadu_ps(dst + i)));
+#elif defined(__AVX2__)
+  __m256 a = _mm256_set1_ps(alpha);
+  for (; i + 8 <= size; i += 8)
+    _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(a, _mm256_loadu_ps(x + i), _mm256_loadu_ps(dst + i)));
+#endif
+  for (; i < size; i++)
+    dst[i] += alpha * x[i];
+}
+
+void
+gnn_vec_fused_axpy(float* err, float* row, float g, const float* input, uint size)
+{
+  uint i = 0;
+  float r;
+#if defined(__AVX512F__)
+  __m512 a = _mm512_set1_ps(g);
+  for (; i + 16 <= size; i += 16)
+  {
+    __m512 v = _mm512_loadu_ps(row + i);
+    _mm512_storeu_ps(err + i, _mm512_fmadd_ps(a, v, _mm512_loadu_ps(err + i)));
+    _mm512_storeu_ps(row + i, _mm512_fmadd_ps(a, _mm512_loadu_ps(input + i), v));
+  }
+#elif defined(__AVX2__)
+  __m256 a = _mm256_set1_ps(g);
+  for (; i + 8 <= size; i += 8)
+  {
+    __m256 v = _mm256_loadu_ps(row + i);
+    _mm256_storeu_ps(err + i, _mm256_fmadd_ps(a, v, _mm256_loadu_ps(err + i)));
+    _mm256_storeu_ps(row + i, _mm256_fmadd_ps(a, _mm256_loadu_ps(input + i), v));
+  }
+#endif
+  for (; i < size; i++)
+  {
+    r = row[i];
+    err[i] += g * r;
+    row[i] = r + g * input[i];
+  }
+}
+
+double
+gnn_vec_clipped_norm2(const float* g, size_t size, float clip)
+{
+  double ret = 0;
+  size_t i = 0;
+  float x;
+#if defined(__AVX512F__)
+  __m512 lo = _mm512_set1_ps(-clip), hi = _mm512_set1_ps(clip);
+  __m512 s = _mm512_setzero_ps();
+  for (; i + 16 <= size; i += 16)
+  {
+    __m512 v = _mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(g + i), lo), hi);
+    s = _mm512_fmadd_ps(v, v, s);
+    // flushes to double now and then, a long arena loses no precision
+    if ((i & 0xfff0) == 0xfff0)
+    {
+      ret += _mm512_reduce_add_ps(s);
+      s = _mm512_setzero_ps();
+    }
+  }
+  ret += _mm512_reduce_add_ps(s);
+#elif defined(__AVX2__)
+  __m256 lo = _mm256_set1_ps(-clip), hi = _mm256_set1_ps(clip);
+  __m256 s = _mm256_setzero_ps();
+  for (; i + 8 <= size; i += 8)
+  {
+    __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(g + i), lo), hi);
+    s = _mm256_fmadd_ps(v, v, s);
+    if ((i & 0xfff8) == 0xfff8)
+    {
+      ret += gnn_vec_hsum256(s);
+      s = _mm256_setzero_ps();
+    }
+  }
+  ret += gnn_vec_hsum256(s);
+#endif
+  for (; i < size; i++)
+  {
+    x = g[i] > clip ? clip : (g[i] < -clip ? -clip : g[i]);
+    ret += x * x;
+  }
+  return ret;
+}
+
+void
+gnn_vec_adam(float*         w,
+             float*         m,
+             float*         r,
+             const float*   g,
+             size_t         size,
+             float          alpha,
+             float          rho,
+             float          beta1,
+             float          beta2,
+             float          clip,
+             float          scale)
+{
+  size_t i = 0;
+  float x;
+#if defined(__AVX512F__)
+  __m512 lo = _mm512_set1_ps(-clip), hi = _mm512_set1_ps(clip), sc = _mm512_set1_ps(scale);
+  __m512 b1 = _mm512_set1_ps(beta1), c1 = _mm512_set1_ps(1 - beta1);
+  __m512 b2 = _mm512_set1_ps(beta2), c2 = _mm512_set1_ps(1 - beta2);
+  __m512 a = _mm512_set1_ps(alpha), p = _mm512_set1_ps(rho), eps = _mm512_set1_ps(1e-8f);
+  for (; i + 16 <= size; i += 16)
+  {
+    __m512 v = _mm512_mul_ps(_mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(g + i), lo), hi), sc);
+    __m512 mv = _mm512_fmadd_ps(b1, _mm512_loadu_ps(m + i), _mm512_mul_ps(c1, v));
+    __m512 rv = _mm512_fmadd_ps(b2, _mm512_loadu_ps(r + i), _mm512_mul_ps(c2, _mm512_mul_ps(v, v)));
+    __m512 d = _mm512_fmadd_ps(p, _mm512_sqrt_ps(rv), eps);
+    _mm512_storeu_ps(m + i, mv);
+    _mm512_storeu_ps(r + i, rv);
+    _mm512_storeu_ps(w + i, _mm512_sub_ps(_mm512_loadu_ps(w + i), _mm512_div_ps(_mm512_mul_ps(a, mv), d)));
+  }
+#elif defined(__AVX2__)
+  __m256 lo = _mm256_set1_ps(-clip), hi = _mm256_set1_ps(clip), sc = _mm256_set1_ps(scale);
+  __m256 b1 = _mm256_set1_ps(beta1), c1 = _mm256_set1_ps(1 - beta1);
+  __m256 b2 = _mm256_set1_ps(beta2), c2 = _mm256_set1_ps(1 - beta2);
+  __m256 a = _mm256_set1_ps(alpha), p = _mm256_set1_ps(rho), eps = _mm256_set1_ps(1e-8f);
+  for (; i + 8 <= size; i += 8)
+  {
+    __m256 v = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(g + i), lo), hi), sc);
+    __m256 mv = _mm256_fmadd_ps(b1, _mm256_loadu_ps(m + i), _mm256_mul_ps(c1, v));
+    __m256 rv = _mm256_fmadd_ps(b2, _mm256_loadu_ps(r + i), _mm256_mul_ps(c2, _mm256_mul_ps(v, v)));
+    __m256 d = _mm256_fmadd_ps(p, _mm256_sqrt_ps(rv), eps);
+    _mm256_storeu_ps(m + i, mv);
+    _mm256_storeu_ps(r + i, rv);
+    _mm256_storeu_ps(w + i, _mm256_sub_ps(_mm256_loadu_ps(w + i), _mm256_div_ps(_mm256_mul_ps(a, mv), d)));
+  }
+#endif
+  for (; i < size; i++)
+  {
+    x = (g[i] > clip ? clip : (g[i] < -clip ? -clip : g[i])) * scale;
+    m[i] = beta1 * m[i] + (1 - beta1) * x;
+    r[i] = beta2 * r[i] + (1 - beta2) * (x * x);
+    w[i] -= alpha * m[i] / (rho * sqrtf(r[i]) + 1e-8f);
+  }
+}
+
+void
+gnn_vec_momentum(float*         w,
+                 float*         v,
+                 const float*   g,
+                 size_t         size,
+                 float          lr,
+                 float          momentum,
+                 float          clip,
+                 float          scale)
+{
+  size_t i = 0;
+  float x;
+#if defined(__AVX512F__)
+  __m512 lo = _mm512_set1_ps(-clip), hi = _mm512_set1_ps(clip);
+  __m512 a = _mm512_set1_ps(-lr * scale), mu = _mm512_set1_ps(momentum);
+  for (; i + 16 <= size; i += 16)
+  {
+    __m512 x = _mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(g + i), lo), hi);
+    __m512 vv = _mm512_fmadd_ps(mu, _mm512_loadu_ps(v + i), _mm512_mul_ps(a, x));
+    _mm512_storeu_ps(v + i, vv);
+    _mm512_storeu_ps(w + i, _mm512_add_ps(_mm512_loadu_ps(w + i), vv));
+  }
+#elif defined(__AVX2__)
+  __m256 lo = _mm256_set1_ps(-clip), hi = _mm256_set1_ps(clip);
+  __m256 a = _mm256_set1_ps(-lr * scale), mu = _mm256_set1_ps(momentum);
+  for (; i + 8 <= size; i += 8)
+  {
+    __m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(g + i), lo), hi);
+    __m256 vv = _mm256_fmadd_ps(mu, _mm256_loadu_ps(v + i), _mm256_mul_ps(a, x));
+    _mm256_storeu_ps(v + i, vv);
+    _mm256_storeu_ps(w + i, _mm256_add_ps(_mm256_loadu_ps(w + i), vv));
+  }
+#endif
+  for (; i < size; i++)
+  {
+    x = g[i] > clip ? clip : (g[i] < -clip ? -clip : g[i]);
+    v[i] = momentum * v[i] + (-lr * scale) * x;
+    w[i] += v[i];
+  }
+}
+
+/*!
+** the cephes expf: exp(x) = 2^n * exp(r), |r| <= ln2 / 2, and exp(r) is a
+** polynomial of degree 7.
+*/
+#define GANN_EXP_HI         88.3762626647949f
+#define GANN_EXP_LO        -88.3762626647949f
+#define GANN_LOG2E          1.44269504088896341f
+#define GANN_EXP_C1         0.693359375f
+#define GANN_EXP_C2        -2.12194440e-4f
+#define GANN_EXP_P0         1.9875691500E-4f
+#define GANN_EXP_P1         1.3981999507E-3f
+#define GANN_EXP_P2         8.3334519073E-3f
+#define GANN_EXP_P3         4.1665795894E-2f
+#define GANN_EXP_P4         1.6666665459E-1f
+#define GANN_EXP_P5         5.0000001201E-1f
+
+#if defined(__AVX512F__)
+static inline __m512
+gnn_vec_exp512(__m512 x)
+{
+  __m512 n, p, r;
+  x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(GANN_EXP_LO)), _mm512_set1_ps(GANN_EXP_HI));
+  n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(GANN_LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  r = _mm512_fnmadd_ps(n, _mm512_set1_ps(GANN_EXP_C1), x);
+  r = _mm512_fnmadd_ps(n, _mm512_set1_ps(GANN_EXP_C2), r);
+  p = _mm512_set1_ps(GANN_EXP_P0);
+  p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(GANN_EXP_P1));
+  p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(GANN_EXP_P2));
+  p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(GANN_EXP_P3));
+  p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(GANN_EXP_P4));
+  p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(GANN_EXP_P5));
+  p = _mm512_fmadd_ps(p, _mm512_mul_ps(r, r), _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+  return _mm512_scalef_ps(p, n);
+}
+#elif defined(__AVX2__)
+static inline __m256
+gnn_vec_exp256(__m256 x)
+{
+  __m256 n, p, r;
+  __m256i e;
+  x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(GANN_EXP_LO)), _mm256_set1_ps(GANN_EXP_HI));
+  n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(GANN_LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  r = _mm256_fnmadd_ps(n, _mm256_set1_ps(GANN_EXP_C1), x);
+  r = _mm256_fnmadd_ps(n, _mm256_set1_ps(GANN_EXP_C2), r);
+  p = _mm256_set1_ps(GANN_EXP_P0);
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(GANN_EXP_P1));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(GANN_EXP_P2));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(GANN_EXP_P3));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(GANN_EXP_P4));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(GANN_EXP_P5));
+  p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+  // 2^n, split in two steps so n = 128 after rounding does not overflow
+  e = _mm256_cvtps_epi32(n);
+  p = _mm256_mul_ps(p, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_srai_epi32(e, 1), _mm256_set1_epi32(127)), 23)));
+  e = _mm256_sub_epi32(e, _mm256_srai_epi32(e, 1));
+  return _mm256_mul_ps(p, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(e, _mm256_set1_epi32(127)), 23)));
+}
+#endif
+
+void
+gnn_vec_sigmoid(float* dst, const float* src, uint size)
+{
+  uint i = 0;
+#if defined(__AVX512F__)
+  __m512 one = _mm512_set1_ps(1.0f);
+  for (; i + 16 <= size; i += 16)
+  {
+    __m512 e = gnn_vec_exp512(_mm512_sub_ps(_mm512_setzero_ps(), _mm512_loadu_ps(src + i)));
+    _mm512_storeu_ps(dst + i, _mm512_div_ps(one, _mm512_add_ps(one, e)));
+  }
+  if (i < size)
+  {
+    __mmask16 mask = (__mmask16) ((1u << (size - i)) - 1);
+    __m512 e = gnn_vec_exp512(_mm512_sub_ps(_mm512_setzero_ps(), _mm512_maskz_loadu_ps(mask, src + i)));
+    _mm512_mask_storeu_ps(dst + i, mask, _mm512_div_ps(one, _mm512_add_ps(one, e)));
+    i = size;
+  }
+#elif defined(__AVX2__)
+  __m256 one = _mm256_set1_ps(1.0f);
+  for (; i + 8 <= size; i += 8)
+  {
+    __m256 e = gnn_vec_exp256(_mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(src + i)));
+    _mm256_storeu_ps(dst + i, _mm256_div_ps(one, _mm256_add_ps(one, e)));
+  }
+#endif
+  for (; i < size; i++)
+    dst[i] = 1.0f / (1.0f + expf(-src[i]));
+}
+
+void
+gnn_vec_prefetch(const float* vec, uint size)
+{
+  const char* p = (const char*) vec;
+  const char* end = (const char*) (vec + size);
+  for (; p < end; p += 64)
+    __builtin_prefetch(p, 1, 3);
+}
+
+float
+gnn_vec_normalize(float* vec, uint size)
+{
+  float norm = sqrt(gnn_vec_dot(vec, vec, size));
+  if (norm > 0)
+    gnn_vec_multiply_scalar(vec, 1.0f / norm, size);
+  return norm;
+}
+
+/*!
+** the pages of one first-touch thread.
+*/
+typedef struct gnn_mem_touch_s
+{
+  char*                 begin;
+
+  char*                 end;
+}
+gnn_mem_touch_t;
+
+static void*
+gnn_mem_touch(void* data)
+{
+  gnn_mem_touch_t* touch = (gnn_mem_touch_t*) data;
+  volatile char* p;
+  for (p = touch->begin; p < touch->end; p += 4096)
+    *p = 0;
+  return NULL;
+}
+
+static size_t
+gnn_mem_length(size_t size, int flags)
+{
+  if ((flags & GANN_MEM_HUGE_PAGES) && size >= GANN_MEM_HUGE_PAGE_SIZE)
+    return (size + GANN_MEM_HUGE_PAGE_SIZE - 1) / GANN_MEM_HUGE_PAGE_SIZE * GANN_MEM_HUGE_PAGE_SIZE;
+  return size > 0 ? size : 1;
+}
+
+void*
+gnn_mem_alloc(size_t size, int flags, uint thread_num)
+{
+  size_t length = gnn_mem_length(size, flags);
+  void* ret = MAP_FAILED;
+  pthread_t* threads;
+  gnn_mem_touch_t* touches;
+  size_t chunk;
+  uint i;
+
+#if defined(__linux__) && defined(MAP_HUGETLB)
+  if ((flags & GANN_MEM_HUGE_PAGES) && size >= GANN_MEM_HUGE_PAGE_SIZE)
+    ret = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (ret == MAP_FAILED)
+  {
+    ret = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ret == MAP_FAILED)
+    {
+      fprintf(stderr, "error: failed to allocate %zu bytes in %d of %s.\n", size, __LINE__, __FILE__);
+      exit(1);
+    }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    // no reserved huge pages, asks for transparent ones
+    if ((flags & GANN_MEM_HUGE_PAGES) && size >= GANN_MEM_HUGE_PAGE_SIZE)
+      madvise(ret, length, MADV_HUGEPAGE);
+#endif
+  }
+
+#if defined(__linux__) && defined(SYS_mbind)
+  if (flags & GANN_MEM_INTERLEAVE)
+  {
+    // MPOL_INTERLEAVE over every node, the kernel drops the absent ones
+    unsigned long nodes[4];
+    memset(nodes, 0xFF, sizeof(nodes));
+    syscall(SYS_mbind, ret, length, 3, nodes, sizeof(nodes) * CHAR_BIT, 0);
+  }
+#endif
+
+  if ((flags & GANN_MEM_FIRST_TOUCH) && thread_num > 1)
+  {
+    threads = (pthread_t*) malloc(thread_num * sizeof(pthread_t));
+    touches = (gnn_mem_touch_t*) malloc(thread_num * sizeof(gnn_mem_touch_t));
+    if (threads == NULL || touches == NULL)
+    {
+      fprintf(stderr, "error: failed to allocate memories for threads in %d of %s.\n", __LINE__, __FILE__);
+      exit(1);
+    }
+    chunk = (length / thread_num + 4095) / 4096 * 4096;
+    for (i = 0; i < thread_num; i++)
+    {
+      touches[i].begin = (char*) ret + (i * chunk < length ? i * chunk : length);
+      touches[i].end = (char*) ret + ((i + 1) * chunk < length ? (i + 1) * chunk : length);
+      pthread_create(&threads[i], NULL, gnn_mem_touch, &touches[i]);
+    }
+    for (i = 0; i < thread_num; i++)
+      pthread_join(threads[i], NULL);
+    free(threads);
+    free(touches);
+  }
+  return ret;
+}
+
+void
+gnn_mem_free(void* ptr, size_t size, int flags)
+{
+  if (ptr == NULL) return;
+  munmap(ptr, gnn_mem_length(size, flags));
+}
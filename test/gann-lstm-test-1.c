@@ -53,6 +53,7 @@ int main(int argc, char *argv[])
   unsigned int file_size = 0, sz = 0;
   int *X_train, *Y_train;
   FILE * fp;
+  gnn_rng_t rng;
 
   memset(&params, 0, sizeof(params));
 
@@ -90,7 +91,7 @@ int main(int argc, char *argv[])
   params.store_network_name_json = STD_JSON_NET_NAME;
   params.store_char_indx_map_name = JSON_KEY_NAME_SET;
 
-  srand(time(NULL));
+  gnn_rng_init(&rng, time(NULL), 0);
 
   parse_input_args(argc, argv);
 
@@ -209,7 +210,7 @@ Reallocating space in network input and output layer to accommodate this new fea
         }
       }
 
-      model_layers[p] = gnn_lstm_new(X, N, Y, 0, &params);
+      model_layers[p] = gnn_lstm_new(X, N, Y, 0, &params, &rng);
 
       ++p;
     }
@@ -253,7 +254,6 @@ Reallocating space in network input and output layer to accommodate this new fea
 
     gnn_lstm_train(model_layers,
                    &params,
-                   &set,
                    file_size,
                    X_train,
                    Y_train,
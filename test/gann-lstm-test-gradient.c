@@ -0,0 +1,121 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gann-w2v-vocab.h"
+#include "../src/gann-lstm-internal.h"
+
+#define FEATURES      5
+#define HIDDEN        7
+#define NEURONS       6
+#define POINTS        7
+#define EPSILON       1e-2
+
+/*!
+** a Huffman tree of the five symbols, the inner nodes are rows 0 to 3
+*/
+static int points[FEATURES][3] = {{3, 2}, {3, 2}, {3, 1}, {3, 1, 0}, {3, 1, 0}};
+static char codes[FEATURES][3] = {{0, 0}, {0, 1}, {1, 0}, {1, 1, 0}, {1, 1, 1}};
+static int codelens[FEATURES] = {2, 2, 2, 3, 3};
+
+/*!
+** compares the gradients of the trainer with central differences of the
+** loss for every weight of a stack, layer 1 takes the symbols and layer 0
+** the dense outputs of layer 1.
+**
+** @return the largest error relative to the size of the gradient
+*/
+static double
+check(int top, int bottom, gnn_w2v_vocab_t const* huffman)
+{
+  int X_train[POINTS + 1] = {0, 3, 1, 4, 2, 0, 3, 1};
+  gnn_lstm_params_t params;
+  gnn_lstm_t* model_layers[2];
+  gnn_lstm_trainer_t* trainer;
+  gnn_lstm_grad_t* gradient;
+  gnn_rng_t rng;
+  float *gradients, w;
+  double a, b, numeric, error, ret = 0;
+  size_t k;
+  uint p;
+
+  memset(&params, 0, sizeof(params));
+  params.softmax_temp = 1;
+  params.mini_batch_size = POINTS - 1;
+  params.huffman = huffman;
+
+  gnn_rng_init(&rng, GANN_RNG_SEED, 0);
+  model_layers[0] = gnn_lstm_cell_new(top, HIDDEN, NEURONS, FEATURES, 0, &params, &rng);
+  model_layers[1] = gnn_lstm_cell_new(bottom, FEATURES, NEURONS, HIDDEN, 0, &params, &rng);
+  for (p = 0; p < 2; p++)
+    gnn_vec_fill_gaussian(model_layers[p]->bf, GANN_LSTM_GATES(model_layers[p]->cell) * NEURONS + model_layers[p]->Y,
+                          0, 0.5f, &rng, 0);
+
+  trainer = gnn_lstm_trainer_new(model_layers, &params, 2, POINTS, X_train, X_train + 1);
+  gnn_lstm_trainer_gradients(trainer);
+
+  for (p = 0; p < 2; p++)
+  {
+    gradient = gnn_lstm_trainer_gradient(trainer, p);
+    gradients = gradient->data;
+    assert(model_layers[p]->size == gradient->size);
+    for (k = 0; k < model_layers[p]->size; k++)
+    {
+      w = model_layers[p]->weights[k];
+      model_layers[p]->weights[k] = w + EPSILON;
+      a = gnn_lstm_trainer_loss(trainer);
+      model_layers[p]->weights[k] = w - EPSILON;
+      b = gnn_lstm_trainer_loss(trainer);
+      model_layers[p]->weights[k] = w;
+
+      numeric = (a - b) / (2 * EPSILON);
+      error = fabs(numeric - gradients[k]) / (fabs(numeric) + fabs(gradients[k]) + 1e-2);
+      if (error > ret)
+        ret = error;
+    }
+  }
+
+  gnn_lstm_trainer_free(trainer);
+  gnn_lstm_free(model_layers[0]);
+  gnn_lstm_free(model_layers[1]);
+  return ret;
+}
+
+int
+main(int argc, char* argv[])
+{
+  static const int stacks[][2] = {
+    {GANN_LSTM_CELL, GANN_LSTM_CELL},
+    {GANN_GRU_CELL, GANN_GRU_CELL},
+    {GANN_GRU_CELL, GANN_LSTM_CELL},
+    {GANN_LSTM_CELL, GANN_GRU_CELL}
+  };
+  gnn_w2v_word_t words[FEATURES];
+  gnn_w2v_vocab_t vocab;
+  double error;
+  int s, w;
+
+  memset(words, 0, sizeof(words));
+  memset(&vocab, 0, sizeof(vocab));
+  for (w = 0; w < FEATURES; w++)
+  {
+    words[w].point = points[w];
+    words[w].code = codes[w];
+    words[w].codelen = codelens[w];
+  }
+  vocab.words = words;
+  vocab.size = FEATURES;
+
+  for (s = 0; s < 4; s++)
+  {
+    error = check(stacks[s][0], stacks[s][1], NULL);
+    printf("cells %d over %d, softmax: error %g\n", stacks[s][0], stacks[s][1], error);
+    assert(error < 0.05);
+
+    error = check(stacks[s][0], stacks[s][1], &vocab);
+    printf("cells %d over %d, huffman: error %g\n", stacks[s][0], stacks[s][1], error);
+    assert(error < 0.05);
+  }
+  return 0;
+}
@@ -0,0 +1,138 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gann-lstm-session.h"
+#include "gann-w2v-reader.h"
+
+#define LAYERS        2
+#define NEURONS       32
+#define BATCH         16
+
+/*!
+** reads the words of the text as their ids in the vocabulary, the sequence
+** wraps around.
+*/
+static uint
+load(const char* path, gnn_w2v_vocab_t const* vocab, int** X_train)
+{
+  int ids[GANN_W2V_MAX_SENTENCE_LENGTH];
+  gnn_w2v_reader_t* reader = gnn_w2v_reader_new(path, vocab, 0, 1, 2, GANN_RNG_SEED);
+  uint size = 0, length;
+
+  assert(reader != NULL);
+  *X_train = (int*) malloc((reader->train_words + 1) * sizeof(int));
+  while ((length = gnn_w2v_reader_next(reader, ids)) > 0)
+  {
+    memcpy(*X_train + size, ids, length * sizeof(int));
+    size += length;
+  }
+  gnn_w2v_reader_free(reader);
+  (*X_train)[size] = (*X_train)[0];
+  return size;
+}
+
+int
+main(int argc, char* argv[])
+{
+  gnn_w2v_vocab_t* vocab = gnn_w2v_read("../../data/chapter.txt");
+  gnn_lstm_params_t params;
+  gnn_lstm_t* model_layers[LAYERS];
+  gnn_lstm_session_t* session;
+  float const* probs;
+  double loss, first, sum;
+  uint size, i, hits = 0;
+  gnn_rng_t rng;
+  int* X_train;
+  llong w;
+
+  size = load("../../data/chapter.txt", vocab, &X_train);
+  assert(size > BATCH && vocab->size > 2);
+
+  memset(&params, 0, sizeof(params));
+  params.loss_moving_avg = 0.01;
+  params.learning_rate = 0.01;
+  params.softmax_temp = 1;
+  params.beta1 = 0.9;
+  params.beta2 = 0.999;
+  params.gradient_clip = 1;
+  params.gradient_clip_limit = 5;
+  params.optimizer = OPTIMIZE_ADAM;
+  params.mini_batch_size = BATCH;
+  params.huffman = vocab;
+
+  /*!
+  ** the words are learned on their paths in the tree
+  */
+  gnn_rng_init(&rng, GANN_RNG_SEED, 0);
+  model_layers[0] = gnn_lstm_new(NEURONS, NEURONS, vocab->size, 0, &params, &rng);
+  model_layers[1] = gnn_lstm_new(vocab->size, NEURONS, NEURONS, 0, &params, &rng);
+  params.iterations = 1;
+  gnn_lstm_train(model_layers, &params, size, X_train, X_train + 1, LAYERS, &first);
+  params.iterations = 1000;
+  gnn_lstm_train(model_layers, &params, size, X_train, X_train + 1, LAYERS, &loss);
+  printf("%lld words, %u points: loss %lf -> %lf\n", vocab->size, size, first, loss);
+  assert(first > 0.5 * log(vocab->size));
+  assert(loss < 0.5 * first);
+
+  /*!
+  ** the products on the paths are a distribution, which predicts the text
+  */
+  session = gnn_lstm_session_new(model_layers, LAYERS);
+  for (i = 0; i < size; i++)
+  {
+    if (i % BATCH == 0)
+      gnn_lstm_session_reset(session);
+    probs = gnn_lstm_session_step(session, X_train[i]);
+    sum = 0;
+    for (w = 0; w < vocab->size; w++)
+    {
+      sum += probs[w];
+      if (probs[w] > probs[X_train[i + 1]])
+        break;
+    }
+    hits += w == vocab->size;
+    for (; w < vocab->size; w++)
+      sum += probs[w];
+    assert(fabs(sum - 1) < 1e-4);
+  }
+  printf("predicted %u of %u\n", hits, size);
+  assert(hits >= 0.5 * size);
+
+  /*!
+  ** saturated inner nodes keep the small branches, which a sigmoid in
+  ** floats rounds to zero past about 17
+  */
+  {
+    float* Y = (float*) malloc(vocab->size * sizeof(float));
+    float* P = (float*) malloc(vocab->size * sizeof(float));
+    double expected;
+    int d;
+
+    for (w = 0; w + 1 < vocab->size; w++)
+      Y[w] = w % 2 ? 20 + w % 7 : -20 - w % 5;
+    gnn_lstm_huffman_forward(P, Y, vocab);
+    for (w = 0; w < vocab->size; w++)
+    {
+      gnn_w2v_word_t const* word = &vocab->words[w];
+      float y;
+
+      expected = 1;
+      for (d = 0; d < word->codelen; d++)
+      {
+        y = word->point[d] % 2 ? 20 + word->point[d] % 7 : -20 - word->point[d] % 5;
+        expected /= 1 + exp(word->code[d] ? y : -y);
+      }
+      assert(fabs(P[w] - expected) <= 1e-5 * expected + 1e-37);
+    }
+    free(Y);
+    free(P);
+  }
+
+  gnn_lstm_session_free(session);
+  gnn_lstm_free(model_layers[0]);
+  gnn_lstm_free(model_layers[1]);
+  gnn_w2v_vocab_free(vocab);
+  free(X_train);
+  return 0;
+}
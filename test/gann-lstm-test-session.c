@@ -0,0 +1,133 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gann-lstm-session.h"
+
+#define LAYERS        2
+#define NEURONS       24
+#define BATCH         16
+#define SESSIONS      5
+
+static int symbols[256];
+static int features;
+
+static uint
+load(const char* path, int** X_train)
+{
+  FILE* fin = fopen(path, "rb");
+  uint size = 0;
+  int c;
+
+  assert(fin != NULL);
+  memset(symbols, -1, sizeof(symbols));
+  *X_train = (int*) malloc(4096 * sizeof(int));
+  while ((c = fgetc(fin)) != EOF && size < 4095)
+  {
+    if (symbols[c] < 0)
+      symbols[c] = features++;
+    (*X_train)[size++] = symbols[c];
+  }
+  fclose(fin);
+  (*X_train)[size] = (*X_train)[0];
+  return size;
+}
+
+static int
+argmax(float const* probs, int size)
+{
+  int ret = 0, i;
+  for (i = 1; i < size; i++)
+    if (probs[i] > probs[ret])
+      ret = i;
+  return ret;
+}
+
+int
+main(int argc, char* argv[])
+{
+  gnn_lstm_params_t params;
+  gnn_lstm_t* model_layers[LAYERS];
+  gnn_lstm_session_t* sessions[SESSIONS];
+  gnn_lstm_session_t* session;
+  int inputs[SESSIONS];
+  float probs[SESSIONS][64];
+  uint size, b, i, hits = 0, total = 0;
+  gnn_rng_t rng;
+  double loss;
+  int* X_train;
+
+  size = load("../../data/test.txt", &X_train);
+  assert(features <= 64);
+
+  memset(&params, 0, sizeof(params));
+  params.loss_moving_avg = 0.01;
+  params.learning_rate = 0.01;
+  params.softmax_temp = 1;
+  params.beta1 = 0.9;
+  params.beta2 = 0.999;
+  params.gradient_clip = 1;
+  params.gradient_clip_limit = 5;
+  params.optimizer = OPTIMIZE_ADAM;
+  params.mini_batch_size = BATCH;
+  params.iterations = 1500;
+
+  gnn_rng_init(&rng, GANN_RNG_SEED, 0);
+  model_layers[0] = gnn_lstm_new(NEURONS, NEURONS, features, 0, &params, &rng);
+  model_layers[1] = gnn_lstm_new(features, NEURONS, NEURONS, 0, &params, &rng);
+  gnn_lstm_train(model_layers, &params, size, X_train, X_train + 1, LAYERS, &loss);
+
+  /*!
+  ** a session fed a minibatch of the text from the zero state predicts it,
+  ** as the training did
+  */
+  session = gnn_lstm_session_new(model_layers, LAYERS);
+  for (b = 0; b + BATCH <= size; b += BATCH)
+  {
+    gnn_lstm_session_reset(session);
+    for (i = b; i < b + BATCH; i++)
+    {
+      hits += argmax(gnn_lstm_session_step(session, X_train[i]), features) == X_train[i + 1];
+      total++;
+    }
+  }
+  printf("loss %lf, predicted %u of %u\n", loss, hits, total);
+  assert(hits >= 0.9 * total);
+
+  i = gnn_lstm_session_sample(session, &rng);
+  assert(i < features);
+
+  /*!
+  ** a batch steps every session as it steps alone
+  */
+  for (b = 0; b < SESSIONS; b++)
+  {
+    sessions[b] = gnn_lstm_session_new(model_layers, LAYERS);
+    inputs[b] = X_train[b];
+  }
+  for (i = 0; i < 8; i++)
+  {
+    gnn_lstm_session_reset(session);
+    for (b = 0; b < SESSIONS; b++)
+    {
+      uint t;
+      for (t = 0; t <= i; t++)
+        gnn_lstm_session_step(session, X_train[b + t]);
+      memcpy(probs[b], session->probs, features * sizeof(float));
+      gnn_lstm_session_reset(session);
+    }
+    for (b = 0; b < SESSIONS; b++)
+      inputs[b] = X_train[b + i];
+    gnn_lstm_session_step_batch(sessions, inputs, SESSIONS);
+    for (b = 0; b < SESSIONS; b++)
+      assert(memcmp(probs[b], sessions[b]->probs, features * sizeof(float)) == 0);
+  }
+
+  for (b = 0; b < SESSIONS; b++)
+    gnn_lstm_session_free(sessions[b]);
+  gnn_lstm_session_free(session);
+  gnn_lstm_free(model_layers[0]);
+  gnn_lstm_free(model_layers[1]);
+  free(X_train);
+  return 0;
+}
@@ -0,0 +1,283 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gann-lstm.h"
+
+#define LAYERS        2
+#define NEURONS       24
+#define PIPELINE_LAYERS 3
+#define WORKERS       3
+
+// not a multiple of the lanes
+#define ADAM_SIZE     1003
+
+// the gates of 7 neurons on 29 symbols
+#define GATHER_N      7
+#define GATHER_R      (4 * GATHER_N)
+#define GATHER_S      (GATHER_N + 29)
+
+static int symbols[256];
+static int features;
+
+/*!
+** reads the text as symbol indices, the sequence wraps around.
+*/
+static uint
+load(const char* path, int** X_train)
+{
+  FILE* fin = fopen(path, "rb");
+  uint size = 0;
+  int c;
+
+  assert(fin != NULL);
+  memset(symbols, -1, sizeof(symbols));
+  *X_train = (int*) malloc(4096 * sizeof(int));
+  while ((c = fgetc(fin)) != EOF && size < 4095)
+  {
+    if (symbols[c] < 0)
+      symbols[c] = features++;
+    (*X_train)[size++] = symbols[c];
+  }
+  fclose(fin);
+  (*X_train)[size] = (*X_train)[0];
+  return size;
+}
+
+static gnn_lstm_t**
+layers_new(gnn_lstm_params_t* params, uint layers)
+{
+  gnn_lstm_t** ret = (gnn_lstm_t**) calloc(layers, sizeof(gnn_lstm_t*));
+  gnn_rng_t rng;
+  uint p;
+
+  gnn_rng_init(&rng, GANN_RNG_SEED, 0);
+  // layer 0 is the output, the last layer takes the symbols
+  ret[0] = gnn_lstm_new(NEURONS, NEURONS, features, 0, params, &rng);
+  for (p = 1; p + 1 < layers; p++)
+    ret[p] = gnn_lstm_new(NEURONS, NEURONS, NEURONS, 0, params, &rng);
+  ret[layers - 1] = gnn_lstm_new(features, NEURONS, NEURONS, 0, params, &rng);
+  return ret;
+}
+
+static void
+layers_free(gnn_lstm_t** model_layers, uint layers)
+{
+  uint p;
+  for (p = 0; p < layers; p++)
+    gnn_lstm_free(model_layers[p]);
+  free(model_layers);
+}
+
+static void
+params_init(gnn_lstm_params_t* params, int optimizer)
+{
+  memset(params, 0, sizeof(gnn_lstm_params_t));
+  params->loss_moving_avg = 0.01;
+  params->learning_rate = optimizer == OPTIMIZE_ADAM ? 0.01 : 0.05;
+  params->momentum = 0.9;
+  params->softmax_temp = 1;
+  params->beta1 = 0.9;
+  params->beta2 = 0.999;
+  params->gradient_clip = 1;
+  params->gradient_fit = 1;
+  params->gradient_clip_limit = 5;
+  params->optimizer = optimizer;
+  params->layers = LAYERS;
+  params->neurons = NEURONS;
+  params->mini_batch_size = 16;
+  params->iterations = 1500;
+}
+
+/*!
+** the fused step over lanes and tail is the plain adam on the clipped and
+** scaled gradients.
+*/
+static void
+check_adam(void)
+{
+  float w[ADAM_SIZE], m[ADAM_SIZE], r[ADAM_SIZE], g[ADAM_SIZE];
+  float ew[ADAM_SIZE], em[ADAM_SIZE], er[ADAM_SIZE];
+  double norm = 0;
+  gnn_rng_t rng;
+  float x;
+  uint i;
+
+  gnn_rng_init(&rng, GANN_RNG_SEED, 1);
+  for (i = 0; i < ADAM_SIZE; i++)
+  {
+    w[i] = gnn_rng_gaussian(&rng);
+    m[i] = 0.1f * gnn_rng_gaussian(&rng);
+    r[i] = gnn_rng_uniform(&rng);
+    g[i] = 2 * gnn_rng_gaussian(&rng);
+
+    x = g[i] > 1 ? 1 : (g[i] < -1 ? -1 : g[i]);
+    norm += x * x;
+    x *= 0.5f;
+    em[i] = 0.9f * m[i] + 0.1f * x;
+    er[i] = 0.999f * r[i] + 0.001f * x * x;
+    ew[i] = w[i] - 0.01f * em[i] / (2 * sqrtf(er[i]) + 1e-8f);
+  }
+  assert(fabs(gnn_vec_clipped_norm2(g, ADAM_SIZE, 1) - norm) < 1e-3);
+
+  gnn_vec_adam(w, m, r, g, ADAM_SIZE, 0.01f, 2, 0.9f, 0.999f, 1, 0.5f);
+  for (i = 0; i < ADAM_SIZE; i++)
+  {
+    assert(fabsf(m[i] - em[i]) < 1e-6f);
+    assert(fabsf(r[i] - er[i]) < 1e-6f);
+    assert(fabsf(w[i] - ew[i]) < 1e-5f);
+  }
+}
+
+/*!
+** the gather of a one hot column and its sparse backward step are the dense
+** product with the one hot vector.
+*/
+static void
+check_gather(void)
+{
+  float A[GATHER_R * GATHER_S], X[GATHER_S], b[GATHER_R], Y[GATHER_R], E[GATHER_R];
+  float dldY[GATHER_R], dldA[GATHER_R * GATHER_S], dldb[GATHER_R], dldX[GATHER_S];
+  float eA[GATHER_R * GATHER_S], eb[GATHER_R], eX[GATHER_S];
+  uint column = GATHER_N + 5, i;
+  gnn_rng_t rng;
+
+  gnn_rng_init(&rng, GANN_RNG_SEED, 2);
+  gnn_vec_fill_gaussian(A, GATHER_R * GATHER_S, 0, 1, &rng, 0);
+  gnn_vec_fill_gaussian(X, GATHER_N, 0, 1, &rng, 0);
+  gnn_vec_fill_gaussian(b, GATHER_R, 0, 1, &rng, 0);
+  gnn_vec_fill_gaussian(dldY, GATHER_R, 0, 1, &rng, 0);
+  memset(X + GATHER_N, 0, (GATHER_S - GATHER_N) * sizeof(float));
+  X[column] = 1;
+
+  gnn_lstm_full_forward(E, A, X, b, GATHER_R, GATHER_S);
+  gnn_lstm_batch_forward(Y, GATHER_R, A, GATHER_S, X, GATHER_N, b, GATHER_R, GATHER_N, 1);
+  gnn_lstm_gather_forward(Y, A, GATHER_S, column, GATHER_R);
+  for (i = 0; i < GATHER_R; i++)
+    assert(fabsf(Y[i] - E[i]) < 1e-4f);
+
+  memset(eA, 0, sizeof(eA));
+  memset(eb, 0, sizeof(eb));
+  memset(dldA, 0, sizeof(dldA));
+  memset(dldb, 0, sizeof(dldb));
+  gnn_lstm_full_backward(dldY, A, X, eA, eX, eb, GATHER_R, GATHER_S);
+  gnn_lstm_gather_backward(dldY, A, GATHER_S, X, column, dldA, dldX, dldb, GATHER_R, GATHER_N);
+  for (i = 0; i < GATHER_R * GATHER_S; i++)
+    assert(fabsf(dldA[i] - eA[i]) < 1e-5f);
+  for (i = 0; i < GATHER_R; i++)
+    assert(fabsf(dldb[i] - eb[i]) < 1e-5f);
+  for (i = 0; i < GATHER_N; i++)
+    assert(fabsf(dldX[i] - eX[i]) < 1e-4f);
+}
+
+int
+main(int argc, char* argv[])
+{
+  gnn_lstm_params_t params;
+  gnn_lstm_t** model_layers;
+  double loss, first;
+  int* X_train;
+  uint size, p;
+  int optimizer;
+
+  check_adam();
+  check_gather();
+
+  size = load("../../data/test.txt", &X_train);
+  assert(size > 0 && features > 1);
+
+  /*!
+  ** both optimizers learn the short text far below the loss of guessing
+  */
+  for (optimizer = OPTIMIZE_ADAM; optimizer <= OPTIMIZE_GRADIENT_DESCENT; optimizer++)
+  {
+    params_init(&params, optimizer);
+    model_layers = layers_new(&params, LAYERS);
+    // the arrays of a layer tile its arena
+    for (p = 0; p < LAYERS; p++)
+    {
+      assert(model_layers[p]->Wf == model_layers[p]->weights);
+      assert(model_layers[p]->by + model_layers[p]->Y == model_layers[p]->weights + model_layers[p]->size);
+    }
+    params.iterations = 1;
+    gnn_lstm_train(model_layers, &params, size, X_train, X_train + 1, LAYERS, &first);
+    params.iterations = 1500;
+    gnn_lstm_train(model_layers, &params, size, X_train, X_train + 1, LAYERS, &loss);
+    printf("optimizer %d: loss %lf -> %lf\n", optimizer, first, loss);
+    assert(first > 0.8 * log(features));
+    assert(loss < 0.5 * first);
+    layers_free(model_layers, LAYERS);
+  }
+
+  /*!
+  ** the stateful training carries the state of a minibatch to the next
+  */
+  params_init(&params, OPTIMIZE_ADAM);
+  params.stateful = 1;
+  model_layers = layers_new(&params, LAYERS);
+  gnn_lstm_train(model_layers, &params, size, X_train, X_train + 1, LAYERS, &loss);
+  printf("stateful: loss %lf\n", loss);
+  assert(loss < 0.5 * first);
+  layers_free(model_layers, LAYERS);
+
+  /*!
+  ** the layers on threads of their own run the same steps as one after the
+  ** other, so they end with the same weights to the bit
+  */
+  for (optimizer = OPTIMIZE_ADAM; optimizer <= OPTIMIZE_GRADIENT_DESCENT; optimizer++)
+  {
+    gnn_lstm_t** serial;
+    double serial_loss;
+
+    params_init(&params, optimizer);
+    params.stateful = 1;
+    params.iterations = 300;
+    serial = layers_new(&params, PIPELINE_LAYERS);
+    gnn_lstm_train(serial, &params, size, X_train, X_train + 1, PIPELINE_LAYERS, &serial_loss);
+
+    params_init(&params, optimizer);
+    params.stateful = 1;
+    params.iterations = 300;
+    params.pipeline = 1;
+    model_layers = layers_new(&params, PIPELINE_LAYERS);
+    gnn_lstm_train(model_layers, &params, size, X_train, X_train + 1, PIPELINE_LAYERS, &loss);
+    printf("pipeline %d: loss %lf\n", optimizer, loss);
+
+    assert(loss == serial_loss);
+    for (p = 0; p < PIPELINE_LAYERS; p++)
+      assert(memcmp(model_layers[p]->weights, serial[p]->weights, model_layers[p]->size * sizeof(float)) == 0);
+    layers_free(serial, PIPELINE_LAYERS);
+    layers_free(model_layers, PIPELINE_LAYERS);
+  }
+
+  /*!
+  ** the workers learn on their slices, and the tree sums up their gradients
+  ** in the same order every run
+  */
+  {
+    gnn_lstm_t** again;
+    double again_loss;
+
+    params_init(&params, OPTIMIZE_ADAM);
+    params.workers = WORKERS;
+    params.mini_batch_size = 8;
+    model_layers = layers_new(&params, LAYERS);
+    gnn_lstm_train(model_layers, &params, size, X_train, X_train + 1, LAYERS, &loss);
+    printf("workers: loss %lf\n", loss);
+    assert(loss < 0.5 * first);
+
+    params_init(&params, OPTIMIZE_ADAM);
+    params.workers = WORKERS;
+    params.mini_batch_size = 8;
+    again = layers_new(&params, LAYERS);
+    gnn_lstm_train(again, &params, size, X_train, X_train + 1, LAYERS, &again_loss);
+    assert(loss == again_loss);
+    for (p = 0; p < LAYERS; p++)
+      assert(memcmp(model_layers[p]->weights, again[p]->weights, again[p]->size * sizeof(float)) == 0);
+    layers_free(model_layers, LAYERS);
+    layers_free(again, LAYERS);
+  }
+
+  free(X_train);
+  return 0;
+}
@@ -90,8 +90,6 @@ int main(int argc, char *argv[])
 {
   printf("Train an ANN on the IRIS dataset using backpropagation.\n");
 
-  srand(time(0));
-
   /* Load the data from file. */
   load_data();
 
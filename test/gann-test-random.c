@@ -0,0 +1,65 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "gann.h"
+
+// not a multiple of the lanes or the blocks, and more than one thread's grain
+#define SIZE      1000003
+
+int
+main(int argc, char* argv[])
+{
+  float* a = (float*) malloc(SIZE * sizeof(float));
+  float* b = (float*) malloc(SIZE * sizeof(float));
+  gnn_rng_t rng, ref;
+  double sum = 0, squares = 0;
+  uint i;
+
+  /*!
+  ** the uniform fill is the loop of gnn_rng_uniform
+  */
+  gnn_rng_init(&rng, GANN_RNG_SEED, 3);
+  gnn_rng_init(&ref, GANN_RNG_SEED, 3);
+  gnn_rng_uniform(&rng);
+  gnn_rng_uniform(&ref);
+  gnn_vec_fill_uniform(a, SIZE, 0, 1, &rng, 4);
+  for (i = 0; i < SIZE; i++)
+    assert(a[i] == gnn_rng_uniform(&ref));
+  assert(rng.counter == ref.counter);
+
+  /*!
+  ** the threads do not change the numbers
+  */
+  gnn_rng_init(&rng, GANN_RNG_SEED, 0);
+  gnn_vec_fill_uniform(a, SIZE, -0.25f, 0.25f, &rng, 1);
+  gnn_rng_init(&rng, GANN_RNG_SEED, 0);
+  gnn_vec_fill_uniform(b, SIZE, -0.25f, 0.25f, &rng, 0);
+  assert(memcmp(a, b, SIZE * sizeof(float)) == 0);
+  for (i = 0; i < SIZE; i++)
+    assert(a[i] >= -0.25f && a[i] < 0.25f);
+
+  gnn_rng_init(&rng, GANN_RNG_SEED, 0);
+  gnn_vec_fill_gaussian(a, SIZE, 1, 2, &rng, 1);
+  assert(rng.counter == SIZE + 1);
+  gnn_rng_init(&rng, GANN_RNG_SEED, 0);
+  gnn_vec_fill_gaussian(b, SIZE, 1, 2, &rng, 7);
+  assert(memcmp(a, b, SIZE * sizeof(float)) == 0);
+
+  for (i = 0; i < SIZE; i++)
+  {
+    assert(isfinite(a[i]));
+    sum += a[i];
+    squares += a[i] * a[i];
+  }
+  sum /= SIZE;
+  squares = squares / SIZE - sum * sum;
+  printf("mean: %f, variance: %f\n", sum, squares);
+  assert(fabs(sum - 1) < 0.01);
+  assert(fabs(squares - 4) < 0.05);
+
+  free(a);
+  free(b);
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gann-w2v-analogy.h"
+
+#define DIM         8
+
+/*!
+** every word is the sum of two axes, so b - a + c of a question is exactly
+** the vector of its answer.
+*/
+static const char* words[] = {
+  "athens", "greece", "oslo", "norway", "madrid",
+  "boy", "girl", "king", "queen"
+};
+
+static const int axes[][2] = {
+  {0, 1}, {2, 1}, {0, 3}, {2, 3}, {4, 5},
+  {4, 6}, {5, 6}, {4, 7}, {5, 7}
+};
+
+/*!
+** the questions, a wrong answer and out of vocabulary words are counted but
+** only the questions of known words are seen.
+*/
+static const char* questions =
+  ": capital-common-countries\n"
+  "athens greece oslo norway\n"
+  "athens greece oslo madrid\n"
+  "athens greece oslo atlantis\n"
+  ": family\n"
+  "boy girl king queen\n"
+  "boy girl prince queen\n";
+
+static void
+check_section(gnn_w2v_analogy_section_t const* section, const char* name, llong total, llong seen, llong correct)
+{
+  assert(strcmp(section->name, name) == 0);
+  assert(section->total == total);
+  assert(section->seen == seen);
+  assert(section->correct == correct);
+}
+
+/*!
+** usage: gann-w2v-test-analogy [model.bin analogy.txt [threads]]
+**
+** with a model in the binary format written by gnn_w2v_save, prints its
+** accuracy on the analogy file.
+*/
+int
+main(int argc, char* argv[])
+{
+  uint threads = argc > 3 ? atoi(argv[3]) : 4;
+  float vectors[sizeof(words) / sizeof(words[0])][DIM];
+  llong size = sizeof(words) / sizeof(words[0]), w;
+  gnn_w2v_store_t* store;
+  gnn_w2v_knn_t* knn;
+  gnn_w2v_knn_t* partial;
+  gnn_w2v_analogy_t* analogy;
+  FILE* fout;
+
+  if (argc > 2)
+  {
+    store = gnn_w2v_store_open(argv[1]);
+    assert(store != NULL);
+    knn = gnn_w2v_knn_from_store(store);
+    analogy = gnn_w2v_analogy_evaluate(store, knn, argv[2], threads);
+    assert(analogy != NULL);
+    gnn_w2v_analogy_print(analogy, stdout);
+    gnn_w2v_analogy_free(analogy);
+    gnn_w2v_knn_free(knn);
+    gnn_w2v_store_close(store);
+    return 0;
+  }
+
+  memset(vectors, 0, sizeof(vectors));
+  for (w = 0; w < size; w++)
+  {
+    vectors[w][axes[w][0]] = 1;
+    vectors[w][axes[w][1]] = 1;
+  }
+  assert(gnn_w2v_store_write("./analogy.bin", &vectors[0][0], words, size, DIM) == 0);
+  fout = fopen("./analogy-questions.txt", "wb");
+  assert(fout != NULL);
+  fputs(questions, fout);
+  fclose(fout);
+
+  store = gnn_w2v_store_open("./analogy.bin");
+  assert(store != NULL);
+  knn = gnn_w2v_knn_from_store(store);
+
+  assert(gnn_w2v_analogy_evaluate(store, knn, "./no-such-questions.txt", threads) == NULL);
+
+  // a searcher over some of the words would answer with other ids
+  partial = gnn_w2v_knn_new(store->vectors, size - 1, DIM, store->stride);
+  assert(gnn_w2v_analogy_evaluate(store, partial, "./analogy-questions.txt", threads) == NULL);
+  gnn_w2v_knn_free(partial);
+
+  analogy = gnn_w2v_analogy_evaluate(store, knn, "./analogy-questions.txt", threads);
+  assert(analogy != NULL);
+  gnn_w2v_analogy_print(analogy, stdout);
+  assert(analogy->section_num == 2);
+  check_section(&analogy->sections[0], "capital-common-countries", 3, 2, 1);
+  check_section(&analogy->sections[1], "family", 2, 1, 1);
+  assert(analogy->total == 5);
+  assert(analogy->seen == 3);
+  assert(analogy->correct == 2);
+
+  gnn_w2v_analogy_free(analogy);
+  gnn_w2v_knn_free(knn);
+  gnn_w2v_store_close(store);
+  remove("./analogy.bin");
+  remove("./analogy-questions.txt");
+  return 0;
+}
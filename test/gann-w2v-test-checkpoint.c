@@ -0,0 +1,57 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gann-w2v.h"
+
+// the hogwild threads race, one thread makes the training repeatable
+extern int num_threads;
+
+static int
+gnn_w2v_same(gnn_w2v_t const* a, gnn_w2v_t const* b)
+{
+  size_t size = (size_t) a->vocab_size * a->dim_num * sizeof(real);
+  return a->vocab_size == b->vocab_size &&
+         memcmp(a->hidden_weights, b->hidden_weights, size) == 0 &&
+         memcmp(a->output_weights, b->output_weights, size) == 0 &&
+         memcmp(a->negative_samplings, b->negative_samplings, size) == 0;
+}
+
+int
+main(int argc, char* argv[])
+{
+  gnn_w2v_vocab_t* vocab = gnn_w2v_read("../../data/test.txt");
+  gnn_w2v_vocab_t* resumed_vocab;
+  gnn_w2v_t* full;
+  gnn_w2v_t* segmented;
+  gnn_w2v_t* resumed;
+  gnn_w2v_skipgram_options_t options;
+
+  num_threads = 1;
+  remove("./test.ckpt");
+  full = gnn_w2v_skipgram("../../data/test.txt", vocab, 0, 2, NULL);
+  assert(full != NULL);
+
+  /*!
+  ** the checkpoints cut the passes into segments without changing the result
+  */
+  options.checkpoint_path = "./test.ckpt";
+  options.checkpoint_words = 500;
+  segmented = gnn_w2v_skipgram("../../data/test.txt", vocab, 0, 2, &options);
+  assert(segmented != NULL);
+  assert(gnn_w2v_same(full, segmented));
+
+  // the latest checkpoint is taken before the end, and the job goes on from it
+  assert(gnn_w2v_skipgram_resume("./not-found.ckpt", "../../data/test.txt", 0, 2, NULL, &resumed_vocab) == NULL);
+  resumed = gnn_w2v_skipgram_resume("./test.ckpt", "../../data/test.txt", 0, 2, NULL, &resumed_vocab);
+  assert(resumed != NULL);
+  assert(resumed_vocab->size == vocab->size);
+  assert(gnn_w2v_same(full, resumed));
+
+  gnn_w2v_free(full);
+  gnn_w2v_free(segmented);
+  gnn_w2v_free(resumed);
+  gnn_w2v_vocab_free(vocab);
+  gnn_w2v_vocab_free(resumed_vocab);
+  return 0;
+}
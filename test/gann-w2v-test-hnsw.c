@@ -0,0 +1,127 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "gann-w2v-hnsw.h"
+
+#define ROWS      10000
+#define DIMS      64
+#define QUERIES   200
+#define K         10
+
+static char* image;
+static size_t image_size;
+
+/*!
+** writes the index image with size bytes at a position replaced, the index
+** must not open.
+*/
+static void
+check_corrupt(size_t at, const void* value, size_t size)
+{
+  char* copy = (char*) malloc(image_size);
+  FILE* fout;
+
+  memcpy(copy, image, image_size);
+  memcpy(copy + at, value, size);
+  fout = fopen("./corrupt.hnsw", "wb");
+  assert(fout != NULL);
+  assert(fwrite(copy, 1, image_size, fout) == image_size);
+  fclose(fout);
+  assert(gnn_w2v_hnsw_open("./corrupt.hnsw") == NULL);
+  remove("./corrupt.hnsw");
+  free(copy);
+}
+
+int
+main(int argc, char* argv[])
+{
+  uint i, j, l, hits = 0;
+  gnn_rng_t rng;
+  gnn_rng_init(&rng, GANN_RNG_SEED, 0);
+  float* vectors = gnn_vec_new(ROWS * DIMS, 5, &rng);
+  float* queries = gnn_vec_new(QUERIES * DIMS, 5, &rng);
+  gnn_w2v_neighbor_t exact[K], approx[K];
+  gnn_w2v_neighbor_t* truth = (gnn_w2v_neighbor_t*) malloc(QUERIES * K * sizeof(gnn_w2v_neighbor_t));
+  gnn_w2v_neighbor_t* found = (gnn_w2v_neighbor_t*) malloc(QUERIES * K * sizeof(gnn_w2v_neighbor_t));
+  gnn_w2v_knn_t* knn = gnn_w2v_knn_new(vectors, ROWS, DIMS, DIMS);
+  gnn_w2v_hnsw_t* hnsw = gnn_w2v_hnsw_new(vectors, ROWS, DIMS, DIMS,
+                                          GANN_W2V_HNSW_M, GANN_W2V_HNSW_EF_CONSTRUCTION, 4);
+  gnn_w2v_hnsw_t* mapped;
+  gnn_w2v_hnsw_header_t const* header;
+  clock_t start;
+  double exact_ms, hnsw_ms;
+  llong entry_point = ROWS;
+  ullong offset;
+  uint value;
+
+  /*!
+  ** the exact and approximate searches are timed apart, the recall is
+  ** checked after both.
+  */
+  start = clock();
+  for (i = 0; i < QUERIES; i++)
+    gnn_w2v_knn_search(knn, queries + i * DIMS, K, truth + i * K);
+  exact_ms = (clock() - start) * 1000.0 / CLOCKS_PER_SEC / QUERIES;
+
+  hnsw->ef_search = 200;
+  start = clock();
+  for (i = 0; i < QUERIES; i++)
+    assert(gnn_w2v_hnsw_search(hnsw, queries + i * DIMS, K, found + i * K) == K);
+  hnsw_ms = (clock() - start) * 1000.0 / CLOCKS_PER_SEC / QUERIES;
+
+  for (i = 0; i < QUERIES; i++)
+    for (j = 0; j < K; j++)
+      for (l = 0; l < K; l++)
+        if (truth[i * K + j].id == found[i * K + l].id) hits++;
+  printf("recall@%d = %.3f at ef_search %d, %.3f ms/query, exact %.3f ms/query\n", K,
+         hits / (float) (QUERIES * K), hnsw->ef_search, hnsw_ms, exact_ms);
+  assert(hits >= QUERIES * K * 0.95);
+
+  assert(gnn_w2v_hnsw_save(hnsw, "./test.hnsw") == 0);
+  mapped = gnn_w2v_hnsw_open("./test.hnsw");
+  assert(mapped != NULL);
+  mapped->ef_search = hnsw->ef_search;
+  for (i = 0; i < QUERIES; i++)
+  {
+    gnn_w2v_hnsw_search(hnsw, queries + i * DIMS, K, exact);
+    gnn_w2v_hnsw_search(mapped, queries + i * DIMS, K, approx);
+    for (j = 0; j < K; j++)
+      assert(exact[j].id == approx[j].id);
+  }
+
+  /*!
+  ** sections past the file and a graph that leaves its nodes are rejected
+  */
+  image_size = mapped->length;
+  image = (char*) malloc(image_size);
+  memcpy(image, mapped->base, image_size);
+  header = (gnn_w2v_hnsw_header_t const*) image;
+  check_corrupt(offsetof(gnn_w2v_hnsw_header_t, entry_point), &entry_point, sizeof(entry_point));
+  offset = image_size;
+  check_corrupt(offsetof(gnn_w2v_hnsw_header_t, links0_offset), &offset, sizeof(offset));
+  offset = image_size - sizeof(uint);
+  check_corrupt(offsetof(gnn_w2v_hnsw_header_t, levels_offset), &offset, sizeof(offset));
+  offset = (ullong) -1;
+  check_corrupt(offsetof(gnn_w2v_hnsw_header_t, upper_size), &offset, sizeof(offset));
+  value = 0;
+  check_corrupt(offsetof(gnn_w2v_hnsw_header_t, M0), &value, sizeof(value));
+  value = GANN_W2V_HNSW_MAX_LEVEL + 1;
+  check_corrupt(header->levels_offset, &value, sizeof(value));
+  assert(*(uint const*) (image + header->links0_offset) > 0);
+  value = ROWS;
+  check_corrupt(header->links0_offset + sizeof(uint), &value, sizeof(value));
+  free(image);
+
+  gnn_w2v_hnsw_free(mapped);
+  gnn_w2v_hnsw_free(hnsw);
+  gnn_w2v_hnsw_release();
+  gnn_w2v_knn_free(knn);
+  free(truth);
+  free(found);
+  free(vectors);
+  free(queries);
+  return 0;
+}
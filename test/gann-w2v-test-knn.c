@@ -0,0 +1,47 @@
+#include <assert.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "gann-w2v-knn.h"
+
+#define ROWS      1000
+#define DIMS      100
+#define QUERIES   37
+#define K         10
+
+int
+main(int argc, char* argv[])
+{
+  uint i, j;
+  gnn_rng_t rng;
+  gnn_rng_init(&rng, GANN_RNG_SEED, 0);
+  float* vectors = gnn_vec_new(ROWS * DIMS, 5, &rng);
+  gnn_w2v_neighbor_t single[K];
+  gnn_w2v_neighbor_t* batch = (gnn_w2v_neighbor_t*) calloc(QUERIES * K, sizeof(gnn_w2v_neighbor_t));
+  gnn_w2v_knn_t* knn = gnn_w2v_knn_new(vectors, ROWS, DIMS, DIMS);
+
+  /*!
+  ** every row is the nearest neighbour of itself.
+  */
+  for (i = 0; i < QUERIES; i++)
+  {
+    assert(gnn_w2v_knn_search(knn, vectors + i * DIMS, K, single) == K);
+    assert(single[0].id == i);
+    assert(fabs(single[0].similarity - 1.0) < 1e-4);
+    for (j = 1; j < K; j++)
+      assert(single[j - 1].similarity >= single[j].similarity);
+  }
+
+  gnn_w2v_knn_search_batch(knn, vectors, QUERIES, K, batch, 4);
+  for (i = 0; i < QUERIES; i++)
+  {
+    gnn_w2v_knn_search(knn, vectors + i * DIMS, K, single);
+    for (j = 0; j < K; j++)
+      assert(batch[i * K + j].id == single[j].id);
+  }
+
+  gnn_w2v_knn_free(knn);
+  free(batch);
+  free(vectors);
+  return 0;
+}
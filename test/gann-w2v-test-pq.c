@@ -0,0 +1,127 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gann-w2v-pq.h"
+
+#define ROWS      5000
+#define DIMS      64
+#define M         16
+#define QUERIES   100
+#define K         10
+
+static char* image;
+static size_t image_size;
+
+/*!
+** writes the quantizer image with size bytes at a position replaced, the
+** quantizer must not open.
+*/
+static void
+check_corrupt(size_t at, const void* value, size_t size)
+{
+  char* copy = (char*) malloc(image_size);
+  FILE* fout;
+
+  memcpy(copy, image, image_size);
+  memcpy(copy + at, value, size);
+  fout = fopen("./corrupt.pq", "wb");
+  assert(fout != NULL);
+  assert(fwrite(copy, 1, image_size, fout) == image_size);
+  fclose(fout);
+  assert(gnn_w2v_pq_open("./corrupt.pq") == NULL);
+  remove("./corrupt.pq");
+  free(copy);
+}
+
+int
+main(int argc, char* argv[])
+{
+  uint i, j, l, hits = 0, value;
+  llong size;
+  ullong offset;
+  gnn_rng_t rng;
+  gnn_rng_init(&rng, GANN_RNG_SEED, 0);
+  float* vectors = gnn_vec_new(ROWS * DIMS, 5, &rng);
+  float decoded[DIMS], original[DIMS];
+  float cosine = 0;
+  gnn_w2v_neighbor_t exact[K], approx[K * 4];
+  gnn_w2v_knn_t* knn = gnn_w2v_knn_new(vectors, ROWS, DIMS, DIMS);
+  gnn_w2v_pq_t* pq = gnn_w2v_pq_new(vectors, ROWS, DIMS, DIMS, M, 4);
+  gnn_w2v_pq_t* mapped;
+
+  for (i = 0; i < ROWS; i++)
+  {
+    gnn_vec_copy(original, vectors + i * DIMS, DIMS);
+    gnn_vec_normalize(original, DIMS);
+    gnn_w2v_pq_decode(pq, i, decoded);
+    cosine += gnn_vec_dot(original, decoded, DIMS);
+  }
+  cosine /= ROWS;
+
+  /*!
+  ** recall of the exact top 10 in the top 40 by asymmetric distance
+  */
+  for (i = 0; i < QUERIES; i++)
+  {
+    gnn_w2v_knn_search(knn, vectors + i * DIMS, K, exact);
+    assert(gnn_w2v_pq_search(pq, vectors + i * DIMS, K * 4, approx) == K * 4);
+    for (j = 0; j < K; j++)
+      for (l = 0; l < K * 4; l++)
+        if (exact[j].id == approx[l].id) hits++;
+  }
+  printf("reconstruction cosine = %.3f, recall@%d in %d = %.3f, %d bytes per vector\n",
+         cosine, K, K * 4, hits / (float) (QUERIES * K), M);
+  assert(cosine > 0.8);
+  assert(hits >= QUERIES * K * 0.5);
+
+  assert(gnn_w2v_pq_save(pq, "./test.pq") == 0);
+  mapped = gnn_w2v_pq_open("./test.pq");
+  assert(mapped != NULL);
+  for (i = 0; i < QUERIES; i++)
+  {
+    gnn_w2v_pq_search(pq, vectors + i * DIMS, K, exact);
+    gnn_w2v_pq_search(mapped, vectors + i * DIMS, K, approx);
+    for (j = 0; j < K; j++)
+      assert(exact[j].id == approx[j].id);
+  }
+
+  /*!
+  ** a broken shape, sections past the file and codes past the trained
+  ** centroids are rejected
+  */
+  image_size = mapped->length;
+  image = (char*) malloc(image_size);
+  memcpy(image, mapped->base, image_size);
+  value = 0;
+  check_corrupt(offsetof(gnn_w2v_pq_header_t, m), &value, sizeof(value));
+  check_corrupt(offsetof(gnn_w2v_pq_header_t, sub_dim), &value, sizeof(value));
+  check_corrupt(offsetof(gnn_w2v_pq_header_t, centroid_num), &value, sizeof(value));
+  value = GANN_W2V_PQ_CENTROIDS + 1;
+  check_corrupt(offsetof(gnn_w2v_pq_header_t, centroid_num), &value, sizeof(value));
+  value = DIMS + 1;
+  check_corrupt(offsetof(gnn_w2v_pq_header_t, dim_num), &value, sizeof(value));
+  value = DIMS;
+  check_corrupt(offsetof(gnn_w2v_pq_header_t, sub_dim), &value, sizeof(value));
+  size = ROWS + 1;
+  check_corrupt(offsetof(gnn_w2v_pq_header_t, size), &size, sizeof(size));
+  size = -1;
+  check_corrupt(offsetof(gnn_w2v_pq_header_t, size), &size, sizeof(size));
+  offset = image_size - 4;
+  check_corrupt(offsetof(gnn_w2v_pq_header_t, centroids_offset), &offset, sizeof(offset));
+  offset = image_size - 1;
+  check_corrupt(offsetof(gnn_w2v_pq_header_t, codes_offset), &offset, sizeof(offset));
+  offset = image_size + 1;
+  check_corrupt(offsetof(gnn_w2v_pq_header_t, file_size), &offset, sizeof(offset));
+  // the codes use all 256 centroids
+  value = 8;
+  check_corrupt(offsetof(gnn_w2v_pq_header_t, centroid_num), &value, sizeof(value));
+  free(image);
+
+  gnn_w2v_pq_free(mapped);
+  gnn_w2v_pq_free(pq);
+  gnn_w2v_knn_free(knn);
+  free(vectors);
+  return 0;
+}
@@ -0,0 +1,169 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "gann-w2v-reader.h"
+
+#define CONSUMERS     4
+#define TAKERS        3
+#define ITERATIONS    7
+
+static gnn_w2v_reader_t* reader;
+
+static ullong consumed[CONSUMERS];
+
+static ullong taken[TAKERS];
+
+/*!
+** folds a sentence into the hash of a consumer.
+*/
+static ullong
+fold(ullong hash, const int* ids, uint length)
+{
+  uint i;
+  for (i = 0; i < length; i++)
+    hash = hash * 1000003 + ids[i];
+  return hash * 1000003 + length;
+}
+
+/*!
+** pops every sentence of a reader into one id sequence.
+*/
+static ullong
+drain(gnn_w2v_reader_t* r, int* sequence)
+{
+  int ids[GANN_W2V_MAX_SENTENCE_LENGTH];
+  ullong ret = 0;
+  uint length;
+  while ((length = gnn_w2v_reader_next(r, ids)) > 0)
+  {
+    memcpy(sequence + ret, ids, length * sizeof(int));
+    ret += length;
+  }
+  return ret;
+}
+
+static void*
+consume(void* data)
+{
+  int ids[GANN_W2V_MAX_SENTENCE_LENGTH];
+  llong id = (llong) data;
+  uint length, i;
+  while ((length = gnn_w2v_reader_next(reader, ids)) > 0)
+  {
+    for (i = 0; i < length; i++)
+      assert(ids[i] > 0 && ids[i] < reader->vocab->size);
+    consumed[id] += length;
+  }
+  return NULL;
+}
+
+static void*
+take(void* data)
+{
+  int ids[GANN_W2V_MAX_SENTENCE_LENGTH];
+  llong id = (llong) data;
+  ullong position = id;
+  uint length;
+  while ((length = gnn_w2v_reader_take(reader, &position, TAKERS, ids)) > 0)
+    taken[id] = fold(taken[id], ids, length);
+  return NULL;
+}
+
+int
+main(int argc, char* argv[])
+{
+  pthread_t threads[CONSUMERS];
+  ullong total = 0;
+  llong i;
+  gnn_w2v_vocab_t* vocab = gnn_w2v_read("../../data/chapter.txt");
+
+  /*!
+  ** a tiny ring makes the producer and the consumers wait on each other.
+  */
+  reader = gnn_w2v_reader_new("../../data/chapter.txt", vocab, 0, ITERATIONS, 2, GANN_RNG_SEED);
+  assert(reader != NULL);
+  for (i = 0; i < CONSUMERS; i++)
+    pthread_create(&threads[i], NULL, consume, (void*) i);
+  for (i = 0; i < CONSUMERS; i++)
+  {
+    pthread_join(threads[i], NULL);
+    total += consumed[i];
+  }
+
+  // every word but </s> is popped exactly once per pass
+  assert(total == ITERATIONS * (reader->train_words - 1));
+  assert(total == reader->word_count);
+  gnn_w2v_reader_free(reader);
+
+  assert(gnn_w2v_reader_new("../../data/not-found.txt", vocab, 0, 1, 2, GANN_RNG_SEED) == NULL);
+
+  /*!
+  ** a consumer taking its own positions gets sentence k of the corpus when
+  ** k mod TAKERS is its id, however the threads are scheduled
+  */
+  {
+    gnn_w2v_vocab_t* text = gnn_w2v_read("../../data/analogy.txt");
+    int ids[GANN_W2V_MAX_SENTENCE_LENGTH];
+    ullong expected[TAKERS] = {0}, k = 0;
+    uint length;
+
+    reader = gnn_w2v_reader_new("../../data/analogy.txt", text, 1, 1, 2, GANN_RNG_SEED);
+    while ((length = gnn_w2v_reader_next(reader, ids)) > 0)
+    {
+      expected[k % TAKERS] = fold(expected[k % TAKERS], ids, length);
+      k++;
+    }
+    gnn_w2v_reader_free(reader);
+    assert(k > TAKERS * 4);
+
+    reader = gnn_w2v_reader_new("../../data/analogy.txt", text, 1, 1, 2, GANN_RNG_SEED);
+    for (i = 0; i < TAKERS; i++)
+      pthread_create(&threads[i], NULL, take, (void*) i);
+    for (i = 0; i < TAKERS; i++)
+    {
+      pthread_join(threads[i], NULL);
+      assert(taken[i] == expected[i]);
+    }
+    gnn_w2v_reader_free(reader);
+    gnn_w2v_vocab_free(text);
+  }
+
+  /*!
+  ** a reader stopped by its limit and resumed from its state pushes the same
+  ** subsampled words as one that never stopped, the long text stops inside
+  ** the passes too
+  */
+  {
+    gnn_w2v_vocab_t* text = gnn_w2v_read("../../data/analogy.txt");
+    ullong size, n, m = 0;
+    gnn_w2v_reader_state_t state;
+    int* whole;
+    int* parts;
+
+    reader = gnn_w2v_reader_new("../../data/analogy.txt", text, 1, 2, 16, GANN_RNG_SEED);
+    size = 2 * reader->train_words;
+    whole = (int*) malloc(size * sizeof(int));
+    parts = (int*) malloc(size * sizeof(int));
+    n = drain(reader, whole);
+    gnn_w2v_reader_free(reader);
+
+    state.iteration = 0;
+    state.offset = 0;
+    gnn_rng_init(&state.rng, GANN_RNG_SEED, 0);
+    while (state.iteration < 2)
+    {
+      reader = gnn_w2v_reader_resume("../../data/analogy.txt", text, 1, 2, 16, &state, 2500);
+      m += drain(reader, parts + m);
+      state = reader->state;
+      gnn_w2v_reader_free(reader);
+    }
+    assert(n > 0 && n == m);
+    assert(memcmp(whole, parts, n * sizeof(int)) == 0);
+    free(whole);
+    free(parts);
+    gnn_w2v_vocab_free(text);
+  }
+  return 0;
+}
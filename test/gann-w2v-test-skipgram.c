@@ -2,11 +2,14 @@
 #include <gfc.h>
 
 #include "gann-w2v.h"
+#include "gann-w2v-store.h"
 
 int
 main(int argc, char* argv[])
 {
   int i, j;
+  int ids[GANN_W2V_MAX_SUBWORDS];
+  real vec[300];
   gnn_w2v_vocab_t* vocab = gnn_w2v_read("../../data/chapter.txt");
   FILE* out = fopen("../../debug.txt", "w");
 
@@ -25,7 +28,19 @@ main(int argc, char* argv[])
     fprintf(out, "\n");
   }
   assert(vocab != NULL);
-  gnn_w2v_skipgram("../../data/chapter.txt", vocab, 5, 2);
-//  gnn_w2v_train(vocab, 100, 100, "./analogy.bin");
+
+  // <棕黄色> has 3 + 2 n-grams, the whole <棕黄色> is not one of them
+  assert(gnn_w2v_subwords("棕黄色", ids, GANN_W2V_MAX_SUBWORDS, 1 << 16) == 5);
+  assert(gnn_w2v_subwords("ab", ids, GANN_W2V_MAX_SUBWORDS, 1 << 16) == 2);
+  gnn_w2v_vocab_subwords(vocab, 1 << 16);
+
+  gnn_w2v_t* w2v = gnn_w2v_skipgram("../../data/chapter.txt", vocab, 5, 2, NULL);
+  assert(gnn_w2v_save(w2v, vocab, "./chapter.bin") == 0);
+
+  // the unseen word still gets a vector from its subwords and characters
+  assert(gnn_w2v_word_index(vocab, "棕黄色的头发") == -1);
+  assert(gnn_w2v_oov_vector(w2v, "棕黄色的头发", vec) > 0);
+  assert(gnn_vec_normalize(vec, w2v->dim_num) > 0);
+  gnn_w2v_free(w2v);
   return 0;
 }
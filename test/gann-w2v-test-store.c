@@ -0,0 +1,85 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gfc.h>
+
+#include "gann-w2v.h"
+#include "gann-w2v-store.h"
+
+static char* image;
+static size_t image_size;
+
+/*!
+** writes the store image with a field of the header replaced, the store
+** must not open.
+*/
+static void
+check_corrupt(size_t field, ullong value)
+{
+  char* copy = (char*) malloc(image_size);
+  FILE* fout;
+
+  memcpy(copy, image, image_size);
+  memcpy(copy + field, &value, sizeof(value));
+  fout = fopen("./corrupt.bin", "wb");
+  assert(fout != NULL);
+  assert(fwrite(copy, 1, image_size, fout) == image_size);
+  fclose(fout);
+  assert(gnn_w2v_store_open("./corrupt.bin") == NULL);
+  remove("./corrupt.bin");
+  free(copy);
+}
+
+int
+main(int argc, char* argv[])
+{
+  llong i;
+  uint j;
+  gnn_rng_t rng;
+  gnn_w2v_vocab_t* vocab = gnn_w2v_read("../../data/test.txt");
+  gnn_w2v_t* w2v;
+  gnn_w2v_store_t* store;
+
+  gnn_rng_init(&rng, GANN_RNG_SEED, 0);
+  w2v = gnn_w2v_new(vocab, 50, GANN_MEM_HUGE_PAGES | GANN_MEM_INTERLEAVE | GANN_MEM_FIRST_TOUCH, &rng);
+
+  assert(gnn_w2v_save(w2v, vocab, "./test.bin") == 0);
+
+  store = gnn_w2v_store_open("./test.bin");
+  assert(store != NULL);
+  assert(store->vocab_size == vocab->size);
+  assert(store->dim_num == w2v->dim_num);
+  assert(((size_t) store->vectors) % 64 == 0);
+
+  for (i = 0; i < vocab->size; i++)
+  {
+    const float* vec = gnn_w2v_store_vector(store, i);
+    assert(gnn_w2v_store_index(store, vocab->words[i].word) == i);
+    assert(strcmp(gnn_w2v_store_word(store, i), vocab->words[i].word) == 0);
+    for (j = 0; j < w2v->dim_num; j++)
+      assert(vec[j] == w2v->hidden_weights[i * w2v->dim_num + j]);
+  }
+  assert(gnn_w2v_store_index(store, "not-a-word") == -1);
+
+  /*!
+  ** a header whose sections leave the file is rejected
+  */
+  image_size = store->length;
+  image = (char*) malloc(image_size);
+  memcpy(image, store->base, image_size);
+  check_corrupt(offsetof(gnn_w2v_store_header_t, vocab_size), 1ULL << 40);
+  check_corrupt(offsetof(gnn_w2v_store_header_t, stride), 0);
+  check_corrupt(offsetof(gnn_w2v_store_header_t, vectors_offset), image_size);
+  check_corrupt(offsetof(gnn_w2v_store_header_t, offsets_offset), image_size - 8);
+  check_corrupt(offsetof(gnn_w2v_store_header_t, strings_offset), image_size - 1);
+  check_corrupt(offsetof(gnn_w2v_store_header_t, hashes_offset), (ullong) -4);
+  check_corrupt(offsetof(gnn_w2v_store_header_t, hash_size), 0);
+  check_corrupt(offsetof(gnn_w2v_store_header_t, hash_size), 3);
+  check_corrupt(offsetof(gnn_w2v_store_header_t, file_size), image_size + 1);
+  free(image);
+
+  gnn_w2v_store_close(store);
+  gnn_w2v_free(w2v);
+  return 0;
+}
@@ -0,0 +1,135 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "gann-w2v.h"
+#include "gann-w2v-model.h"
+
+/*!
+** the hierarchical softmax loss of every known word given every known word,
+** which depends on both the Huffman paths and the output rows.
+*/
+static double
+hs_loss(gnn_w2v_t const* w2v, gnn_w2v_vocab_t const* vocab, llong size)
+{
+  uint dims = w2v->dim_num;
+  double loss = 0, f;
+  llong u, w;
+  int d;
+
+  for (u = 1; u < size; u++)
+    for (w = 1; w < size; w++)
+      for (d = 0; d < vocab->words[w].codelen; d++)
+      {
+        f = gnn_vec_dot(w2v->hidden_weights + u * dims,
+                        w2v->output_weights + (llong) vocab->words[w].point[d] * dims, dims);
+        loss += log1p(exp(vocab->words[w].code[d] ? f : -f));
+      }
+  return loss;
+}
+
+/*!
+** whether the two vocabularies give the words from from to size the same
+** paths.
+*/
+static int
+same_paths(gnn_w2v_vocab_t const* a, gnn_w2v_vocab_t const* b, llong from, llong size)
+{
+  llong w;
+
+  for (w = from; w < size; w++)
+    if (a->words[w].codelen != b->words[w].codelen ||
+        memcmp(a->words[w].code, b->words[w].code, a->words[w].codelen) != 0 ||
+        memcmp(a->words[w].point, b->words[w].point, a->words[w].codelen * sizeof(int)) != 0)
+      return 0;
+  return 1;
+}
+
+int
+main(int argc, char* argv[])
+{
+  gnn_w2v_vocab_t* vocab = gnn_w2v_read("../../data/test.txt");
+  gnn_w2v_t* w2v = gnn_w2v_skipgram("../../data/test.txt", vocab, 0, 2, NULL);
+  llong size = vocab->size, wood = gnn_w2v_word_index(vocab, "wood");
+  ullong count = vocab->words[wood].count;
+  size_t length = (size_t) size * w2v->dim_num;
+  real* hidden = (real*) malloc(length * sizeof(real));
+  real* row = (real*) malloc(w2v->dim_num * sizeof(real));
+  gnn_w2v_vocab_t* trained = gnn_w2v_read("../../data/test.txt");
+  gnn_w2v_vocab_t* loaded;
+  gnn_w2v_t* reloaded;
+  double loss = hs_loss(w2v, vocab, size);
+  gnn_rng_t rng;
+  llong a, grown;
+  size_t i;
+  int d;
+
+  assert(w2v != NULL);
+  memcpy(hidden, w2v->hidden_weights, length * sizeof(real));
+  assert(gnn_w2v_model_save(w2v, vocab, "./test.model") == 0);
+  gnn_w2v_free(w2v);
+  gnn_w2v_vocab_free(vocab);
+
+  assert(gnn_w2v_model_load("./not-found.model", GANN_MEM_DEFAULT, &vocab, &w2v) == -1);
+  assert(gnn_w2v_model_load("./test.model", GANN_MEM_DEFAULT, &vocab, &w2v) == 0);
+  assert(vocab->size == size && w2v->vocab_size == size);
+  assert(gnn_w2v_word_index(vocab, "wood") == wood && vocab->words[wood].count == count);
+  assert(memcmp(hidden, w2v->hidden_weights, length * sizeof(real)) == 0);
+  assert(same_paths(vocab, trained, 0, size) && hs_loss(w2v, vocab, size) == loss);
+
+  /*!
+  ** the new text brings new words, the old ones keep their ids and rows
+  */
+  assert(gnn_w2v_vocab_grow(vocab, "../../data/not-found.txt") == -1);
+  grown = gnn_w2v_vocab_grow(vocab, "../../data/chapter.txt");
+  assert(grown > 0 && vocab->size == size + grown);
+  assert(gnn_w2v_word_index(vocab, "wood") == wood);
+  assert(gnn_w2v_word_index(vocab, "肌肤") >= size);
+
+  // the known words but </s> keep their paths, </s> gives its leaf to the new words
+  assert(same_paths(vocab, trained, 1, size));
+  assert(vocab->words[0].codelen == trained->words[0].codelen + 1);
+  for (a = 0; a < vocab->size; a++)
+  {
+    assert(vocab->words[a].codelen > 0);
+    for (d = 0; d < vocab->words[a].codelen; d++)
+      assert(vocab->words[a].point[d] >= 0 && vocab->words[a].point[d] < vocab->size - 1);
+  }
+  assert(gnn_w2v_skipgram_continue(w2v, "../../data/chapter.txt", vocab, 0, 2, NULL) == -1);
+
+  gnn_rng_init(&rng, GANN_RNG_SEED, 1);
+  gnn_w2v_grow(w2v, vocab, &rng);
+  assert(w2v->vocab_size == vocab->size);
+  assert(memcmp(hidden, w2v->hidden_weights, length * sizeof(real)) == 0);
+  assert(hs_loss(w2v, vocab, size) == loss);
+
+  // the delta shares no words with the old text, so only the new rows train
+  a = gnn_w2v_word_index(vocab, "肌肤");
+  memcpy(row, w2v->hidden_weights + a * w2v->dim_num, w2v->dim_num * sizeof(real));
+  assert(gnn_w2v_skipgram_continue(w2v, "../../data/chapter.txt", vocab, 0, 2, NULL) == 0);
+  assert(memcmp(row, w2v->hidden_weights + a * w2v->dim_num, w2v->dim_num * sizeof(real)) != 0);
+  assert(memcmp(hidden, w2v->hidden_weights, length * sizeof(real)) == 0);
+  for (i = 0; i < (size_t) vocab->size * w2v->dim_num; i++)
+    assert(isfinite(w2v->hidden_weights[i]));
+
+  /*!
+  ** the delta only moves the inner nodes above the leaf of </s>, so the known
+  ** words are predicted about as well as before
+  */
+  assert(hs_loss(w2v, vocab, size) <= loss * 1.01);
+
+  // a grown model reloads with its paths rather than a rebuilt tree
+  assert(gnn_w2v_model_save(w2v, vocab, "./test.model") == 0);
+  assert(gnn_w2v_model_load("./test.model", GANN_MEM_DEFAULT, &loaded, &reloaded) == 0);
+  assert(loaded->size == vocab->size && same_paths(loaded, vocab, 0, vocab->size));
+  gnn_w2v_free(reloaded);
+  gnn_w2v_vocab_free(loaded);
+
+  free(hidden);
+  free(row);
+  gnn_w2v_free(w2v);
+  gnn_w2v_vocab_free(vocab);
+  gnn_w2v_vocab_free(trained);
+  return 0;
+}